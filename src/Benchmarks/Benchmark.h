@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace JMP::Benchmarks
+{
+struct Corpus
+{
+    std::string name;
+    std::vector<uint8_t> bytes;
+    // Where it was read from, empty for synthetic corpora.
+    std::string path;
+};
+
+struct Options
+{
+    std::string_view filter;
+    std::vector<std::string> extra_corpus_paths;
+    std::chrono::nanoseconds minimum_time{std::chrono::milliseconds(250)};
+};
+
+// Every corpus we benchmark against: synthetic random data, real x86-64 code from the build machine, and whatever
+// was passed on the command line. These are built once, and shared between benchmarks.
+const std::vector<Corpus>& corpora(const Options&);
+
+// Calls the callback repeatedly for at least the minimum time, and returns the fastest single iteration.
+// Taking the fastest iteration (rather than the average) keeps scheduler noise out of the numbers.
+template<typename Callback>
+std::chrono::nanoseconds measure(const Options& options, Callback callback)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto fastest = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds total{};
+    size_t iterations{};
+
+    // Always do at least a few iterations, so the first (cold) one doesn't decide the result.
+    while (total < options.minimum_time || iterations < 3)
+    {
+        auto start = Clock::now();
+        callback();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+        fastest = std::min(fastest, elapsed);
+        total += elapsed;
+        iterations++;
+    }
+
+    return fastest;
+}
+
+// Prevents the compiler from optimizing away a result we only compute for timing.
+template<typename T>
+void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+double gigabytes_per_second(size_t bytes, std::chrono::nanoseconds);
+
+void run_signature_benchmarks(const Options&);
+void run_code_cave_benchmarks(const Options&);
+void run_detour_benchmarks(const Options&);
+void run_dirty_page_benchmarks(const Options&);
+void run_import_hook_benchmarks(const Options&);
+void run_large_allocation_benchmarks(const Options&);
+void run_memory_map_benchmarks(const Options&);
+void run_memory_probe_benchmarks(const Options&);
+void run_module_scan_benchmarks(const Options&);
+void run_narrowing_scan_benchmarks(const Options&);
+void run_pointer_map_benchmarks(const Options&);
+void run_remote_patch_benchmarks(const Options&);
+void run_remote_process_benchmarks(const Options&);
+void run_symbol_resolver_benchmarks(const Options&);
+void run_value_scan_benchmarks(const Options&);
+void run_virtual_table_benchmarks(const Options&);
+void run_watch_point_benchmarks(const Options&);
+void run_x86_benchmarks(const Options&);
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/CodeCaveIndex.h>
+#include <JMP/ProtectionTransaction.h>
+#include <cstdio>
+#include <optional>
+#include <random>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t synthetic_size = 16 * 1024 * 1024;
+constexpr size_t allocation_size = 16;
+constexpr size_t allocation_count = 1000;
+constexpr size_t rescan_count = 20;
+
+double milliseconds(std::chrono::nanoseconds elapsed) { return static_cast<double>(elapsed.count()) / 1e6; }
+
+template<typename Callback>
+std::chrono::nanoseconds time_once(Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    return std::chrono::steady_clock::now() - start;
+}
+
+// Every run of padding, a byte at a time, like we'd search without an index.
+template<typename Callback>
+void for_each_run(const ModuleTable::Module& module, size_t minimum_size, Callback callback)
+{
+    for (auto& segment : module.segments)
+    {
+        if (!segment.protection.read || !segment.protection.execute)
+            continue;
+
+        auto bytes = segment.bytes();
+        for (size_t i = 0; i < bytes.size();)
+        {
+            if (bytes[i] != 0xCC && bytes[i] != 0)
+            {
+                i++;
+                continue;
+            }
+
+            auto end = i;
+            while (end < bytes.size() && bytes[end] == bytes[i])
+                end++;
+
+            auto start = bytes[i] == 0 ? i + CodeCaveIndex::zero_run_guard : i;
+            if (end >= start + minimum_size)
+                callback(segment.start + start, end - start);
+
+            i = end;
+        }
+    }
+}
+
+// Functions of random bytes, each padded with int3 up to the next 16 bytes like Clang and MSVC do, and a few runs of
+// zeros. GCC pads with multi-byte nops instead, which we can't tell apart from nops that run, so there are no caves in
+// what it builds.
+ModuleTable::Module make_synthetic_module(std::span<uint8_t> bytes)
+{
+    std::mt19937_64 random(1234);
+    size_t offset{};
+
+    while (offset < bytes.size())
+    {
+        auto function_size = std::min<size_t>(20 + random() % 400, bytes.size() - offset);
+        for (size_t i = 0; i < function_size; i++)
+        {
+            // Never padding, so the only runs are the ones we put there.
+            auto value = static_cast<uint8_t>(random());
+            bytes[offset + i] = value == 0xCC || value == 0 ? 0x90 : value;
+        }
+
+        offset += function_size;
+        auto padding_end = std::min(bytes.size(), (offset + 15) & ~size_t{15});
+        if (random() % 50 == 0)
+            padding_end = std::min(bytes.size(), offset + 32 + random() % 64);
+
+        auto padding = random() % 10 == 0 ? 0 : 0xCC;
+        for (; offset < padding_end; offset++)
+            bytes[offset] = padding;
+    }
+
+    Platform::modify_memory_protection(bytes, {true, false, true});
+
+    auto start = reinterpret_cast<uintptr_t>(bytes.data());
+    ModuleTable::Module module;
+    module.name = "synthetic";
+    module.base = start;
+    module.start = start;
+    module.end = start + bytes.size();
+    module.segments.push_back({start, bytes.size(), {true, false, true}});
+    return module;
+}
+
+std::optional<uintptr_t> find_closest_run(const ModuleTable::Module& module, uintptr_t near, size_t size)
+{
+    std::optional<uintptr_t> closest;
+    uint64_t closest_distance{};
+
+    for_each_run(module, size, [&](uintptr_t start, size_t) {
+        auto distance = start > near ? start - near : near - start;
+        if (!closest || distance < closest_distance)
+        {
+            closest = start;
+            closest_distance = distance;
+        }
+    });
+
+    return closest;
+}
+}
+
+void run_code_cave_benchmarks(const Options&)
+{
+    ModuleTable modules;
+
+    printf("%-24s %10s %10s %10s %10s %10s %8s\n", "module", "build ms", "caves", "free", "largest", "MiB", "");
+    for (auto& module : modules.modules())
+    {
+        size_t executable_size{};
+        for (auto& segment : module.segments)
+            executable_size += segment.protection.execute ? segment.size : 0;
+
+        std::optional<CodeCaveIndex> index;
+        auto elapsed = time_once([&] { index.emplace(module); });
+
+        size_t expected{};
+        for_each_run(module, CodeCaveIndex::default_minimum_size, [&](uintptr_t, size_t) { expected++; });
+
+        auto statistics = index->statistics();
+        printf("%-24s %10.3f %10zu %10zu %10zu %10.1f %8s\n", module.name.empty() ? "<main>" : module.name.c_str(),
+               milliseconds(elapsed), statistics.caves, statistics.free_bytes, statistics.largest,
+               static_cast<double>(executable_size) / (1024 * 1024),
+               statistics.caves == expected ? "correct" : "WRONG");
+    }
+
+    auto allocation = Platform::allocate_large(synthetic_size, {false, false});
+    auto synthetic = make_synthetic_module(allocation.bytes);
+
+    std::optional<CodeCaveIndex> synthetic_index;
+    auto build = time_once([&] { synthetic_index.emplace(synthetic); });
+
+    size_t expected{};
+    for_each_run(synthetic, CodeCaveIndex::default_minimum_size, [&](uintptr_t, size_t) { expected++; });
+
+    auto statistics = synthetic_index->statistics();
+    printf("%-24s %10.3f %10zu %10zu %10zu %10.1f %8s\n", synthetic.name.c_str(), milliseconds(build), statistics.caves,
+           statistics.free_bytes, statistics.largest, static_cast<double>(synthetic_size) / (1024 * 1024),
+           statistics.caves == expected ? "correct" : "WRONG");
+
+    // Allocating from the synthetic module, since it's the only one we know has caves.
+    auto& index = *synthetic_index;
+    std::mt19937_64 random(1234);
+    std::vector<uintptr_t> targets;
+    for (size_t i = 0; i < allocation_count; i++)
+        targets.push_back(synthetic.start + random() % (synthetic.end - synthetic.start));
+
+    std::vector<std::span<uint8_t>> allocations;
+    auto elapsed = time_once([&] {
+        for (auto target : targets)
+        {
+            if (auto bytes = index.allocate(reinterpret_cast<void*>(target), allocation_size))
+                allocations.push_back(*bytes);
+        }
+    });
+
+    printf("%-32s %10.1f ns/allocation %10zu allocated\n", "indexed",
+           static_cast<double>(elapsed.count()) / allocation_count, allocations.size());
+
+    elapsed = time_once([&] {
+        for (size_t i = 0; i < rescan_count; i++)
+            do_not_optimize(find_closest_run(synthetic, targets[i], allocation_size));
+    });
+
+    printf("%-32s %10.1f ns/allocation\n", "scanning the module each time",
+           static_cast<double>(elapsed.count()) / rescan_count);
+
+    // Everything freed merges back into the caves it came from.
+    auto before = index.statistics();
+    for (auto bytes : allocations)
+        index.free(bytes);
+
+    auto after = index.statistics();
+    auto merged = after.free_ranges == after.caves &&
+                  after.free_bytes == before.free_bytes + allocations.size() * allocation_size;
+    printf("%-32s %10zu ranges %10zu free bytes %8s\n", "freed", after.free_ranges, after.free_bytes,
+           merged ? "correct" : "WRONG");
+
+    // A stub in a cave runs: mov eax, 42; ret
+    static constexpr uint8_t stub[] = {0xB8, 0x2A, 0x00, 0x00, 0x00, 0xC3};
+    auto bytes = index.allocate(reinterpret_cast<void*>(synthetic.start), sizeof(stub), 16);
+    if (!bytes)
+    {
+        Platform::free_large(allocation.bytes);
+        return;
+    }
+
+    {
+        ProtectionTransaction transaction;
+        transaction.add(*bytes, {true, true, true});
+        auto restore = transaction.apply();
+        std::copy(std::begin(stub), std::end(stub), bytes->begin());
+    }
+
+    auto result = reinterpret_cast<int (*)()>(bytes->data())();
+    printf("%-32s %10d %8s\n", "stub in a cave returned", result, result == 42 ? "correct" : "WRONG");
+
+    Platform::free_large(allocation.bytes);
+}
+}
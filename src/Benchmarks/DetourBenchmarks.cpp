@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/DetourEngine.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace JMP::Benchmarks
+{
+using Function = int64_t (*)(int64_t);
+
+static constexpr size_t number_of_targets = 1000;
+static constexpr size_t function_stride = 32;
+
+static Function s_original;
+
+static int64_t replacement(int64_t value) { return s_original(value) + 1000; }
+
+// Generates functions that start with a RIP-relative load, so every hook has to fix up a displacement:
+//     mov rax, [rip + constant]
+//     add rax, rdi
+//     ret
+static uint8_t* generate_targets()
+{
+    auto code_size = number_of_targets * function_stride;
+    auto* mapping = static_cast<uint8_t*>(mmap(nullptr, code_size + number_of_targets * sizeof(int64_t),
+                                               PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (mapping == MAP_FAILED)
+        return nullptr;
+
+    auto* constants = reinterpret_cast<int64_t*>(mapping + code_size);
+
+    for (size_t i = 0; i < number_of_targets; i++)
+    {
+        auto* function = mapping + i * function_stride;
+        constants[i] = static_cast<int64_t>(i);
+
+        auto displacement = static_cast<int32_t>(reinterpret_cast<uint8_t*>(&constants[i]) - (function + 7));
+        memcpy(function, "\x48\x8B\x05", 3);
+        memcpy(function + 3, &displacement, sizeof(displacement));
+        memcpy(function + 7, "\x48\x01\xF8\xC3", 4);
+    }
+
+    mprotect(mapping, code_size, PROT_READ | PROT_EXEC);
+    return mapping;
+}
+
+template<typename Callback>
+static double nanoseconds_per_call(const Options& options, Callback callback)
+{
+    constexpr size_t calls = 100'000;
+
+    auto elapsed = measure(options, [&] {
+        for (size_t i = 0; i < calls; i++)
+            do_not_optimize(callback(static_cast<int64_t>(i)));
+    });
+
+    return static_cast<double>(elapsed.count()) / calls;
+}
+
+void run_detour_benchmarks(const Options& options)
+{
+    auto* targets = generate_targets();
+    if (!targets)
+        return;
+
+    auto target_at = [targets](size_t i) { return reinterpret_cast<void*>(targets + i * function_stride); };
+
+    DetourEngine engine;
+
+    std::vector<DetourEngine::Request> requests;
+    std::vector<void*> target_pointers;
+    for (size_t i = 0; i < number_of_targets; i++)
+    {
+        requests.push_back({target_at(i), reinterpret_cast<const void*>(&replacement)});
+        target_pointers.push_back(target_at(i));
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    auto fastest_install = std::chrono::nanoseconds::max();
+    auto fastest_uninstall = std::chrono::nanoseconds::max();
+
+    for (auto i = 0; i < 5; i++)
+    {
+        auto start = Clock::now();
+        engine.install(requests);
+        auto installed = Clock::now();
+        engine.uninstall(target_pointers);
+        auto uninstalled = Clock::now();
+
+        fastest_install = std::min(fastest_install, installed - start);
+        fastest_uninstall = std::min(fastest_uninstall, uninstalled - installed);
+    }
+
+    printf("%-28s %12.1f ns/hook (%zu hooks)\n", "install", static_cast<double>(fastest_install.count()) / number_of_targets,
+           number_of_targets);
+    printf("%-28s %12.1f ns/hook\n", "uninstall", static_cast<double>(fastest_uninstall.count()) / number_of_targets);
+
+    // Each of these seals on its own, which shouldn't cost a block apiece.
+    {
+        DetourEngine one_at_a_time;
+
+        auto start = Clock::now();
+        for (auto& request : requests)
+            one_at_a_time.install(request.target, request.replacement);
+        auto elapsed = Clock::now() - start;
+
+        printf("%-28s %12.1f ns/hook (%zu blocks)\n", "install one at a time",
+               static_cast<double>(elapsed.count()) / number_of_targets, one_at_a_time.arena_statistics().blocks);
+    }
+
+    auto target = reinterpret_cast<Function>(target_at(7));
+    auto direct = nanoseconds_per_call(options, target);
+
+    s_original = reinterpret_cast<Function>(engine.install(target_at(7), reinterpret_cast<const void*>(&replacement)));
+    auto hooked_result = target(1);
+
+    auto through_trampoline = nanoseconds_per_call(options, s_original);
+    auto through_hook = nanoseconds_per_call(options, target);
+
+    printf("%-28s %12.3f ns/call\n", "direct", direct);
+    printf("%-28s %12.3f ns/call\n", "original via trampoline", through_trampoline);
+    printf("%-28s %12.3f ns/call\n", "hooked (replacement+orig)", through_hook);
+    printf("%-28s %12s\n", "hooked result correct", hooked_result == 1 + 7 + 1000 ? "yes" : "NO");
+
+    engine.uninstall_all();
+    printf("%-28s %12s\n", "unhooked result correct", target(1) == 1 + 7 ? "yes" : "NO");
+
+    munmap(targets, number_of_targets * (function_stride + sizeof(int64_t)));
+}
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/DirtyPageTracker.h>
+#include <JMP/ValueScan.h>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <unistd.h>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t heap_size = 256 * 1024 * 1024;
+// One in this many pages is written to between scans.
+constexpr size_t written_page_interval = 50;
+
+double milliseconds(std::chrono::nanoseconds elapsed) { return static_cast<double>(elapsed.count()) / 1e6; }
+
+template<typename Callback>
+std::chrono::nanoseconds time_once(Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    return std::chrono::steady_clock::now() - start;
+}
+
+size_t count_in(const ValueScan::Results& results, std::span<const uint8_t> bytes)
+{
+    size_t count{};
+    results.for_each([&](uintptr_t address) {
+        count += address >= reinterpret_cast<uintptr_t>(bytes.data()) &&
+                 address < reinterpret_cast<uintptr_t>(bytes.data() + bytes.size());
+    });
+
+    return count;
+}
+
+void run_mode(DirtyPageTracker::Mode mode, const char* name, std::vector<uint32_t>& heap)
+{
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto values_per_page = page_size / sizeof(uint32_t);
+    std::span<const uint8_t> bytes{reinterpret_cast<const uint8_t*>(heap.data()), heap.size() * sizeof(uint32_t)};
+    auto scan = ValueScan::equal_to<uint32_t>(1337);
+
+    auto memory_map = MemoryMap::self();
+    std::optional<DirtyPageTracker> tracker;
+    auto elapsed = time_once([&] { tracker.emplace(mode, memory_map); });
+    printf("%-36s %10.1f ms %10.1f MiB tracked\n", name, milliseconds(elapsed),
+           static_cast<double>(tracker->tracked_size()) / (1024 * 1024));
+
+    ValueScan::Results before;
+    elapsed = time_once([&] { before = scan.scan(memory_map); });
+    printf("%-36s %10.1f ms\n", "  full scan", milliseconds(elapsed));
+
+    // Some of what we write is what we're looking for, so the incremental scan has something new to find.
+    elapsed = time_once([&] {
+        for (size_t i = 0; i < heap.size(); i += values_per_page * written_page_interval)
+            heap[i] = i % 3 ? heap[i] + 1 : 1337;
+    });
+    printf("%-36s %10.1f ms\n", "  write 1 in 50 pages", milliseconds(elapsed));
+
+    std::vector<std::span<const uint8_t>> dirty;
+    elapsed = time_once([&] { dirty = tracker->collect_dirty(); });
+
+    size_t dirty_size{};
+    for (auto range : dirty)
+        dirty_size += range.size();
+
+    printf("%-36s %10.1f ms %10.1f MiB dirty\n", "  collect dirty", milliseconds(elapsed),
+           static_cast<double>(dirty_size) / (1024 * 1024));
+
+    ValueScan::Results changed;
+    elapsed = time_once([&] { changed = scan.scan(dirty); });
+
+    // What we found before on pages that didn't change, plus what's on the ones that did, is everything there is.
+    auto in_dirty = [&](uintptr_t address) {
+        for (auto range : dirty)
+        {
+            if (address >= reinterpret_cast<uintptr_t>(range.data()) &&
+                address < reinterpret_cast<uintptr_t>(range.data() + range.size()))
+                return true;
+        }
+
+        return false;
+    };
+
+    size_t kept{};
+    before.for_each([&](uintptr_t address) {
+        kept += address >= reinterpret_cast<uintptr_t>(bytes.data()) &&
+                address < reinterpret_cast<uintptr_t>(bytes.data() + bytes.size()) && !in_dirty(address);
+    });
+
+    auto expected = count_in(scan.scan(bytes), bytes);
+    printf("%-36s %10.1f ms %10zu matches %8s\n", "  incremental scan", milliseconds(elapsed), kept + count_in(changed, bytes),
+           kept + count_in(changed, bytes) == expected ? "correct" : "WRONG");
+
+    // Every page's first write since we collected costs a (kernel handled) fault with write protection.
+    elapsed = time_once([&] {
+        for (size_t i = 0; i < heap.size(); i += values_per_page)
+            heap[i]++;
+    });
+    printf("%-36s %10.1f ms\n", "  write every page once", milliseconds(elapsed));
+}
+}
+
+void run_dirty_page_benchmarks(const Options&)
+{
+    std::vector<uint32_t> heap(heap_size / sizeof(uint32_t));
+
+    uint32_t state = 0x12345678;
+    for (auto& value : heap)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value = state;
+    }
+
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto elapsed = time_once([&] {
+        for (size_t i = 0; i < heap.size(); i += page_size / sizeof(uint32_t))
+            heap[i]++;
+    });
+    printf("%-36s %10.1f ms\n", "write every page once, untracked", milliseconds(elapsed));
+
+    if (DirtyPageTracker::is_supported(DirtyPageTracker::Mode::WriteProtect))
+        run_mode(DirtyPageTracker::Mode::WriteProtect, "write protect", heap);
+    else
+        printf("%-36s %10s\n", "write protect", "unsupported");
+
+    if (DirtyPageTracker::is_supported(DirtyPageTracker::Mode::SoftDirty))
+        run_mode(DirtyPageTracker::Mode::SoftDirty, "soft-dirty", heap);
+    else
+        printf("%-36s %10s\n", "soft-dirty", "unsupported");
+}
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/ImportHooks.h>
+#include <JMP/ModuleTable.h>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+namespace JMP::Benchmarks
+{
+static pid_t fake_getpid() { return 42; }
+
+template<typename Callback>
+static double nanoseconds_per_call(const Options& options, Callback callback)
+{
+    constexpr size_t calls = 100'000;
+
+    auto elapsed = measure(options, [&] {
+        for (size_t i = 0; i < calls; i++)
+            do_not_optimize(callback());
+    });
+
+    return static_cast<double>(elapsed.count()) / calls;
+}
+
+// Hooks every import of a large library with what it already resolves to, so nothing actually changes behaviour.
+static void run_mass_hooking(const ModuleTable& modules, const ModuleTable::Module& module)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto start = Clock::now();
+    ImportHooks hooks(modules, module);
+    auto indexed = Clock::now();
+
+    std::vector<ImportHooks::Request> requests;
+    for (auto symbol : hooks.imported_symbols())
+        requests.push_back({symbol, hooks.resolve(symbol)});
+
+    std::vector<std::string_view> symbols;
+    for (auto& request : requests)
+        symbols.push_back(request.symbol);
+
+    auto fastest_install = std::chrono::nanoseconds::max();
+    auto fastest_uninstall = std::chrono::nanoseconds::max();
+
+    for (auto i = 0; i < 5; i++)
+    {
+        auto install_start = Clock::now();
+        hooks.install(requests);
+        auto installed = Clock::now();
+        hooks.uninstall(symbols);
+        auto uninstalled = Clock::now();
+
+        fastest_install = std::min(fastest_install, installed - install_start);
+        fastest_uninstall = std::min(fastest_uninstall, uninstalled - installed);
+    }
+
+    auto count = static_cast<double>(requests.size());
+    printf("%-28s %12.1f us (%s, %zu imports)\n", "index",
+           static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(indexed - start).count()) / 1000,
+           module.name.c_str(), requests.size());
+    printf("%-28s %12.1f ns/hook\n", "install", static_cast<double>(fastest_install.count()) / count);
+    printf("%-28s %12.1f ns/hook\n", "uninstall", static_cast<double>(fastest_uninstall.count()) / count);
+}
+
+void run_import_hook_benchmarks(const Options& options)
+{
+    ModuleTable modules;
+
+    if (auto* library = modules.find_by_name("libstdc++.so.6"))
+        run_mass_hooking(modules, *library);
+
+    ImportHooks hooks(modules, *modules.main_module());
+    auto real_pid = getpid();
+
+    auto direct = nanoseconds_per_call(options, [] { return fake_getpid(); });
+
+    auto* original = reinterpret_cast<pid_t (*)()>(hooks.install("getpid", reinterpret_cast<const void*>(&fake_getpid)));
+    auto hooked_result = getpid();
+    auto through_got = nanoseconds_per_call(options, [] { return getpid(); });
+
+    printf("%-28s %12.3f ns/call\n", "replacement, direct", direct);
+    printf("%-28s %12.3f ns/call\n", "replacement, through GOT", through_got);
+    printf("%-28s %12s\n", "hooked result correct", hooked_result == 42 && original() == real_pid ? "yes" : "NO");
+
+    hooks.uninstall_all();
+    printf("%-28s %12s\n", "unhooked result correct", getpid() == real_pid ? "yes" : "NO");
+}
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/Platform.h>
+#include <cstdio>
+#include <cstring>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t buffer_size = 1024 * 1024 * 1024;
+constexpr size_t random_reads = 16 * 1024 * 1024;
+
+double milliseconds(std::chrono::nanoseconds elapsed) { return static_cast<double>(elapsed.count()) / 1e6; }
+
+template<typename Callback>
+std::chrono::nanoseconds time_once(Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    return std::chrono::steady_clock::now() - start;
+}
+
+// How much of our anonymous memory the kernel has backed with transparent huge pages.
+size_t anonymous_huge_page_size()
+{
+    auto* file = fopen("/proc/self/smaps_rollup", "re");
+    if (!file)
+        return 0;
+
+    char line[256];
+    size_t kilobytes{};
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "AnonHugePages: %zu kB", &kilobytes) == 1)
+            break;
+    }
+
+    fclose(file);
+    return kilobytes * 1024;
+}
+
+const char* name_of(Platform::LargeAllocation::Pages pages)
+{
+    switch (pages)
+    {
+        case Platform::LargeAllocation::Pages::Normal:
+            return "normal";
+        case Platform::LargeAllocation::Pages::TransparentHuge:
+            return "transparent huge";
+        case Platform::LargeAllocation::Pages::Huge:
+            return "huge";
+    }
+
+    return "?";
+}
+
+void run(const Options& options, const char* name, const Platform::LargeAllocationPolicy& policy)
+{
+    auto huge_before = anonymous_huge_page_size();
+    auto allocation = Platform::allocate_large(buffer_size, policy);
+    auto values = std::span(reinterpret_cast<uint64_t*>(allocation.bytes.data()), buffer_size / sizeof(uint64_t));
+
+    // The first touch of each page is when the kernel picks what backs it.
+    auto fill = time_once([&] {
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = i * 0x9E3779B97F4A7C15ull;
+    });
+
+    auto huge_backed = anonymous_huge_page_size() - huge_before;
+
+    // Random reads all over the buffer, which is mostly TLB misses with normal pages.
+    auto random = measure(options, [&] {
+        uint64_t state = 0x12345678;
+        uint64_t sum{};
+        for (size_t i = 0; i < random_reads; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            sum += values[state & (values.size() - 1)];
+        }
+
+        do_not_optimize(sum);
+    });
+
+    Platform::free_large(allocation.bytes);
+
+    printf("%-20s %-18s %6s %10.1f %12.1f %10.1f %12.2f\n", name, name_of(allocation.pages),
+           allocation.node_local ? "yes" : "no", static_cast<double>(huge_backed) / (1024 * 1024), milliseconds(fill),
+           milliseconds(random), static_cast<double>(random.count()) / random_reads);
+}
+}
+
+void run_large_allocation_benchmarks(const Options& options)
+{
+    printf("huge page size %zu KiB, buffers of %zu MiB\n", Platform::huge_page_size() / 1024,
+           buffer_size / (1024 * 1024));
+    printf("%-20s %-18s %6s %10s %12s %10s %12s\n", "asked for", "got", "local", "huge MiB", "fill ms", "random ms",
+           "ns/read");
+
+    run(options, "normal pages", {false, false});
+    run(options, "huge pages", {true, false});
+    run(options, "huge pages, local", {true, true});
+}
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/MemoryMap.h>
+#include <cstdio>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace JMP::Benchmarks
+{
+static void run_refresh(const Options& options, MemoryMap& memory_map)
+{
+    memory_map.refresh();
+    auto elapsed = measure(options, [&] { memory_map.refresh(); });
+
+    printf("%10zu %12.3f %14.3f\n", memory_map.regions().size(), static_cast<double>(elapsed.count()) / 1000,
+           static_cast<double>(elapsed.count()) / static_cast<double>(memory_map.regions().size()));
+}
+
+void run_memory_map_benchmarks(const Options& options)
+{
+    printf("%10s %12s %14s\n", "regions", "refresh us", "ns/region");
+
+    MemoryMap memory_map;
+    run_refresh(options, memory_map);
+
+    // Alternating protections stop the kernel from merging neighbouring mappings into one region.
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    for (size_t count : {1'000, 5'000, 20'000})
+    {
+        auto* mapping =
+            static_cast<uint8_t*>(mmap(nullptr, count * page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (mapping == MAP_FAILED)
+            continue;
+
+        for (size_t i = 0; i < count; i += 2)
+            mprotect(mapping + i * page_size, page_size, PROT_READ | PROT_WRITE);
+
+        run_refresh(options, memory_map);
+
+        auto lookups = memory_map.regions().size();
+        auto elapsed = measure(options, [&] {
+            for (size_t i = 0; i < count; i++)
+                do_not_optimize(memory_map.find(mapping + i * page_size));
+        });
+
+        printf("%10s %12s %14.3f (find)\n", "", "", static_cast<double>(elapsed.count()) / static_cast<double>(count));
+        do_not_optimize(lookups);
+
+        munmap(mapping, count * page_size);
+    }
+}
+}
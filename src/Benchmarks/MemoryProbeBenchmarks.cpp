@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/MemoryMap.h>
+#include <JMP/Platform.h>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <sys/mman.h>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t address_count = 4096;
+
+struct Probe
+{
+    std::vector<uintptr_t> addresses;
+    // What each address holds, or 0 for the ones that can't be read.
+    std::vector<uint64_t> expected;
+};
+
+// Scattered reads of separately allocated values, the same as following thousands of pointers. Every tenth address
+// is bad when invalid is set: alternately a null pointer plus an offset, and a page we've unmapped.
+Probe make_probe(std::span<const std::unique_ptr<uint64_t>> values, uintptr_t unmapped, bool invalid)
+{
+    Probe probe;
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (invalid && i % 10 == 0)
+        {
+            probe.addresses.push_back(i % 20 == 0 ? 0x18 : unmapped + i % 512);
+            probe.expected.push_back(0);
+            continue;
+        }
+
+        probe.addresses.push_back(reinterpret_cast<uintptr_t>(values[i].get()));
+        probe.expected.push_back(*values[i]);
+    }
+
+    return probe;
+}
+
+void run_probe(const Options& options, const char* name, const Probe& probe)
+{
+    std::vector<uint64_t> results(probe.addresses.size());
+    std::vector<Platform::MemoryRead> reads(probe.addresses.size());
+
+    auto batched = measure(options, [&] {
+        for (size_t i = 0; i < reads.size(); i++)
+            reads[i] = {probe.addresses[i], {reinterpret_cast<uint8_t*>(&results[i]), sizeof(uint64_t)}};
+
+        do_not_optimize(Platform::read_memory(reads));
+    });
+
+    size_t correct{};
+    for (size_t i = 0; i < reads.size(); i++)
+        correct += probe.expected[i] == 0 ? !reads[i].succeeded : reads[i].succeeded && results[i] == probe.expected[i];
+
+    auto one_at_a_time = measure(options, [&] {
+        for (auto address : probe.addresses)
+            do_not_optimize(Platform::read_memory<uint64_t>(address));
+    });
+
+    auto count = static_cast<double>(probe.addresses.size());
+    printf("%-24s %12.1f ns/read (batched) %12.1f ns/read (one at a time) %8zu/%zu correct\n", name,
+           static_cast<double>(batched.count()) / count, static_cast<double>(one_at_a_time.count()) / count, correct,
+           probe.addresses.size());
+}
+}
+
+void run_memory_probe_benchmarks(const Options& options)
+{
+    std::mt19937_64 random(1234);
+
+    std::vector<std::unique_ptr<uint64_t>> values;
+    for (size_t i = 0; i < address_count; i++)
+        values.push_back(std::make_unique<uint64_t>(random() | 1));
+
+    // Shuffled, so we don't just walk the heap in order.
+    std::shuffle(values.begin(), values.end(), random);
+
+    auto* page = mmap(nullptr, Platform::page_size(), PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    munmap(page, Platform::page_size());
+    auto unmapped = reinterpret_cast<uintptr_t>(page);
+
+    // What the reads would cost if we could just dereference them.
+    auto valid = make_probe(values, unmapped, false);
+    auto direct = measure(options, [&] {
+        for (auto address : valid.addresses)
+            do_not_optimize(*reinterpret_cast<const volatile uint64_t*>(address));
+    });
+
+    // Checking against a snapshot of our regions is much cheaper than a syscall, but it can't be trusted: another thread
+    // could unmap something after the check, and then we'd fault.
+    auto memory_map = MemoryMap::self();
+    auto checked = measure(options, [&] {
+        for (auto address : valid.addresses)
+        {
+            auto* region = memory_map.find(address);
+            if (region && region->protection.read && address + sizeof(uint64_t) <= region->end)
+                do_not_optimize(*reinterpret_cast<const volatile uint64_t*>(address));
+        }
+    });
+
+    printf("%-24s %12.1f ns/read\n", "direct", static_cast<double>(direct.count()) / address_count);
+    printf("%-24s %12.1f ns/read\n", "region map check", static_cast<double>(checked.count()) / address_count);
+    run_probe(options, "valid", valid);
+    run_probe(options, "10% invalid", make_probe(values, unmapped, true));
+
+    // Probing protections where most of what we try fails, throwing versus returning the error.
+    std::span<uint8_t> unmapped_page{reinterpret_cast<uint8_t*>(unmapped), Platform::page_size()};
+    size_t failures{};
+    auto throwing = measure(options, [&] {
+        for (size_t i = 0; i < address_count; i++)
+        {
+            try
+            {
+                Platform::modify_memory_protection(unmapped_page, {true, false, false});
+            }
+            catch (const Platform::PlatformException&)
+            {
+                failures++;
+            }
+        }
+    });
+
+    auto returning = measure(options, [&] {
+        for (size_t i = 0; i < address_count; i++)
+            failures += !Platform::try_modify_memory_protection(unmapped_page, {true, false, false});
+    });
+
+    printf("%-24s %12.1f ns/call (throwing) %12.1f ns/call (returning)\n", "failing mprotect",
+           static_cast<double>(throwing.count()) / address_count, static_cast<double>(returning.count()) / address_count);
+    do_not_optimize(failures);
+}
+}
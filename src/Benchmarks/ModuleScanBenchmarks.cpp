@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/ModuleScan.h>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t signature_length = 24;
+
+// A signature for bytes from the middle of the biggest executable segment we have, with a few wildcards.
+std::string make_pattern(const ModuleTable::Segment& segment, bool mutate_last_byte)
+{
+    auto* bytes = reinterpret_cast<const uint8_t*>(segment.start + segment.size / 2);
+    std::string pattern;
+    char formatted[4];
+
+    for (size_t i = 0; i < signature_length; i++)
+    {
+        if (i % 5 == 2)
+        {
+            pattern += "? ";
+            continue;
+        }
+
+        auto value = bytes[i];
+        if (mutate_last_byte && i == signature_length - 1)
+            value ^= 0xFF;
+
+        snprintf(formatted, sizeof(formatted), "%02X ", value);
+        pattern += formatted;
+    }
+
+    return pattern;
+}
+}
+
+void run_module_scan_benchmarks(const Options& options)
+{
+    ModuleTable modules;
+
+    const ModuleTable::Segment* biggest{};
+    size_t scanned_size{};
+    for (auto& module : modules.modules())
+    {
+        for (auto& segment : module.segments)
+        {
+            if (!segment.protection.read || !segment.protection.execute)
+                continue;
+
+            scanned_size += segment.size;
+            if (!biggest || segment.size > biggest->size)
+                biggest = &segment;
+        }
+    }
+
+    if (!biggest)
+    {
+        printf("No executable segments\n");
+        return;
+    }
+
+    auto expected = biggest->start + biggest->size / 2;
+    Signature present(make_pattern(*biggest, false));
+    // Almost certainly nowhere, so everything is scanned.
+    Signature absent(make_pattern(*biggest, true));
+
+    printf("%zu modules, %.1f MiB of executable segments, %u cores\n", modules.modules().size(),
+           static_cast<double>(scanned_size) / (1024 * 1024), std::thread::hardware_concurrency());
+    printf("%-8s %14s %14s %12s %14s\n", "threads", "find first ms", "find all ms", "GB/s", "found");
+
+    std::vector<size_t> thread_counts{1, 2, 4};
+    auto cores = std::max(1u, std::thread::hardware_concurrency());
+    if (cores > 4)
+        thread_counts.push_back(cores);
+
+    for (auto thread_count : thread_counts)
+    {
+        ModuleScan scan(modules);
+        scan.set_thread_count(thread_count);
+
+        std::vector<ModuleScan::Match> firsts;
+        auto find_first = measure(options, [&] { firsts = scan.find_first(present); });
+
+        std::vector<ModuleScan::Match> all;
+        auto find_all = measure(options, [&] { all = scan.find_all(absent); });
+
+        auto all_present = scan.find_all(present);
+        auto correct = std::any_of(firsts.begin(), firsts.end(),
+                                   [&](const ModuleScan::Match& match) { return match.address <= expected; }) &&
+                       std::any_of(all_present.begin(), all_present.end(),
+                                   [&](const ModuleScan::Match& match) { return match.address == expected; }) &&
+                       all.empty();
+
+        printf("%-8zu %14.3f %14.3f %12.3f %14s\n", thread_count, static_cast<double>(find_first.count()) / 1e6,
+               static_cast<double>(find_all.count()) / 1e6, gigabytes_per_second(scanned_size, find_all),
+               correct ? "correct" : "WRONG");
+    }
+}
+}
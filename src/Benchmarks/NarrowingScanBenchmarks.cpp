@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/NarrowingScan.h>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t heap_size = 256 * 1024 * 1024;
+
+// Every pass changes what's left, so we can only time each one once.
+template<typename Callback>
+std::chrono::nanoseconds time_once(Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    return std::chrono::steady_clock::now() - start;
+}
+
+void print_pass(const char* name, std::chrono::nanoseconds elapsed, const NarrowingScan& scan, size_t bytes)
+{
+    printf("%-28s %10.1f ms %10.2f GB/s %12zu candidates %10.1f MiB\n", name,
+           static_cast<double>(elapsed.count()) / 1e6, gigabytes_per_second(bytes, elapsed), scan.candidate_count(),
+           static_cast<double>(scan.memory_usage()) / (1024 * 1024));
+}
+}
+
+void run_narrowing_scan_benchmarks(const Options&)
+{
+    std::vector<int32_t> heap(heap_size / sizeof(int32_t));
+
+    uint32_t state = 0x12345678;
+    for (auto& value : heap)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value = static_cast<int32_t>(state);
+    }
+
+    std::span<const uint8_t> bytes{reinterpret_cast<const uint8_t*>(heap.data()), heap.size() * sizeof(int32_t)};
+
+    // Looking for a value that goes down (every 7th), then up by 10 (every 14th), then stays put.
+    std::optional<NarrowingScan> narrowing;
+    auto elapsed = time_once([&] { narrowing.emplace(ValueScan::Type::I32, std::span(&bytes, 1)); });
+    auto& scan = *narrowing;
+    print_pass("snapshot", elapsed, scan, bytes.size());
+
+    elapsed = time_once([&] { scan.keep_unchanged(); });
+    print_pass("unchanged, all survive", elapsed, scan, bytes.size());
+
+    for (size_t i = 0; i < heap.size(); i += 7)
+        heap[i] -= 3;
+
+    elapsed = time_once([&] { scan.keep_decreased(); });
+    print_pass("decreased, 1 in 7", elapsed, scan, bytes.size());
+
+    for (size_t i = 0; i < heap.size(); i += 14)
+        heap[i] += 10;
+
+    elapsed = time_once([&] { scan.keep_increased_by<int32_t>(10); });
+    print_pass("increased by 10, 1 in 14", elapsed, scan, bytes.size());
+
+    elapsed = time_once([&] { scan.keep_unchanged(); });
+    print_pass("unchanged, sparse", elapsed, scan, bytes.size());
+
+    // Exactly every 14th value should be left, each with the value it has now.
+    size_t verified{};
+    scan.for_each([&](uintptr_t address, const uint8_t* value) {
+        auto index = (address - reinterpret_cast<uintptr_t>(heap.data())) / sizeof(int32_t);
+        verified += index % 14 == 0 && memcmp(value, &heap[index], sizeof(int32_t)) == 0;
+    });
+
+    auto expected = (heap.size() + 13) / 14;
+    printf("%-28s %8s\n", "survivors", verified == expected && scan.candidate_count() == expected ? "correct" : "WRONG");
+
+    // Everything writable in this process, with its regions checked against a fresh memory map on each pass.
+    size_t whole_process_bytes{};
+    auto memory_map = MemoryMap::self();
+    memory_map.for_each_matching({{true, true, false}, {}},
+                                 [&](const MemoryMap::Region& region) { whole_process_bytes += region.bytes().size(); });
+
+    std::optional<NarrowingScan> whole_process;
+    elapsed = time_once([&] { whole_process.emplace(ValueScan::Type::I32, memory_map); });
+    print_pass("whole process, snapshot", elapsed, *whole_process, whole_process_bytes);
+
+    for (size_t i = 0; i < heap.size(); i += 1000)
+        heap[i]++;
+
+    elapsed = time_once([&] { whole_process->keep_increased(); });
+    print_pass("whole process, increased", elapsed, *whole_process, whole_process_bytes);
+}
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/FileStream.h>
+#include <JMP/PointerMap.h>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+namespace JMP::Benchmarks
+{
+// Where a path to the player starts. It's not in an anonymous namespace, so it stays in the executable's data.
+struct PointerMapWorld* pointer_map_world{};
+
+struct PointerMapPlayer
+{
+    uint8_t padding[0x10];
+    int32_t health{100};
+};
+
+struct PointerMapLevel
+{
+    uint8_t padding[0x40];
+    PointerMapPlayer* player{};
+};
+
+struct PointerMapWorld
+{
+    uint8_t padding[0x18];
+    PointerMapLevel* level{};
+};
+
+namespace
+{
+// The world, and some unrelated objects pointing at each other so there's something else to search through.
+struct Run
+{
+    std::unique_ptr<PointerMapWorld> world;
+    std::unique_ptr<PointerMapLevel> level;
+    std::unique_ptr<PointerMapPlayer> player;
+    std::vector<std::unique_ptr<uintptr_t[]>> clutter;
+
+    Run(size_t clutter_count, size_t clutter_size)
+    {
+        // Allocated in a different order each run, so the addresses move around like they would between launches.
+        for (size_t i = 0; i < clutter_count / 2; i++)
+            clutter.push_back(std::make_unique<uintptr_t[]>(clutter_size));
+
+        player = std::make_unique<PointerMapPlayer>();
+        level = std::make_unique<PointerMapLevel>();
+        world = std::make_unique<PointerMapWorld>();
+        level->player = player.get();
+        world->level = level.get();
+
+        for (size_t i = clutter_count / 2; i < clutter_count; i++)
+            clutter.push_back(std::make_unique<uintptr_t[]>(clutter_size));
+
+        uint32_t state = 0x12345678;
+        for (auto& block : clutter)
+        {
+            for (size_t i = 0; i < clutter_size; i++)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                // Mostly plain values, then pointers into other blocks, and a few near the player.
+                auto& other = clutter[state % clutter.size()];
+                if (state % 8)
+                    block[i] = state;
+                else if (state % 50'000)
+                    block[i] = reinterpret_cast<uintptr_t>(other.get() + state % clutter_size);
+                else
+                    block[i] = reinterpret_cast<uintptr_t>(player.get()) - state % 64;
+            }
+        }
+
+        pointer_map_world = world.get();
+    }
+
+    uintptr_t target() const { return reinterpret_cast<uintptr_t>(&player->health); }
+};
+
+double milliseconds(std::chrono::nanoseconds elapsed) { return static_cast<double>(elapsed.count()) / 1e6; }
+
+template<typename Callback>
+std::chrono::nanoseconds time_once(Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    return std::chrono::steady_clock::now() - start;
+}
+}
+
+void run_pointer_map_benchmarks(const Options& options)
+{
+    ModuleTable module_table;
+    PointerPath expected{"", reinterpret_cast<uintptr_t>(&pointer_map_world) - module_table.main_module()->start,
+                         {0x18, 0x40, 0x10}};
+
+    std::vector<PointerPath> first_paths;
+    std::vector<PointerPath> second_paths;
+    PointerMap::Limits limits;
+    limits.max_depth = 4;
+    limits.max_offset = 0x100;
+
+    for (auto* paths : {&first_paths, &second_paths})
+    {
+        Run run(4096, 512);
+        auto memory_map = MemoryMap::self();
+
+        PointerMap map;
+        auto elapsed = measure(options, [&] { map = PointerMap::build(module_table, memory_map); });
+        printf("%-28s %10.1f ms %12zu pointers\n", "build", milliseconds(elapsed), map.size());
+
+        elapsed = time_once([&] { *paths = map.find_paths(run.target(), limits); });
+
+        // Some paths go through memory that's been freed since the map was built, which is why we intersect.
+        size_t resolved{};
+        for (auto& path : *paths)
+            resolved += path.resolve(module_table) == run.target();
+
+        printf("%-28s %10.1f ms %12zu paths %12zu still resolve %8s\n", "find paths, depth 4", milliseconds(elapsed),
+               paths->size(), resolved,
+               std::find(paths->begin(), paths->end(), expected) != paths->end() && expected.resolve(module_table) == run.target()
+                   ? "correct"
+                   : "WRONG");
+
+        // The defaults, which look much further and find a lot more that won't survive.
+        std::vector<PointerPath> wide_paths;
+        elapsed = time_once([&] { wide_paths = map.find_paths(run.target()); });
+        printf("%-28s %10.1f ms %12zu paths\n", "find paths, defaults", milliseconds(elapsed), wide_paths.size());
+
+        // Searching a saved map should be no different from searching the one we built.
+        auto stream = FileStream::adopt(tmpfile());
+        elapsed = time_once([&] {
+            map.save(stream);
+            stream.seek(0, Stream::SeekOrigin::Start);
+        });
+        auto loaded = PointerMap::load(stream);
+        printf("%-28s %10.1f ms %12zu bytes %8s\n", "save", milliseconds(elapsed), stream.index(),
+               loaded.find_paths(run.target(), limits) == *paths ? "correct" : "WRONG");
+    }
+
+    std::vector<PointerPath> both;
+    auto elapsed = time_once([&] { both = PointerMap::intersect(first_paths, second_paths); });
+    printf("%-28s %10.1f ms %12zu paths %8s  (%s)\n", "intersect", milliseconds(elapsed), both.size(),
+           std::find(both.begin(), both.end(), expected) != both.end() ? "correct" : "WRONG",
+           expected.to_string().c_str());
+}
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/RemotePatchSet.h>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t writable_size = 64 * 1024 * 1024;
+constexpr size_t read_only_size = 4 * 1024 * 1024;
+constexpr size_t patch_count = 2000;
+
+// A child process with a zeroed writable buffer, and a zeroed buffer it can only read (like code would be). It stays
+// alive until we close our end of the pipe it's blocked reading.
+struct Target
+{
+    pid_t pid{};
+    int keep_alive_fd{-1};
+    uintptr_t writable{};
+    uintptr_t read_only{};
+
+    ~Target()
+    {
+        if (keep_alive_fd != -1)
+            close(keep_alive_fd);
+
+        if (pid > 0)
+            waitpid(pid, nullptr, 0);
+    }
+};
+
+bool spawn_target(Target& target)
+{
+    int address_pipe[2];
+    int keep_alive_pipe[2];
+    if (pipe(address_pipe) == -1 || pipe(keep_alive_pipe) == -1)
+        return false;
+
+    target.pid = fork();
+    if (target.pid == -1)
+        return false;
+
+    if (target.pid == 0)
+    {
+        close(address_pipe[0]);
+        close(keep_alive_pipe[1]);
+
+        auto* writable = mmap(nullptr, writable_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        auto* read_only = mmap(nullptr, read_only_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        uintptr_t addresses[2] = {reinterpret_cast<uintptr_t>(writable), reinterpret_cast<uintptr_t>(read_only)};
+        write(address_pipe[1], addresses, sizeof(addresses));
+
+        char unused;
+        read(keep_alive_pipe[0], &unused, sizeof(unused));
+        _exit(0);
+    }
+
+    close(address_pipe[1]);
+    close(keep_alive_pipe[0]);
+    target.keep_alive_fd = keep_alive_pipe[1];
+
+    uintptr_t addresses[2];
+    auto result = read(address_pipe[0], addresses, sizeof(addresses));
+    close(address_pipe[0]);
+
+    target.writable = addresses[0];
+    target.read_only = addresses[1];
+    return result == sizeof(addresses);
+}
+
+struct Patch
+{
+    uintptr_t address{};
+    std::vector<uint8_t> bytes;
+};
+
+// Mostly scattered, some in clusters on the same page (like several fields of an object), one in ten read-only.
+std::vector<Patch> make_patches(const Target& target)
+{
+    std::mt19937_64 random(1234);
+    std::vector<Patch> patches;
+
+    while (patches.size() < patch_count)
+    {
+        auto read_only = patches.size() % 10 == 0;
+        auto base = read_only ? target.read_only : target.writable;
+        auto size = read_only ? read_only_size : writable_size;
+        // Spaced out enough that patches never overlap.
+        auto address = base + (random() % (size / 256)) * 256;
+        size_t cluster = random() % 4 == 0 ? 4 : 1;
+
+        for (size_t i = 0; i < cluster && patches.size() < patch_count; i++)
+        {
+            Patch patch{address + i * 16, std::vector<uint8_t>(1 + random() % 8)};
+            for (auto& byte : patch.bytes)
+                byte = static_cast<uint8_t>(random() | 1);
+
+            patches.push_back(std::move(patch));
+        }
+    }
+
+    // Addresses were random, so some could have landed on the same spot. Keep the first of each.
+    std::vector<Patch> unique;
+    std::vector<uintptr_t> seen;
+    for (auto& patch : patches)
+    {
+        if (std::find(seen.begin(), seen.end(), patch.address) != seen.end())
+            continue;
+
+        seen.push_back(patch.address);
+        unique.push_back(std::move(patch));
+    }
+
+    return unique;
+}
+
+double milliseconds(std::chrono::nanoseconds elapsed) { return static_cast<double>(elapsed.count()) / 1e6; }
+}
+
+void run_remote_patch_benchmarks(const Options& options)
+{
+    Target target;
+    if (!spawn_target(target))
+    {
+        printf("Unable to spawn target process\n");
+        return;
+    }
+
+    RemoteProcess process(target.pid);
+    auto patches = make_patches(target);
+
+    RemotePatchSet patch_set(process);
+    for (auto& patch : patches)
+        patch_set.add(patch.address, patch.bytes);
+
+    // Applying and restoring together, as applying twice in a row does nothing.
+    size_t applied_mismatches{};
+    auto grouped = measure(options, [&] {
+        patch_set.apply();
+        applied_mismatches += patch_set.verify();
+        patch_set.restore();
+    });
+
+    auto restored_mismatches = patch_set.verify();
+
+    // The same patches one at a time: a read of the original, a write (through the memory file if it's read-only), and
+    // a read back for each.
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/mem", target.pid);
+    auto memory_file = open(path, O_RDWR | O_CLOEXEC);
+
+    auto one_at_a_time = measure(options, [&] {
+        for (auto& patch : patches)
+        {
+            uint8_t original[8];
+            uint8_t check[8];
+            iovec local{original, patch.bytes.size()};
+            iovec remote{reinterpret_cast<void*>(patch.address), patch.bytes.size()};
+            process_vm_readv(target.pid, &local, 1, &remote, 1, 0);
+
+            local = {patch.bytes.data(), patch.bytes.size()};
+            if (process_vm_writev(target.pid, &local, 1, &remote, 1, 0) == -1)
+                pwrite(memory_file, patch.bytes.data(), patch.bytes.size(), static_cast<off_t>(patch.address));
+
+            local = {check, patch.bytes.size()};
+            process_vm_readv(target.pid, &local, 1, &remote, 1, 0);
+
+            local = {original, patch.bytes.size()};
+            if (process_vm_writev(target.pid, &local, 1, &remote, 1, 0) == -1)
+                pwrite(memory_file, original, patch.bytes.size(), static_cast<off_t>(patch.address));
+        }
+    });
+
+    close(memory_file);
+
+    printf("%-24s %10zu patches %10zu groups\n", "patch set", patch_set.size(), patch_set.group_count());
+    printf("%-24s %10.2f ms %10.2f ms one at a time %8s\n", "apply, verify, restore", milliseconds(grouped),
+           milliseconds(one_at_a_time),
+           applied_mismatches == 0 && restored_mismatches == patch_set.size() ? "correct" : "WRONG");
+}
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/RemoteProcess.h>
+#include <JMP/Signature.h>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace JMP::Benchmarks
+{
+static constexpr size_t target_buffer_size = 256 * 1024 * 1024;
+static constexpr size_t batch_sizes[] = {256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024};
+
+// A child process holding a large buffer with a known pattern near the end of it. The child stays alive until we close
+// our end of the pipe it's blocked reading.
+struct Target
+{
+    pid_t pid{};
+    int keep_alive_fd{-1};
+    uintptr_t planted_address{};
+    uint8_t pattern[16]{};
+
+    ~Target()
+    {
+        if (keep_alive_fd != -1)
+            close(keep_alive_fd);
+
+        if (pid > 0)
+            waitpid(pid, nullptr, 0);
+    }
+};
+
+static bool spawn_target(Target& target)
+{
+    std::mt19937_64 engine{0x52454D4F};
+    for (auto& value : target.pattern)
+        value = static_cast<uint8_t>(engine());
+
+    int address_pipe[2];
+    int keep_alive_pipe[2];
+    if (pipe(address_pipe) == -1 || pipe(keep_alive_pipe) == -1)
+        return false;
+
+    target.pid = fork();
+    if (target.pid == -1)
+        return false;
+
+    if (target.pid == 0)
+    {
+        close(address_pipe[0]);
+        close(keep_alive_pipe[1]);
+
+        auto* buffer = static_cast<uint8_t*>(malloc(target_buffer_size));
+        for (size_t i = 0; i < target_buffer_size; i += sizeof(uint64_t))
+        {
+            auto value = engine();
+            memcpy(buffer + i, &value, sizeof(value));
+        }
+
+        auto* planted = buffer + target_buffer_size - target_buffer_size / 10;
+        memcpy(planted, target.pattern, sizeof(target.pattern));
+
+        auto address = reinterpret_cast<uintptr_t>(planted);
+        write(address_pipe[1], &address, sizeof(address));
+
+        char unused;
+        read(keep_alive_pipe[0], &unused, sizeof(unused));
+        _exit(0);
+    }
+
+    close(address_pipe[1]);
+    close(keep_alive_pipe[0]);
+    target.keep_alive_fd = keep_alive_pipe[1];
+
+    auto result = read(address_pipe[0], &target.planted_address, sizeof(target.planted_address));
+    close(address_pipe[0]);
+
+    return result == sizeof(target.planted_address);
+}
+
+void run_remote_process_benchmarks(const Options& options)
+{
+    Target target;
+    if (!spawn_target(target))
+    {
+        fprintf(stderr, "Unable to spawn target process: %s\n", strerror(errno));
+        return;
+    }
+
+    std::string pattern;
+    char formatted[4];
+    for (auto value : target.pattern)
+    {
+        snprintf(formatted, sizeof(formatted), "%02X ", value);
+        pattern += formatted;
+    }
+
+    Signature signature(pattern);
+    RemoteProcess process(target.pid);
+
+    // Only count what we actually had to copy out of the target to find the pattern.
+    size_t scanned{};
+    for (auto& region : process.regions())
+    {
+        if (!region.protection.read || region.start > target.planted_address)
+            continue;
+
+        scanned += std::min(region.end, target.planted_address) - region.start;
+    }
+
+    printf("%-12s %10s %10s %12s %10s\n", "batch size", "scanned", "found", "GB/s", "ms");
+
+    for (auto batch_size : batch_sizes)
+    {
+        process.set_batch_size(batch_size);
+
+        std::optional<uintptr_t> match;
+        auto elapsed = measure(options, [&] { match = process.find(signature); });
+
+        printf("%10zuK %9.1fM %10s %12.3f %10.3f\n", batch_size / 1024, static_cast<double>(scanned) / (1024 * 1024),
+               match == target.planted_address ? "yes" : "NO", gigabytes_per_second(scanned, elapsed),
+               static_cast<double>(elapsed.count()) / 1'000'000);
+    }
+}
+}
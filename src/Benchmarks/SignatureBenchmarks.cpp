@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/Signature.h>
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <optional>
+#include <random>
+
+namespace JMP::Benchmarks
+{
+static constexpr size_t pattern_lengths[] = {4, 8, 16, 32, 64};
+static constexpr unsigned wildcard_percentages[] = {0, 25, 50};
+
+static void print_header()
+{
+    printf("%-10s %-28s %6s %6s %10s %12s %14s\n", "corpus", "pattern", "length", "wild%", "scanned", "GB/s",
+           "ns/candidate");
+}
+
+static void run(const Options& options, const Corpus& corpus, std::string_view description, Signature& signature,
+                unsigned wildcard_percentage)
+{
+    auto bytes = std::span<uint8_t>(const_cast<uint8_t*>(corpus.bytes.data()), corpus.bytes.size());
+    if (bytes.size() <= signature.values().size())
+        return;
+
+    // Everything up to (and including) the match, or every place the pattern could start if there was no match, is
+    // what we scanned.
+    auto* match = static_cast<uint8_t*>(signature.find_in(bytes));
+    auto candidates = match ? static_cast<size_t>(match - bytes.data()) + 1
+                            : bytes.size() - signature.values().size() + 1;
+
+    auto elapsed = measure(options, [&] { do_not_optimize(signature.find_in(bytes)); });
+
+    printf("%-10s %-28.*s %6zu %6u %9.1fM %12.3f %14.3f\n", corpus.name.c_str(), static_cast<int>(description.size()),
+           description.data(), signature.values().size(), wildcard_percentage,
+           static_cast<double>(candidates) / (1024 * 1024), gigabytes_per_second(candidates, elapsed),
+           static_cast<double>(elapsed.count()) / static_cast<double>(candidates));
+}
+
+static std::string make_pattern(std::span<const uint8_t> bytes, unsigned wildcard_percentage, std::mt19937_64& engine,
+                                bool mutate_last_byte)
+{
+    std::uniform_int_distribution<unsigned> percentage{0, 99};
+    std::string pattern;
+    char formatted[4];
+
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        // Keep the first and last bytes concrete, like anyone writing a signature by hand would.
+        auto is_edge = i == 0 || i == bytes.size() - 1;
+        if (!is_edge && percentage(engine) < wildcard_percentage)
+        {
+            pattern += "? ";
+            continue;
+        }
+
+        auto value = bytes[i];
+        if (mutate_last_byte && i == bytes.size() - 1)
+            value ^= 0xFF;
+
+        snprintf(formatted, sizeof(formatted), "%02X ", value);
+        pattern += formatted;
+    }
+
+    return pattern;
+}
+
+// A pattern taken from somewhere in the corpus, changed so it's found nowhere in it, or nothing if we couldn't manage
+// that (like in a corpus of all the same byte).
+static std::optional<Signature> make_absent_signature(const Corpus& corpus, size_t length, unsigned wildcard_percentage,
+                                                      std::mt19937_64& engine)
+{
+    auto bytes = std::span<uint8_t>(const_cast<uint8_t*>(corpus.bytes.data()), corpus.bytes.size());
+    std::uniform_int_distribution<size_t> offset_distribution{0, bytes.size() - length};
+
+    for (auto attempt = 0; attempt < 100; attempt++)
+    {
+        Signature signature(make_pattern(bytes.subspan(offset_distribution(engine), length), wildcard_percentage,
+                                         engine, true));
+        if (!signature.find_in(bytes))
+            return signature;
+    }
+
+    return {};
+}
+
+// Breaks a signature taken from the corpus like an update would (changing some of its bytes), and checks that
+// approximate matching recovers the original location as the best match.
+static void run_approximate(const Options& options, const Corpus& corpus, size_t length, size_t max_mismatches,
+                            std::mt19937_64& engine)
+{
+    auto bytes = std::span<uint8_t>(const_cast<uint8_t*>(corpus.bytes.data()), corpus.bytes.size());
+    if (bytes.size() < length * 2)
+        return;
+
+    // Binaries repeat themselves (padding, and the same few instructions everywhere), so we take bytes that nothing
+    // else in the corpus is within twice the mismatches of. Then after breaking them, the original location is the
+    // only one left within max_mismatches, and recovering it is something find_approximate has to get right.
+    std::optional<size_t> offset;
+    for (auto candidate = bytes.size() - bytes.size() / 10; !offset && candidate + length <= bytes.size();
+         candidate += length)
+    {
+        Signature original(make_pattern(bytes.subspan(candidate, length), 0, engine, false));
+        if (original.find_approximate(bytes, max_mismatches * 2).size() == 1)
+            offset = candidate;
+    }
+
+    if (!offset)
+    {
+        printf("%-10s %6zu %6zu %10s\n", corpus.name.c_str(), length, max_mismatches, "no unique bytes to break");
+        return;
+    }
+
+    // Every mismatch at a different position, as breaking the same byte twice would undo it.
+    std::vector<size_t> positions(length);
+    std::iota(positions.begin(), positions.end(), 0);
+    std::shuffle(positions.begin(), positions.end(), engine);
+
+    std::vector<uint8_t> broken(bytes.begin() + *offset, bytes.begin() + *offset + length);
+    for (size_t i = 0; i < max_mismatches; i++)
+        broken[positions[i]] ^= 0x5A;
+
+    Signature signature(make_pattern(broken, 0, engine, false));
+
+    auto matches = signature.find_approximate(bytes, max_mismatches);
+    auto recovered = !matches.empty() && matches.front().address == bytes.data() + *offset;
+
+    auto elapsed = measure(options, [&] { do_not_optimize(signature.find_approximate(bytes, max_mismatches)); });
+
+    printf("%-10s %6zu %6zu %10zu %10s %12.3f %14.3f\n", corpus.name.c_str(), length, max_mismatches, matches.size(),
+           recovered ? "yes" : "NO", gigabytes_per_second(bytes.size(), elapsed),
+           static_cast<double>(elapsed.count()) / static_cast<double>(bytes.size()));
+}
+
+void run_signature_benchmarks(const Options& options)
+{
+    std::mt19937_64 engine{0x5349475};
+
+    print_header();
+
+    for (auto& corpus : corpora(options))
+    {
+        for (auto length : pattern_lengths)
+        {
+            if (corpus.bytes.size() < length * 2)
+                continue;
+
+            // Take a pattern from near the end of the corpus, so a hit still has to scan almost everything.
+            auto present_offset = corpus.bytes.size() - corpus.bytes.size() / 10;
+            auto present = std::span(corpus.bytes).subspan(std::min(present_offset, corpus.bytes.size() - length), length);
+
+            for (auto wildcard_percentage : wildcard_percentages)
+            {
+                Signature present_signature(make_pattern(present, wildcard_percentage, engine, false));
+                run(options, corpus, "present (90%)", present_signature, wildcard_percentage);
+
+                if (auto absent_signature = make_absent_signature(corpus, length, wildcard_percentage, engine))
+                    run(options, corpus, "absent", *absent_signature, wildcard_percentage);
+            }
+        }
+    }
+
+    // The worst case for any byte-by-byte scanner: every candidate matches all but the very last byte.
+    Corpus zeros{"zeros", std::vector<uint8_t>(16 * 1024 * 1024), {}};
+
+    for (auto length : pattern_lengths)
+    {
+        std::string pattern;
+        for (size_t i = 0; i < length - 1; i++)
+            pattern += "00 ";
+        pattern += "01";
+
+        Signature signature(pattern);
+        run(options, zeros, "worst case (00.. 01)", signature, 0);
+    }
+
+    // Leading wildcards defeat any scanner that only looks for the first byte.
+    for (auto length : pattern_lengths)
+    {
+        std::string pattern;
+        for (size_t i = 0; i < length - 1; i++)
+            pattern += "? ";
+        pattern += "01";
+
+        Signature signature(pattern);
+        run(options, zeros, "worst case (? .. 01)", signature, 100 * (length - 1) / length);
+    }
+
+    // Limits are only checked between chunks, so a limited scan should be as fast as an unlimited one.
+    printf("\n%-10s %16s %16s\n", "corpus", "unlimited GB/s", "limited GB/s");
+
+    for (auto& corpus : corpora(options))
+    {
+        auto bytes = std::span<uint8_t>(const_cast<uint8_t*>(corpus.bytes.data()), corpus.bytes.size());
+        Signature signature(make_pattern(bytes.first(16), 0, engine, true));
+
+        Signature::ScanLimits limits;
+        limits.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+        limits.byte_budget = bytes.size();
+        std::stop_source stop_source;
+        limits.stop_token = stop_source.get_token();
+
+        auto unlimited = measure(options, [&] { do_not_optimize(signature.find_in(bytes)); });
+        auto limited = measure(options, [&] { do_not_optimize(signature.find_in(bytes, limits)); });
+
+        printf("%-10s %16.3f %16.3f\n", corpus.name.c_str(), gigabytes_per_second(bytes.size(), unlimited),
+               gigabytes_per_second(bytes.size(), limited));
+    }
+
+    printf("\n%-10s %6s %6s %10s %10s %12s %14s\n", "corpus", "length", "k", "candidates", "recovered", "GB/s",
+           "ns/candidate");
+
+    for (auto& corpus : corpora(options))
+    {
+        for (size_t length : {16, 32, 64})
+        {
+            for (size_t max_mismatches : {1, 2, 3})
+                run_approximate(options, corpus, length, max_mismatches, engine);
+        }
+    }
+}
+}
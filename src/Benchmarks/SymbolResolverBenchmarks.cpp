@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/ElfImage.h>
+#include <JMP/ModuleTable.h>
+#include <JMP/SymbolResolver.h>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <elf.h>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+// Every exported function of a module, except IFUNCs, as dlsym gives what those resolve to rather than the resolver.
+std::vector<std::string_view> exported_functions(const ModuleTable::Module& module)
+{
+    ElfImage image(module);
+    std::vector<std::string_view> names;
+
+    for (size_t i = 1; i < image.symbol_count(); i++)
+    {
+        auto& symbol = image.symbol(i);
+        if (symbol.st_shndx != SHN_UNDEF && ELF64_ST_TYPE(symbol.st_info) == STT_FUNC &&
+            image.find_symbol(image.symbol_name(symbol)) == &symbol)
+            names.push_back(image.symbol_name(symbol));
+    }
+
+    return names;
+}
+
+void print_per_lookup(const char* name, std::chrono::nanoseconds elapsed, size_t lookups)
+{
+    printf("%-32s %12.1f ns/lookup\n", name, static_cast<double>(elapsed.count()) / static_cast<double>(lookups));
+}
+
+void run_exported(const Options& options, const ModuleTable::Module& module)
+{
+    auto* handle = dlopen(module.path.c_str(), RTLD_NOW | RTLD_NOLOAD);
+    if (!handle)
+        return;
+
+    SymbolResolver resolver(module);
+    auto names = exported_functions(module);
+
+    // dlsym wants null terminated names, which these are, as they point into the module's string table.
+    auto dlsym_time = measure(options, [&] {
+        for (auto name : names)
+            do_not_optimize(dlsym(handle, name.data()));
+    });
+
+    auto find_time = measure(options, [&] {
+        for (auto name : names)
+            do_not_optimize(resolver.find(name));
+    });
+
+    auto batch_time = measure(options, [&] { do_not_optimize(resolver.find(names).data()); });
+
+    // What we'd do without a hash table: compare against every symbol until we find it.
+    ElfImage image(module);
+    auto symbol_count = image.symbol_count();
+    auto scanned = std::min<size_t>(names.size(), 256);
+    auto scan_time = measure(options, [&] {
+        for (size_t i = 0; i < scanned; i++)
+        {
+            for (size_t j = 1; j < symbol_count; j++)
+            {
+                if (image.symbol_name(image.symbol(j)) == names[i])
+                {
+                    do_not_optimize(j);
+                    break;
+                }
+            }
+        }
+    });
+
+    size_t agreed{};
+    size_t reverse_agreed{};
+    std::vector<uintptr_t> middles;
+
+    for (auto name : names)
+    {
+        auto symbol = resolver.find(name);
+        if (!symbol.has_value() || reinterpret_cast<uintptr_t>(dlsym(handle, name.data())) != symbol->address)
+            continue;
+
+        agreed++;
+
+        // Anything in the middle of a function should find it, or an alias of it.
+        auto middle = symbol->address + symbol->size / 2;
+        middles.push_back(middle);
+
+        auto containing = resolver.find_by_address(middle);
+        reverse_agreed += containing.has_value() && containing->address == symbol->address;
+    }
+
+    auto reverse_time = measure(options, [&] {
+        for (auto address : middles)
+            do_not_optimize(resolver.find_by_address(address));
+    });
+
+    auto dladdr_time = measure(options, [&] {
+        Dl_info info;
+        for (auto address : middles)
+            do_not_optimize(dladdr(reinterpret_cast<void*>(address), &info));
+    });
+
+    printf("%s, %zu exported functions\n", module.name.c_str(), names.size());
+    print_per_lookup("dlsym", dlsym_time, names.size());
+    print_per_lookup("find", find_time, names.size());
+    print_per_lookup("find (batch)", batch_time, names.size());
+    print_per_lookup("linear scan", scan_time, scanned);
+    print_per_lookup("dladdr", dladdr_time, middles.size());
+    print_per_lookup("find_by_address", reverse_time, middles.size());
+    printf("%-32s %12zu/%zu\n", "agrees with dlsym", agreed, names.size());
+    printf("%-32s %12zu/%zu\n", "find_by_address round trips", reverse_agreed, middles.size());
+
+    dlclose(handle);
+}
+
+// A function that isn't exported, so it's only in .symtab.
+[[gnu::noinline]] int internal_function(int value) { return value * 3; }
+
+// A function with a smaller symbol nested at its second byte, so the closest symbol before its last bytes isn't the
+// one they're in.
+asm(R"(
+    .text
+    .type enclosing_function, @function
+enclosing_function:
+    nop
+    .type nested_function, @function
+nested_function:
+    nop
+    nop
+    .size nested_function, 2
+    nop
+    ret
+    .size enclosing_function, . - enclosing_function
+)");
+
+extern "C" void enclosing_function();
+
+void run_internal(const Options& options, const ModuleTable::Module& module)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto start = Clock::now();
+    SymbolResolver resolver(module, true);
+    auto mapped = Clock::now();
+
+    if (!resolver.has_symbol_table())
+    {
+        printf("main executable is stripped, skipping .symtab\n");
+        return;
+    }
+
+    auto function = reinterpret_cast<uintptr_t>(&internal_function);
+    auto symbol = resolver.find_by_address(function);
+    auto indexed = Clock::now();
+
+    if (!symbol.has_value())
+    {
+        printf("%-32s %12s\n", "internal symbol found", "NO");
+        return;
+    }
+
+    std::string name(symbol->name);
+    auto first_find_start = Clock::now();
+    auto found = resolver.find(name);
+    auto first_find_end = Clock::now();
+
+    std::string_view names[] = {name};
+    auto find_time = measure(options, [&] { do_not_optimize(resolver.find(name)); });
+
+    SymbolResolver batch_resolver(module, true);
+    auto batch_time = measure(options, [&] { do_not_optimize(batch_resolver.find(names).data()); });
+
+    auto microseconds = [](Clock::duration duration) {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / 1000;
+    };
+
+    printf("main executable, .symtab\n");
+    printf("%-32s %12.1f us\n", "map", microseconds(mapped - start));
+    printf("%-32s %12.1f us\n", "first find_by_address", microseconds(indexed - mapped));
+    printf("%-32s %12.1f us\n", "first find (builds index)", microseconds(first_find_end - first_find_start));
+    print_per_lookup("find", find_time, 1);
+    print_per_lookup("find (batch, without index)", batch_time, 1);
+    printf("%-32s %12s\n", "internal symbol round trips",
+           found.has_value() && found->address == function && symbol->name == found->name ? "yes" : "NO");
+
+    auto enclosing = reinterpret_cast<uintptr_t>(&enclosing_function);
+    auto past_nested = resolver.find_by_address(enclosing + 3);
+    printf("%-32s %12s\n", "past a nested symbol",
+           past_nested.has_value() && past_nested->address == enclosing ? "yes" : "NO");
+}
+}
+
+void run_symbol_resolver_benchmarks(const Options& options)
+{
+    ModuleTable modules;
+
+    for (auto* name : {"libc.so.6", "libstdc++.so.6"})
+    {
+        if (auto* module = modules.find_by_name(name))
+        {
+            run_exported(options, *module);
+            printf("\n");
+        }
+    }
+
+    do_not_optimize(internal_function(1));
+    run_internal(options, *modules.main_module());
+}
+}
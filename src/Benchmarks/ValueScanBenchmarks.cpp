@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/ValueScan.h>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+// Large enough that it's mostly memory bandwidth we're measuring, small enough to allocate anywhere.
+constexpr size_t heap_size = 512 * 1024 * 1024;
+
+// The straightforward loop, which every scan's results are checked against.
+template<typename T, typename Predicate>
+size_t count_naively(std::span<const uint8_t> bytes, size_t stride, Predicate predicate)
+{
+    size_t count{};
+    for (size_t offset = 0; offset + sizeof(T) <= bytes.size(); offset += stride)
+    {
+        T value;
+        memcpy(&value, bytes.data() + offset, sizeof(T));
+        count += predicate(value);
+    }
+
+    return count;
+}
+
+template<typename T, typename Predicate>
+void run_scan(const Options& options, const char* name, std::span<const uint8_t> heap, const ValueScan& scan,
+              Predicate predicate)
+{
+    ValueScan::Results results;
+    auto elapsed = measure(options, [&] { results = scan.scan(heap); });
+
+    // Every result should be a real match, and there should be as many as the slow way finds.
+    size_t verified{};
+    results.for_each([&](uintptr_t address) {
+        T value;
+        memcpy(&value, reinterpret_cast<const void*>(address), sizeof(T));
+        verified += predicate(value);
+    });
+
+    auto expected = count_naively<T>(heap, scan.is_aligned() ? sizeof(T) : 1, predicate);
+    auto seconds_per_byte = static_cast<double>(elapsed.count()) / 1e9 / static_cast<double>(heap.size());
+
+    printf("%-24s %10.2f GB/s %10.1f ms/2 GiB %12zu matches %8s\n", name, gigabytes_per_second(heap.size(), elapsed),
+           seconds_per_byte * 2.0 * 1024 * 1024 * 1024 * 1000, results.size(),
+           verified == results.size() && results.size() == expected ? "correct" : "WRONG");
+}
+}
+
+void run_value_scan_benchmarks(const Options& options)
+{
+    std::vector<uint32_t> heap(heap_size / sizeof(uint32_t));
+
+    // Mostly random values, with some we'll look for sprinkled in.
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < heap.size(); i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        heap[i] = state;
+
+        if (i % 100'003 == 0)
+            heap[i] = 1337;
+        else if (i % 100'019 == 0)
+            heap[i] = std::bit_cast<uint32_t>(3.504f);
+    }
+
+    std::span<const uint8_t> bytes{reinterpret_cast<const uint8_t*>(heap.data()), heap.size() * sizeof(uint32_t)};
+
+    run_scan<uint32_t>(options, "u32 == 1337", bytes, ValueScan::equal_to<uint32_t>(1337),
+                       [](uint32_t value) { return value == 1337; });
+    run_scan<uint32_t>(options, "u32 == 1337, unaligned", bytes,
+                       ValueScan::equal_to<uint32_t>(1337).set_aligned(false), [](uint32_t value) { return value == 1337; });
+    run_scan<float>(options, "f32 near 3.5 +- 0.01", bytes, ValueScan::near(3.5f, 0.01f),
+                    [](float value) { return value >= 3.5f - 0.01f && value <= 3.5f + 0.01f; });
+    run_scan<double>(options, "f64 near 1.0 +- 0.5", bytes, ValueScan::near(1.0, 0.5),
+                     [](double value) { return value >= 0.5 && value <= 1.5; });
+    run_scan<uint8_t>(options, "u8 == 0x42", bytes, ValueScan::equal_to<uint8_t>(0x42),
+                      [](uint8_t value) { return value == 0x42; });
+    run_scan<int16_t>(options, "i16 in [-10, 10]", bytes, ValueScan::between<int16_t>(-10, 10),
+                      [](int16_t value) { return value >= -10 && value <= 10; });
+    run_scan<uint64_t>(options, "u64 < 2^40", bytes, ValueScan::between<uint64_t>(0, 1ull << 40),
+                       [](uint64_t value) { return value <= 1ull << 40; });
+
+    // Everything writable in this process, which includes the heap above and whatever else we've allocated.
+    auto memory_map = MemoryMap::self();
+    ValueScan::Results results;
+    auto scan = ValueScan::equal_to<uint32_t>(1337);
+    auto elapsed = measure(options, [&] { results = scan.scan(memory_map); });
+
+    auto in_heap_expected = count_naively<uint32_t>(bytes, sizeof(uint32_t), [](uint32_t value) { return value == 1337; });
+    size_t in_heap{};
+    results.for_each([&](uintptr_t address) { in_heap += address >= reinterpret_cast<uintptr_t>(bytes.data()) &&
+                                                         address < reinterpret_cast<uintptr_t>(bytes.data() + bytes.size()); });
+
+    printf("%-24s %10.1f ms %25zu matches %8s\n", "whole process, u32", static_cast<double>(elapsed.count()) / 1e6,
+           results.size(), in_heap == in_heap_expected ? "correct" : "WRONG");
+}
+}
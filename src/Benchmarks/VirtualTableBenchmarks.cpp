@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/Platform.h>
+#include <JMP/ShadowVirtualTable.h>
+#include <JMP/VirtualTableHooks.h>
+#include <cstdio>
+#include <memory>
+
+namespace JMP::Benchmarks
+{
+// Enough virtual functions to batch, each returning something different so we can tell which one was called. This
+// isn't in the anonymous namespace, as then the compiler knows nothing derives from it and skips the vtable.
+struct VirtualTableTarget
+{
+    virtual ~VirtualTableTarget() = default;
+
+#define VIRTUAL_FUNCTION(n) \
+    virtual int function##n(int value) { return value + n; }
+
+    VIRTUAL_FUNCTION(0)
+    VIRTUAL_FUNCTION(1)
+    VIRTUAL_FUNCTION(2)
+    VIRTUAL_FUNCTION(3)
+    VIRTUAL_FUNCTION(4)
+    VIRTUAL_FUNCTION(5)
+    VIRTUAL_FUNCTION(6)
+    VIRTUAL_FUNCTION(7)
+    VIRTUAL_FUNCTION(8)
+    VIRTUAL_FUNCTION(9)
+    VIRTUAL_FUNCTION(10)
+    VIRTUAL_FUNCTION(11)
+    VIRTUAL_FUNCTION(12)
+    VIRTUAL_FUNCTION(13)
+#undef VIRTUAL_FUNCTION
+};
+
+namespace
+{
+using Target = VirtualTableTarget;
+
+constexpr size_t function_count = 16;
+
+// The destructor takes two slots in the Itanium ABI (complete and deleting), before function0.
+constexpr size_t first_function = 2;
+
+int replacement(Target*, int value) { return value * 1000; }
+
+[[gnu::noinline]] int call_first(Target& target, int value) { return target.function0(value); }
+
+// How we used to do it: an mprotect pair for every slot.
+void patch_one_at_a_time(void** table, std::span<void* const> values)
+{
+    for (size_t i = first_function; i < function_count; i++)
+    {
+        auto page = reinterpret_cast<uintptr_t>(table + i) & ~(Platform::page_size() - 1);
+        std::span<uint8_t> bytes{reinterpret_cast<uint8_t*>(page), Platform::page_size()};
+
+        Platform::modify_memory_protection(bytes, {true, true, false});
+        table[i] = values[i - first_function];
+        Platform::modify_memory_protection(bytes, {true, false, false});
+    }
+}
+}
+
+void run_virtual_table_benchmarks(const Options& options)
+{
+    auto target = std::make_unique<Target>();
+    auto other = std::make_unique<Target>();
+    auto* table = VirtualTableHooks::table_of(target.get());
+    auto hooked_slots = function_count - first_function;
+
+    // Shared vtable, every slot in one batch.
+    std::vector<VirtualTableHooks::Request> requests;
+    std::vector<VirtualTableHooks::Slot> slots;
+    for (auto i = first_function; i < function_count; i++)
+    {
+        requests.push_back({{table, i}, reinterpret_cast<const void*>(&replacement)});
+        slots.push_back({table, i});
+    }
+
+    VirtualTableHooks hooks;
+    auto batch = measure(options, [&] {
+        hooks.install(requests);
+        hooks.uninstall(slots);
+    });
+
+    hooks.install(requests);
+    auto shared_hooked = call_first(*target, 1) == 1000 && call_first(*other, 1) == 1000;
+    hooks.uninstall_all();
+    auto shared_unhooked = call_first(*target, 1) == 1 && call_first(*other, 1) == 1;
+
+    std::vector<void*> originals(table + first_function, table + function_count);
+    std::vector<void*> replacements(hooked_slots, reinterpret_cast<void*>(&replacement));
+    auto one_at_a_time = measure(options, [&] {
+        patch_one_at_a_time(table, replacements);
+        patch_one_at_a_time(table, originals);
+    });
+
+    // One object, nothing shared.
+    auto shadow_hook = measure(options, [&] {
+        ShadowVirtualTable shadow(target.get(), function_count);
+        for (auto i = first_function; i < function_count; i++)
+            shadow.install(i, reinterpret_cast<const void*>(&replacement));
+        shadow.uninstall_all();
+    });
+
+    ShadowVirtualTable shadow(target.get(), function_count);
+    auto install_uninstall = measure(options, [&] {
+        for (size_t i = 0; i < 1000; i++)
+        {
+            shadow.install(first_function, reinterpret_cast<const void*>(&replacement));
+            shadow.uninstall(first_function);
+        }
+    });
+
+    auto* original = reinterpret_cast<int (*)(Target*, int)>(
+        shadow.install(first_function, reinterpret_cast<const void*>(&replacement)));
+    auto shadow_hooked = call_first(*target, 1) == 1000 && call_first(*other, 1) == 1 && original(target.get(), 1) == 1 &&
+                         typeid(*target) == typeid(Target) && dynamic_cast<Target*>(target.get()) == target.get();
+
+    auto count = static_cast<double>(hooked_slots);
+    printf("%-36s %12.1f ns/slot\n", "shared, batched install+uninstall", static_cast<double>(batch.count()) / count);
+    printf("%-36s %12.1f ns/slot\n", "shared, mprotect per slot", static_cast<double>(one_at_a_time.count()) / count);
+    printf("%-36s %12.1f ns/slot\n", "shadow, copy+install+restore", static_cast<double>(shadow_hook.count()) / count);
+    printf("%-36s %12.1f ns\n", "shadow, install+uninstall", static_cast<double>(install_uninstall.count()) / 1000);
+    printf("%-36s %12s\n", "shared hook correct", shared_hooked && shared_unhooked ? "yes" : "NO");
+    printf("%-36s %12s\n", "shadow hook correct", shadow_hooked ? "yes" : "NO");
+}
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/Platform.h>
+#include <JMP/WatchPoints.h>
+#include <cstdio>
+#include <limits>
+#include <thread>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+constexpr size_t write_count = 20'000;
+constexpr size_t hot_write_count = 10'000'000;
+
+double milliseconds(std::chrono::nanoseconds elapsed) { return static_cast<double>(elapsed.count()) / 1e6; }
+
+template<typename Callback>
+std::chrono::nanoseconds time_once(Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    callback();
+    return std::chrono::steady_clock::now() - start;
+}
+
+// Out of line, so every write is the same instruction.
+[[gnu::noinline]] void write_values(volatile uint64_t* value, size_t count, uint64_t first)
+{
+    for (size_t i = 0; i < count; i++)
+        *value = first + i;
+}
+
+// Each value is only there for an instruction or two, which polling would almost never see.
+[[gnu::noinline]] void write_briefly(volatile uint64_t* value, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        *value = 0xdead;
+        *value = 0;
+    }
+}
+
+void print(const char* name, std::chrono::nanoseconds elapsed, size_t writes, size_t hits, const char* result)
+{
+    printf("%-32s %10.2f ms %10.1f ns/write %10zu hits %8s\n", name, milliseconds(elapsed),
+           static_cast<double>(elapsed.count()) / static_cast<double>(writes), hits, result);
+}
+}
+
+void run_watch_point_benchmarks(const Options&)
+{
+    if (!WatchPoints::is_supported())
+    {
+        printf("Unsupported\n");
+        return;
+    }
+
+    auto allocation = Platform::allocate_large(2 * Platform::page_size(), {false, false});
+    auto* watched = reinterpret_cast<volatile uint64_t*>(allocation.bytes.data());
+    // On the same page, but not watched.
+    auto* neighbour = reinterpret_cast<volatile uint64_t*>(allocation.bytes.data() + 64);
+    uint64_t unwatched_value{};
+
+    auto elapsed = time_once([&] { write_values(&unwatched_value, write_count, 1); });
+    print("unwatched", elapsed, write_count, 0, "");
+
+    {
+        // Every write goes through, none are coalesced.
+        WatchPoints watch_points({std::numeric_limits<size_t>::max(), std::chrono::milliseconds(10), 1 << 16});
+        watch_points.watch(reinterpret_cast<uintptr_t>(watched), sizeof(uint64_t));
+
+        elapsed = time_once([&] { write_values(watched, write_count, 1); });
+        auto hits = watch_points.collect();
+
+        auto correct = hits.size() == write_count;
+        for (size_t i = 0; correct && i < hits.size(); i++)
+        {
+            correct = hits[i].value == i + 1 && hits[i].address == reinterpret_cast<uintptr_t>(watched) &&
+                      hits[i].instruction == hits[0].instruction && hits[i].instruction;
+        }
+
+        print("watched", elapsed, write_count, hits.size(), correct ? "correct" : "WRONG");
+
+        elapsed = time_once([&] { write_values(neighbour, write_count, 1); });
+        hits = watch_points.collect();
+        print("same page, not watched", elapsed, write_count, hits.size(), hits.empty() ? "correct" : "WRONG");
+
+        elapsed = time_once([&] { write_briefly(watched, write_count / 2); });
+        hits = watch_points.collect();
+        print("short-lived values", elapsed, write_count, hits.size(),
+              hits.size() == write_count && watch_points.dropped() == 0 ? "correct" : "WRONG");
+    }
+
+    {
+        WatchPoints watch_points({std::numeric_limits<size_t>::max(), std::chrono::milliseconds(10), 1 << 16});
+
+        // Every write to this one faults on both pages, and both have to be protected again afterwards.
+        auto* spanning = reinterpret_cast<volatile uint64_t*>(allocation.bytes.data() + Platform::page_size() - 4);
+        watch_points.watch(reinterpret_cast<uintptr_t>(spanning), sizeof(uint64_t));
+        watch_points.watch(reinterpret_cast<uintptr_t>(watched), sizeof(uint64_t));
+
+        elapsed = time_once([&] { write_values(spanning, write_count, 1); });
+        write_values(watched, 1, 1234);
+        auto hits = watch_points.collect();
+        auto correct = hits.size() == write_count + 1 && hits.back().value == 1234;
+        print("across a page boundary", elapsed, write_count, hits.size(), correct ? "correct" : "WRONG");
+    }
+
+    {
+        WatchPoints watch_points;
+        watch_points.watch(reinterpret_cast<uintptr_t>(watched), sizeof(uint64_t));
+
+        // A page this hot only costs a fault for its first few writes in each window.
+        elapsed = time_once([&] { write_values(watched, hot_write_count, 1); });
+        auto hits = watch_points.collect();
+        print("hot page, coalesced", elapsed, hot_write_count, hits.size(), "");
+        printf("%-32s %10zu times\n", "  coalesced", watch_points.coalesced());
+
+        // Once the window is over, collecting protects it again.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        watch_points.collect();
+        write_values(watched, 1, 1234);
+        hits = watch_points.collect();
+        printf("%-32s %10zu hits %8s\n", "  after cooling down", hits.size(),
+               hits.size() == 1 && hits[0].value == 1234 ? "correct" : "WRONG");
+    }
+
+    Platform::free_large(allocation.bytes);
+}
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/X86.h>
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include <optional>
+#include <span>
+
+namespace JMP::Benchmarks
+{
+namespace
+{
+struct TextSection
+{
+    std::span<const uint8_t> bytes;
+    uint64_t address{};
+};
+
+std::optional<TextSection> find_text_section(std::span<const uint8_t> file)
+{
+    if (file.size() < sizeof(Elf64_Ehdr))
+        return {};
+
+    Elf64_Ehdr header;
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_machine != EM_X86_64 || header.e_shentsize != sizeof(Elf64_Shdr) || header.e_shstrndx >= header.e_shnum ||
+        header.e_shoff + header.e_shnum * sizeof(Elf64_Shdr) > file.size())
+        return {};
+
+    auto section = [&](size_t index) {
+        Elf64_Shdr section_header;
+        memcpy(&section_header, file.data() + header.e_shoff + index * sizeof(Elf64_Shdr), sizeof(section_header));
+        return section_header;
+    };
+
+    auto names = section(header.e_shstrndx);
+
+    for (size_t i = 0; i < header.e_shnum; i++)
+    {
+        auto candidate = section(i);
+        if (candidate.sh_type != SHT_PROGBITS || names.sh_offset + candidate.sh_name + sizeof(".text") > file.size() ||
+            memcmp(file.data() + names.sh_offset + candidate.sh_name, ".text", sizeof(".text")) != 0 ||
+            candidate.sh_offset + candidate.sh_size > file.size())
+            continue;
+
+        return TextSection{file.subspan(candidate.sh_offset, candidate.sh_size), candidate.sh_addr};
+    }
+
+    return {};
+}
+
+struct Validation
+{
+    size_t compared{};
+    size_t mismatches{};
+};
+
+// Compares our length for every instruction objdump found in .text against its own. objdump decodes from each
+// instruction's end, so one disagreement doesn't throw off the rest.
+std::optional<Validation> validate_against_objdump(const std::string& path, const TextSection& text)
+{
+    if (path.find('\'') != std::string::npos)
+        return {};
+
+    auto command = "objdump -d --insn-width=16 -j .text '" + path + "' 2>/dev/null";
+    auto* output = popen(command.c_str(), "r");
+    if (!output)
+        return {};
+
+    Validation validation;
+    char line[512];
+
+    while (fgets(line, sizeof(line), output))
+    {
+        // "  1a2b0:\tf3 0f 1e fa          \tendbr64"
+        char* end;
+        auto address = strtoull(line, &end, 16);
+        if (end == line || end[0] != ':' || end[1] != '\t')
+            continue;
+
+        auto* raw_bytes = end + 2;
+        auto* mnemonic = strchr(raw_bytes, '\t');
+        if (!mnemonic || strncmp(mnemonic + 1, "(bad)", 5) == 0)
+            continue;
+
+        size_t length{};
+        for (auto* c = raw_bytes; c < mnemonic; c++)
+            length += *c != ' ' && (c == raw_bytes || c[-1] == ' ');
+
+        if (address < text.address || address - text.address >= text.bytes.size())
+            continue;
+
+        auto offset = address - text.address;
+        auto instruction = X86::decode(text.bytes.subspan(offset));
+        size_t decoded_length = instruction.has_value() ? instruction->length : 0;
+
+        validation.compared++;
+        if (decoded_length == length)
+            continue;
+
+        if (validation.mismatches++ < 10)
+        {
+            printf("  mismatch at %#llx, objdump %zu, decoded %zu:", static_cast<unsigned long long>(address), length,
+                   decoded_length);
+            for (size_t i = 0; i < std::min<size_t>(length, text.bytes.size() - offset); i++)
+                printf(" %02x", text.bytes[offset + i]);
+            printf(" %s", mnemonic + 1);
+        }
+    }
+
+    if (pclose(output) != 0 || validation.compared == 0)
+        return {};
+
+    return validation;
+}
+}
+
+void run_x86_benchmarks(const Options& options)
+{
+    printf("%-12s %12s %10s %12s %12s %24s\n", "corpus", "instructions", "invalid", "MB/s", "ns/insn", "objdump agreement");
+
+    for (auto& corpus : corpora(options))
+    {
+        auto text = find_text_section(corpus.bytes);
+        if (!text.has_value())
+            continue;
+
+        size_t instructions{};
+        size_t invalid{};
+
+        // Straight-line decoding, the same as any linear sweep disassembler.
+        auto elapsed = measure(options, [&] {
+            instructions = invalid = 0;
+
+            for (size_t offset = 0; offset < text->bytes.size();)
+            {
+                auto instruction = X86::decode(text->bytes.subspan(offset));
+                offset += instruction.has_value() ? instruction->length : 1;
+                instructions++;
+                invalid += !instruction.has_value();
+            }
+
+            do_not_optimize(instructions);
+        });
+
+        char agreement[32] = "n/a";
+        if (auto validation = validate_against_objdump(corpus.path, *text); validation.has_value())
+        {
+            snprintf(agreement, sizeof(agreement), "%zu/%zu", validation->compared - validation->mismatches,
+                     validation->compared);
+        }
+
+        printf("%-12s %12zu %10zu %12.1f %12.3f %24s\n", corpus.name.c_str(), instructions, invalid,
+               gigabytes_per_second(text->bytes.size(), elapsed) * 1000,
+               static_cast<double>(elapsed.count()) / static_cast<double>(instructions), agreement);
+    }
+}
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Benchmark.h"
+#include <JMP/FileStream.h>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <random>
+
+#ifdef JMP_BENCHMARKS_LINUX
+#include <link.h>
+#endif
+
+namespace JMP::Benchmarks
+{
+static std::optional<Corpus> read_corpus_from_file(std::string name, const char* path)
+{
+    auto* file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Unable to open corpus %s (%s), skipping: %s\n", name.c_str(), path, strerror(errno));
+        return {};
+    }
+
+    auto stream = FileStream::adopt(file);
+    stream.seek(0, Stream::SeekOrigin::End);
+    auto size = stream.index();
+    stream.seek(0, Stream::SeekOrigin::Start);
+
+    // Canonical, as /proc/self/exe means something else to anyone we hand it to.
+    char resolved_path[PATH_MAX];
+    return Corpus{std::move(name), stream.read(size), realpath(path, resolved_path) ? resolved_path : path};
+}
+
+static Corpus make_random_corpus(size_t size)
+{
+    // Fixed seed, so that runs are comparable between each other.
+    std::mt19937_64 engine{0x4A4D50};
+    Corpus corpus{"random", {}, {}};
+    corpus.bytes.resize(size);
+
+    for (size_t i = 0; i < size; i += sizeof(uint64_t))
+    {
+        auto value = engine();
+        memcpy(corpus.bytes.data() + i, &value, std::min(sizeof(value), size - i));
+    }
+
+    return corpus;
+}
+
+#ifdef JMP_BENCHMARKS_LINUX
+// Where libc actually lives differs between distributions, so ask the loader which one we were linked against.
+static std::optional<std::string> path_to_libc()
+{
+    std::optional<std::string> path;
+
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data) {
+            if (!info->dlpi_name || !strstr(info->dlpi_name, "/libc.so"))
+                return 0;
+
+            *static_cast<std::optional<std::string>*>(data) = info->dlpi_name;
+            return 1;
+        },
+        &path);
+
+    return path;
+}
+#endif
+
+const std::vector<Corpus>& corpora(const Options& options)
+{
+    static std::vector<Corpus> corpora;
+    if (!corpora.empty())
+        return corpora;
+
+    corpora.push_back(make_random_corpus(64 * 1024 * 1024));
+
+#ifdef JMP_BENCHMARKS_LINUX
+    if (auto libc_path = path_to_libc(); libc_path.has_value())
+    {
+        if (auto corpus = read_corpus_from_file("libc", libc_path->c_str()); corpus.has_value())
+            corpora.push_back(std::move(*corpus));
+    }
+#endif
+
+    if (auto corpus = read_corpus_from_file("self", "/proc/self/exe"); corpus.has_value())
+        corpora.push_back(std::move(*corpus));
+
+    for (auto& path : options.extra_corpus_paths)
+    {
+        if (auto corpus = read_corpus_from_file(path, path.c_str()); corpus.has_value())
+            corpora.push_back(std::move(*corpus));
+    }
+
+    return corpora;
+}
+
+double gigabytes_per_second(size_t bytes, std::chrono::nanoseconds elapsed)
+{
+    // Bytes per nanosecond is exactly gigabytes per second.
+    return static_cast<double>(bytes) / static_cast<double>(elapsed.count());
+}
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--filter <suite>] [--min-time-ms <milliseconds>] [--corpus <path>]...\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    using namespace JMP::Benchmarks;
+
+    Options options;
+
+    for (auto i = 1; i < argc; i++)
+    {
+        std::string_view argument = argv[i];
+        auto has_value = i + 1 < argc;
+
+        if (argument == "--filter" && has_value)
+            options.filter = argv[++i];
+        else if (argument == "--corpus" && has_value)
+            options.extra_corpus_paths.emplace_back(argv[++i]);
+        else if (argument == "--min-time-ms" && has_value)
+            options.minimum_time = std::chrono::milliseconds(strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    struct Suite
+    {
+        std::string_view name;
+        void (*run)(const Options&);
+    };
+
+    static constexpr Suite suites[] = {
+        {"signature", run_signature_benchmarks},
+#ifdef JMP_BENCHMARKS_LINUX
+        {"code-caves", run_code_cave_benchmarks},
+        {"detour", run_detour_benchmarks},
+        {"dirty-pages", run_dirty_page_benchmarks},
+        {"imports", run_import_hook_benchmarks},
+        {"large-allocations", run_large_allocation_benchmarks},
+        {"memory-map", run_memory_map_benchmarks},
+        {"memory-probe", run_memory_probe_benchmarks},
+        {"module-scan", run_module_scan_benchmarks},
+        {"narrowing", run_narrowing_scan_benchmarks},
+        {"pointer-map", run_pointer_map_benchmarks},
+        {"remote-patches", run_remote_patch_benchmarks},
+        {"remote-process", run_remote_process_benchmarks},
+        {"symbols", run_symbol_resolver_benchmarks},
+        {"value-scan", run_value_scan_benchmarks},
+        {"vtable", run_virtual_table_benchmarks},
+        {"watch-points", run_watch_point_benchmarks},
+        {"x86", run_x86_benchmarks},
+#endif
+    };
+
+    for (auto& suite : suites)
+    {
+        if (!options.filter.empty() && suite.name.find(options.filter) == std::string_view::npos)
+            continue;
+
+        printf("== %.*s\n", static_cast<int>(suite.name.size()), suite.name.data());
+        suite.run(options);
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "CodeCaveIndex.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+namespace JMP
+{
+namespace
+{
+uintptr_t align_up(uintptr_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+uintptr_t align_down(uintptr_t value, size_t alignment) { return value & ~(alignment - 1); }
+
+uint64_t distance_between(uintptr_t a, uintptr_t b) { return a > b ? a - b : b - a; }
+
+// A run of padding at least twice as long as a word (less one) always has a whole aligned word in it. So we compare
+// aligned words, in blocks that vectorize like ValueScan's, and only look at the bytes around words that are all
+// padding to find where their run starts and ends. Code without padding costs a compare or two per word.
+template<typename Word, typename Callback>
+void find_runs(std::span<const uint8_t> bytes, size_t minimum_size, Callback callback)
+{
+    constexpr size_t block_size = 64;
+
+    auto base = reinterpret_cast<uintptr_t>(bytes.data());
+    auto first_word = align_up(base, sizeof(Word)) - base;
+    if (first_word >= bytes.size())
+        return;
+
+    auto word_count = (bytes.size() - first_word) / sizeof(Word);
+    auto* words = bytes.data() + first_word;
+
+    Word int3s;
+    memset(&int3s, 0xCC, sizeof(int3s));
+
+    auto load = [&](size_t index) {
+        Word word;
+        memcpy(&word, words + index * sizeof(Word), sizeof(Word));
+        return word;
+    };
+
+    // Everything before this was part of a run we already found.
+    size_t covered{};
+
+    auto extend = [&](size_t index) {
+        auto offset = first_word + index * sizeof(Word);
+        if (offset < covered)
+            return;
+
+        auto value = bytes[offset];
+        auto start = offset;
+        while (start > 0 && bytes[start - 1] == value)
+            start--;
+
+        auto end = offset + sizeof(Word);
+        while (end < bytes.size() && bytes[end] == value)
+            end++;
+
+        covered = end;
+        if (end - start >= minimum_size)
+            callback(start, end, value);
+    };
+
+    size_t i{};
+    uint8_t hits[block_size];
+
+    for (; i + block_size <= word_count; i += block_size)
+    {
+        for (size_t j = 0; j < block_size; j++)
+        {
+            auto word = load(i + j);
+            hits[j] = (word == int3s) | (word == 0);
+        }
+
+        uint64_t any{};
+        for (size_t j = 0; j < block_size; j += sizeof(uint64_t))
+        {
+            uint64_t hit_word;
+            memcpy(&hit_word, hits + j, sizeof(hit_word));
+            any |= hit_word;
+        }
+
+        if (!any)
+            continue;
+
+        for (size_t j = 0; j < block_size; j++)
+        {
+            if (hits[j])
+                extend(i + j);
+        }
+    }
+
+    for (; i < word_count; i++)
+    {
+        auto word = load(i);
+        if (word == int3s || word == 0)
+            extend(i);
+    }
+}
+}
+
+CodeCaveIndex::CodeCaveIndex(const ModuleTable::Module& module, size_t minimum_size)
+{
+    if (minimum_size == 0)
+        throw std::invalid_argument("Minimum cave size must be at least one byte");
+
+    for (auto& segment : module.segments)
+    {
+        if (!segment.protection.read || !segment.protection.execute)
+            continue;
+
+        std::span<const uint8_t> bytes = segment.bytes();
+        auto add_cave = [&](size_t start, size_t end, uint8_t value) {
+            if (value == 0)
+                start += zero_run_guard;
+
+            if (end < start + minimum_size)
+                return;
+
+            insert(segment.start + start, end - start);
+            m_cave_count++;
+        };
+
+        // The widest word that a run of the minimum size is sure to have a whole (aligned) one of.
+        if (minimum_size >= 2 * sizeof(uint64_t) - 1)
+            find_runs<uint64_t>(bytes, minimum_size, add_cave);
+        else if (minimum_size >= 2 * sizeof(uint32_t) - 1)
+            find_runs<uint32_t>(bytes, minimum_size, add_cave);
+        else if (minimum_size >= 2 * sizeof(uint16_t) - 1)
+            find_runs<uint16_t>(bytes, minimum_size, add_cave);
+        else
+            find_runs<uint8_t>(bytes, minimum_size, add_cave);
+    }
+}
+
+size_t CodeCaveIndex::bucket_for(size_t size) { return static_cast<size_t>(std::bit_width(size)) - 1; }
+
+void CodeCaveIndex::insert(uintptr_t start, size_t size)
+{
+    m_free.emplace(start, size);
+    m_buckets[bucket_for(size)].emplace(start, size);
+    m_free_bytes += size;
+}
+
+void CodeCaveIndex::erase(std::map<uintptr_t, size_t>::iterator it)
+{
+    m_buckets[bucket_for(it->second)].erase(it->first);
+    m_free_bytes -= it->second;
+    m_free.erase(it);
+}
+
+std::optional<CodeCaveIndex::Candidate> CodeCaveIndex::closest_in(size_t bucket, uintptr_t near, size_t size,
+                                                                  size_t alignment) const
+{
+    auto fit = [&](uintptr_t start, size_t cave_size) -> std::optional<Candidate> {
+        auto end = start + cave_size;
+        auto lowest = align_up(start, alignment);
+        if (lowest + size > end)
+            return {};
+
+        // As close to near as the cave lets us, which is its start or end unless near is inside of it.
+        auto highest = align_down(end - size, alignment);
+        auto allocation = std::clamp(align_down(near, alignment), lowest, highest);
+        auto distance = std::max(distance_between(allocation, near), distance_between(allocation + size, near));
+        if (distance > maximum_distance)
+            return {};
+
+        return Candidate{start, end, allocation, distance};
+    };
+
+    auto& caves = m_buckets[bucket];
+    auto after = caves.lower_bound(near);
+    std::optional<Candidate> best;
+
+    // Caves only get further away on either side, so the first that fits on each side is the closest there. In
+    // buckets where every cave is big enough, that's the first one we look at.
+    auto it = after;
+    for (size_t probes = 0; it != caves.end() && probes < maximum_probes; it++, probes++)
+    {
+        if (it->first - near > maximum_distance)
+            break;
+
+        if ((best = fit(it->first, it->second)))
+            break;
+    }
+
+    it = after;
+    for (size_t probes = 0; it != caves.begin() && probes < maximum_probes; probes++)
+    {
+        it--;
+        if (near - it->first > maximum_distance + it->second)
+            break;
+
+        if (auto candidate = fit(it->first, it->second))
+        {
+            if (!best || candidate->distance < best->distance)
+                best = candidate;
+
+            break;
+        }
+    }
+
+    return best;
+}
+
+std::optional<std::span<uint8_t>> CodeCaveIndex::allocate(const void* near, size_t size, size_t alignment)
+{
+    if (size == 0 || !std::has_single_bit(alignment))
+        throw std::invalid_argument("Invalid CodeCaveIndex allocation");
+
+    auto near_address = reinterpret_cast<uintptr_t>(near);
+    std::optional<Candidate> best;
+
+    // Smaller buckets can't have anything that fits.
+    for (auto bucket = bucket_for(size); bucket < bucket_count; bucket++)
+    {
+        if (m_buckets[bucket].empty())
+            continue;
+
+        auto candidate = closest_in(bucket, near_address, size, alignment);
+        if (candidate && (!best || candidate->distance < best->distance))
+            best = candidate;
+    }
+
+    if (!best)
+        return {};
+
+    // What's left on either side of the allocation stays free.
+    erase(m_free.find(best->start));
+    if (best->allocation > best->start)
+        insert(best->start, best->allocation - best->start);
+
+    if (auto allocation_end = best->allocation + size; allocation_end < best->end)
+        insert(allocation_end, best->end - allocation_end);
+
+    return std::span<uint8_t>{reinterpret_cast<uint8_t*>(best->allocation), size};
+}
+
+void CodeCaveIndex::free(std::span<uint8_t> bytes)
+{
+    auto start = reinterpret_cast<uintptr_t>(bytes.data());
+    auto size = bytes.size();
+
+    auto next = m_free.lower_bound(start);
+    if ((next != m_free.end() && next->first < start + size) ||
+        (next != m_free.begin() && std::prev(next)->first + std::prev(next)->second > start))
+        throw std::invalid_argument("Freeing bytes that are already free");
+
+    if (next != m_free.end() && next->first == start + size)
+    {
+        size += next->second;
+        erase(next++);
+    }
+
+    if (next != m_free.begin())
+    {
+        if (auto previous = std::prev(next); previous->first + previous->second == start)
+        {
+            start = previous->first;
+            size += previous->second;
+            erase(previous);
+        }
+    }
+
+    insert(start, size);
+}
+
+CodeCaveIndex::Statistics CodeCaveIndex::statistics() const
+{
+    Statistics statistics;
+    statistics.caves = m_cave_count;
+    statistics.free_ranges = m_free.size();
+    statistics.free_bytes = m_free_bytes;
+
+    for (auto& [start, size] : m_free)
+        statistics.largest = std::max(statistics.largest, size);
+
+    return statistics;
+}
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ModuleTable.h"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+
+namespace JMP
+{
+// Free executable bytes inside a module: the padding compilers put between functions (int3, or zeros), which nothing
+// ever runs. Small patches and stubs can go there, right next to what they're for, without mapping anything new.
+//
+//     CodeCaveIndex caves(*modules.find_by_name("libgame.so"));
+//     if (auto stub = caves.allocate(target, 14))
+//     {
+//         ProtectionTransaction transaction;
+//         transaction.add(*stub, {.read = true, .write = true, .execute = true});
+//         auto restore = transaction.apply();
+//         // ... write the stub
+//     }
+//
+// The module's executable segments are scanned once, and every run of padding of at least the minimum size goes into
+// free lists bucketed by size (in powers of two) and sorted by address, so finding the closest cave that fits takes a
+// few lookups. Caves are in code that isn't writable, so write to them through the protection API.
+class CodeCaveIndex
+{
+public:
+    struct Statistics
+    {
+        size_t caves{};
+        size_t free_ranges{};
+        size_t free_bytes{};
+        size_t largest{};
+    };
+
+    static constexpr size_t default_minimum_size = 16;
+    // How far a rel32 can reach.
+    static constexpr int64_t maximum_distance = INT32_MAX;
+    // Zeros can also be the end of an instruction's immediate, or displacement, so we leave this many of them alone at
+    // the start of a run of them.
+    static constexpr size_t zero_run_guard = 8;
+
+    explicit CodeCaveIndex(const ModuleTable::Module&, size_t minimum_size = default_minimum_size);
+
+    // The closest free bytes to near (within rel32 reach from anywhere in them) that fit, or nothing if there aren't
+    // any. The bytes are still whatever padding they were.
+    std::optional<std::span<uint8_t>> allocate(const void* near, size_t size, size_t alignment = 1);
+    // Must be given exactly what allocate returned. The bytes can be reused as they are, they don't have to be
+    // padding again.
+    void free(std::span<uint8_t> bytes);
+
+    Statistics statistics() const;
+
+private:
+    static constexpr size_t bucket_count = 64;
+    // How many caves we look at on each side of near, in a bucket whose caves might not fit.
+    static constexpr size_t maximum_probes = 8;
+
+    struct Candidate
+    {
+        uintptr_t start{};
+        uintptr_t end{};
+        // Where we'd put the allocation in it.
+        uintptr_t allocation{};
+        uint64_t distance{};
+    };
+
+    static size_t bucket_for(size_t size);
+
+    void insert(uintptr_t start, size_t size);
+    void erase(std::map<uintptr_t, size_t>::iterator);
+    std::optional<Candidate> closest_in(size_t bucket, uintptr_t near, size_t size, size_t alignment) const;
+
+    // Every free range, by address, so what's freed can merge with its neighbours.
+    std::map<uintptr_t, size_t> m_free;
+    // The same ranges, bucketed by the highest bit of their size.
+    std::array<std::map<uintptr_t, size_t>, bucket_count> m_buckets;
+    size_t m_cave_count{};
+    size_t m_free_bytes{};
+};
+}
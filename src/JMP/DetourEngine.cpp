@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "DetourEngine.h"
+#include "ProtectionTransaction.h"
+#include "ScopeGuard.h"
+#include "X86.h"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace JMP
+{
+namespace
+{
+// jmp rel32
+constexpr size_t jmp_size = 5;
+// jmp [rip+0], followed by the absolute address
+constexpr size_t absolute_jmp_size = 14;
+
+bool fits_in_relative32(uintptr_t from, uintptr_t to)
+{
+    auto distance = static_cast<int64_t>(to - from);
+    return distance >= INT32_MIN && distance <= INT32_MAX;
+}
+
+void write_relative32(uint8_t* at, uintptr_t instruction_end, uintptr_t to)
+{
+    if (!fits_in_relative32(instruction_end, to))
+        throw std::runtime_error("Relocated instruction can't reach its target");
+
+    auto displacement = static_cast<int32_t>(to - instruction_end);
+    memcpy(at, &displacement, sizeof(displacement));
+}
+
+int64_t read_signed(const uint8_t* at, size_t size)
+{
+    if (size == 1)
+        return static_cast<int8_t>(*at);
+
+    int32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+struct Relocation
+{
+    size_t offset{};
+    X86::Instruction instruction;
+    size_t relocated_length{};
+};
+}
+
+DetourEngine::~DetourEngine()
+{
+    try
+    {
+        uninstall_all();
+    }
+    catch (...)
+    {
+        // Some targets still jump into our trampolines (or their module is gone), so we can't unmap them.
+        m_arena.leak();
+    }
+}
+
+DetourEngine::Hook DetourEngine::prepare(uintptr_t target, uintptr_t replacement)
+{
+    auto* code = reinterpret_cast<const uint8_t*>(target);
+
+    std::vector<Relocation> relocations;
+    size_t patch_length{};
+    size_t trampoline_length{};
+
+    // Take whole instructions until there's room for our jmp.
+    while (patch_length < jmp_size)
+    {
+        auto instruction = X86::decode({code + patch_length, 15});
+        if (!instruction.has_value())
+            throw std::runtime_error("Unable to decode instruction at hook target");
+
+        auto* bytes = code + patch_length;
+        auto opcode = instruction->opcode;
+        auto relocated_length = static_cast<size_t>(instruction->length);
+
+        // Short branches can't reach anything from the trampoline, so they're widened to their rel32 forms.
+        if (instruction->is_relative_branch && instruction->immediate_size == 1)
+        {
+            if (instruction->opcode_offset != 0)
+                throw std::runtime_error("Unable to relocate prefixed short branch at hook target");
+
+            if (opcode == 0xEB)
+                relocated_length = 5;
+            else if (opcode >= 0x70 && opcode <= 0x7F)
+                relocated_length = 6;
+            else
+                throw std::runtime_error("Unable to relocate loop or jrcxz at hook target");
+        }
+
+        relocations.push_back({patch_length, *instruction, relocated_length});
+        patch_length += instruction->length;
+        trampoline_length += relocated_length;
+
+        auto reg = instruction->has_modrm ? (bytes[instruction->modrm_offset] >> 3) & 7 : 0;
+        auto ends_function = opcode == 0xC3 || opcode == 0xC2 || opcode == 0xCC || opcode == 0xE9 || opcode == 0xEB ||
+                             (opcode == 0xFF && (reg == 4 || reg == 5));
+
+        // Our jmp would overwrite whatever comes after the function.
+        if (instruction->map == 0 && ends_function && patch_length < jmp_size)
+            throw std::runtime_error("Hook target is too short to hook");
+    }
+
+    auto is_inside_patch = [&](uintptr_t address) { return address > target && address < target + patch_length; };
+
+    Hook hook;
+    hook.original_bytes.assign(code, code + patch_length);
+    hook.trampoline = m_arena.allocate(code, trampoline_length + jmp_size);
+
+    // Relocating can still find an instruction it can't handle.
+    ScopeGuard release_on_error{[&] { release(hook); }};
+
+    auto* output = hook.trampoline.data();
+
+    for (auto& relocation : relocations)
+    {
+        auto& instruction = relocation.instruction;
+        auto* bytes = code + relocation.offset;
+        auto original_end = target + relocation.offset + instruction.length;
+        auto relocated_end = reinterpret_cast<uintptr_t>(output) + relocation.relocated_length;
+
+        if (instruction.is_relative_branch)
+        {
+            auto destination = original_end + read_signed(bytes + instruction.immediate_offset, instruction.immediate_size);
+            if (is_inside_patch(destination))
+                throw std::runtime_error("Unable to relocate branch into the patched bytes of hook target");
+
+            if (instruction.immediate_size == 1)
+            {
+                if (bytes[0] == 0xEB)
+                {
+                    output[0] = 0xE9;
+                    write_relative32(output + 1, relocated_end, destination);
+                }
+                else
+                {
+                    output[0] = 0x0F;
+                    output[1] = 0x80 | (bytes[0] & 0x0F);
+                    write_relative32(output + 2, relocated_end, destination);
+                }
+            }
+            else
+            {
+                memcpy(output, bytes, instruction.length);
+                write_relative32(output + instruction.immediate_offset, relocated_end, destination);
+            }
+        }
+        else
+        {
+            memcpy(output, bytes, instruction.length);
+
+            if (instruction.is_rip_relative)
+            {
+                auto destination = original_end + read_signed(bytes + instruction.displacement_offset, 4);
+                write_relative32(output + instruction.displacement_offset, relocated_end, destination);
+            }
+        }
+
+        output += relocation.relocated_length;
+    }
+
+    // And back to the rest of the original.
+    output[0] = 0xE9;
+    write_relative32(output + 1, reinterpret_cast<uintptr_t>(output) + jmp_size, target + patch_length);
+
+    // Prefer jumping straight to the replacement, only relaying through an absolute jmp when it's too far away.
+    auto jmp_destination = replacement;
+    if (!fits_in_relative32(target + jmp_size, replacement))
+    {
+        hook.relay = m_arena.allocate(code, absolute_jmp_size);
+        memcpy(hook.relay.data(), "\xFF\x25\x00\x00\x00\x00", 6);
+        memcpy(hook.relay.data() + 6, &replacement, sizeof(replacement));
+        jmp_destination = reinterpret_cast<uintptr_t>(hook.relay.data());
+    }
+
+    // Whatever is left of the last instruction we overwrote becomes int3, so nothing can sensibly run it.
+    hook.patch.resize(patch_length, 0xCC);
+    hook.patch[0] = 0xE9;
+    write_relative32(hook.patch.data() + 1, target + jmp_size, jmp_destination);
+
+    release_on_error.disarm();
+    return hook;
+}
+
+void DetourEngine::release(Hook& hook)
+{
+    m_arena.free(hook.trampoline);
+    if (!hook.relay.empty())
+        m_arena.free(hook.relay);
+}
+
+std::vector<void*> DetourEngine::install(std::span<const Request> requests)
+{
+    std::vector<std::pair<uintptr_t, Hook>> prepared;
+    std::unordered_set<uintptr_t> targets;
+
+    prepared.reserve(requests.size());
+
+    // Until the targets are patched, nothing jumps into the trampolines, so they're ours to give back.
+    ScopeGuard release_on_error{[&] {
+        for (auto& [target, hook] : prepared)
+            release(hook);
+    }};
+
+    for (auto& request : requests)
+    {
+        auto target = reinterpret_cast<uintptr_t>(request.target);
+        if (m_hooks.contains(target) || !targets.insert(target).second)
+            throw std::invalid_argument("Hook target is already hooked");
+
+        prepared.emplace_back(target, prepare(target, reinterpret_cast<uintptr_t>(request.replacement)));
+    }
+
+    m_arena.seal();
+
+    {
+        ProtectionTransaction transaction;
+        for (auto& [target, hook] : prepared)
+            transaction.add({reinterpret_cast<uint8_t*>(target), hook.patch.size()}, {true, true, true});
+
+        auto restore_protection = transaction.apply();
+
+        for (auto& [target, hook] : prepared)
+            memcpy(reinterpret_cast<void*>(target), hook.patch.data(), hook.patch.size());
+    }
+
+    release_on_error.disarm();
+
+    std::vector<void*> originals;
+    originals.reserve(prepared.size());
+
+    for (auto& [target, hook] : prepared)
+    {
+        auto* start = reinterpret_cast<char*>(target);
+        __builtin___clear_cache(start, start + hook.patch.size());
+
+        originals.push_back(hook.trampoline.data());
+        m_hooks.emplace(target, std::move(hook));
+    }
+
+    return originals;
+}
+
+void* DetourEngine::install(void* target, const void* replacement)
+{
+    Request request{target, replacement};
+    return install(std::span(&request, 1)).front();
+}
+
+void DetourEngine::uninstall(std::span<void* const> targets)
+{
+    std::unordered_set<void*> unique_targets;
+    for (auto* target : targets)
+    {
+        if (!is_installed(target))
+            throw std::invalid_argument("Unable to uninstall hook that isn't installed");
+
+        if (!unique_targets.insert(target).second)
+            throw std::invalid_argument("Unable to uninstall the same hook twice");
+    }
+
+    {
+        ProtectionTransaction transaction;
+        for (auto* target : targets)
+        {
+            auto& hook = m_hooks.at(reinterpret_cast<uintptr_t>(target));
+            transaction.add({static_cast<uint8_t*>(target), hook.original_bytes.size()}, {true, true, true});
+        }
+
+        auto restore_protection = transaction.apply();
+
+        for (auto* target : targets)
+        {
+            auto& hook = m_hooks.at(reinterpret_cast<uintptr_t>(target));
+            memcpy(target, hook.original_bytes.data(), hook.original_bytes.size());
+        }
+    }
+
+    // The trampolines are freed, but the arena never hands out sealed memory again, so anything still running in one
+    // (like a thread that called the original) can finish.
+    for (auto* target : targets)
+    {
+        auto it = m_hooks.find(reinterpret_cast<uintptr_t>(target));
+        auto* start = static_cast<char*>(target);
+        __builtin___clear_cache(start, start + it->second.original_bytes.size());
+
+        release(it->second);
+        m_hooks.erase(it);
+    }
+}
+
+void DetourEngine::uninstall(void* target) { uninstall(std::span(&target, 1)); }
+
+void DetourEngine::uninstall_all()
+{
+    std::vector<void*> targets;
+    targets.reserve(m_hooks.size());
+
+    for (auto& [target, hook] : m_hooks)
+        targets.push_back(reinterpret_cast<void*>(target));
+
+    if (!targets.empty())
+        uninstall(targets);
+}
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ExecutableArena.h"
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace JMP
+{
+// Inline function hooks: the start of the target is overwritten with a jmp to the replacement, and the instructions
+// that were there are moved into a trampoline (followed by a jmp back), which calling the original goes through.
+//
+// Installing and uninstalling are batched, so any number of hooks costs one protection change (and restore) for the
+// targets, and one for the trampolines. Nothing may be executing the start of a target while it's being patched.
+class DetourEngine
+{
+public:
+    struct Request
+    {
+        void* target{};
+        const void* replacement{};
+    };
+
+    DetourEngine() = default;
+    DetourEngine(const DetourEngine&) = delete;
+    DetourEngine& operator=(const DetourEngine&) = delete;
+    ~DetourEngine();
+
+    // Returns what to call instead of each target to get the original behaviour, in the same order as the requests.
+    std::vector<void*> install(std::span<const Request> requests);
+    void* install(void* target, const void* replacement);
+
+    void uninstall(std::span<void* const> targets);
+    void uninstall(void* target);
+    void uninstall_all();
+
+    bool is_installed(void* target) const { return m_hooks.contains(reinterpret_cast<uintptr_t>(target)); }
+    ExecutableArena::Statistics arena_statistics() const { return m_arena.statistics(); }
+
+private:
+    struct Hook
+    {
+        std::vector<uint8_t> original_bytes;
+        std::vector<uint8_t> patch;
+        std::span<uint8_t> trampoline;
+        // Only needed when the replacement is too far away to jmp to directly.
+        std::span<uint8_t> relay;
+    };
+
+    Hook prepare(uintptr_t target, uintptr_t replacement);
+    void release(Hook&);
+
+    std::unordered_map<uintptr_t, Hook> m_hooks;
+    ExecutableArena m_arena;
+};
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "DirtyPageTracker.h"
+#include "ScopeGuard.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older kernel headers don't have asynchronous write protection or PAGEMAP_SCAN, but the kernel we run on might.
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#    define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+
+#ifndef UFFD_FEATURE_WP_ASYNC
+#    define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+
+#ifndef PAGEMAP_SCAN
+#    define PAGE_IS_WRITTEN (1 << 1)
+#    define PM_SCAN_WP_MATCHING (1 << 0)
+
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#    define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+namespace JMP
+{
+namespace
+{
+constexpr uint64_t soft_dirty_bit = 1ull << 55;
+// How many pagemap entries (or page regions) we ask for at once.
+constexpr size_t buffer_size = 4096;
+
+int open_proc(pid_t pid, const char* name, int flags)
+{
+    char path[64];
+    if (pid == 0)
+        snprintf(path, sizeof(path), "/proc/self/%s", name);
+    else
+        snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+
+    return open(path, flags | O_CLOEXEC);
+}
+
+// Returns -1 if we can't have a userfaultfd with asynchronous write protection.
+int open_userfaultfd()
+{
+    // Only handling faults from user mode is all we need, and is allowed without privileges.
+    auto fd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+    if (fd == -1)
+        return -1;
+
+    uffdio_api api{};
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+
+    if (ioctl(fd, UFFDIO_API, &api) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void append(std::vector<std::span<const uint8_t>>& ranges, uintptr_t start, uintptr_t end)
+{
+    if (!ranges.empty() && reinterpret_cast<uintptr_t>(ranges.back().data() + ranges.back().size()) == start)
+    {
+        ranges.back() = {ranges.back().data(), ranges.back().size() + (end - start)};
+        return;
+    }
+
+    ranges.push_back({reinterpret_cast<const uint8_t*>(start), end - start});
+}
+}
+
+bool DirtyPageTracker::is_supported(Mode mode)
+{
+    if (mode == Mode::WriteProtect)
+    {
+        auto fd = open_userfaultfd();
+        if (fd == -1)
+            return false;
+
+        close(fd);
+
+        // The kernel could have the features but not PAGEMAP_SCAN, which would fail with ENOTTY.
+        auto pagemap = open_proc(0, "pagemap", O_RDONLY);
+        if (pagemap == -1)
+            return false;
+
+        ScopeGuard close_pagemap{[pagemap] { close(pagemap); }};
+
+        pm_scan_arg arg{};
+        arg.size = sizeof(arg);
+        return ioctl(pagemap, PAGEMAP_SCAN, &arg) == 0;
+    }
+
+    // A page we just wrote to is always soft-dirty, if the kernel has them at all.
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto* page = static_cast<uint8_t*>(mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (page == MAP_FAILED)
+        return false;
+
+    ScopeGuard unmap_page{[page, page_size] { munmap(page, page_size); }};
+    *static_cast<volatile uint8_t*>(page) = 1;
+
+    auto pagemap = open_proc(0, "pagemap", O_RDONLY);
+    if (pagemap == -1)
+        return false;
+
+    ScopeGuard close_pagemap{[pagemap] { close(pagemap); }};
+
+    uint64_t entry{};
+    auto offset = reinterpret_cast<uintptr_t>(page) / page_size * sizeof(entry);
+    return pread(pagemap, &entry, sizeof(entry), static_cast<off_t>(offset)) == sizeof(entry) && (entry & soft_dirty_bit);
+}
+
+DirtyPageTracker::DirtyPageTracker(const MemoryMap& memory_map, const MemoryMap::Filter& filter)
+    : DirtyPageTracker((memory_map.pid() == 0 || memory_map.pid() == getpid()) && is_supported(Mode::WriteProtect)
+                           ? Mode::WriteProtect
+                           : Mode::SoftDirty,
+                       memory_map, filter)
+{
+}
+
+DirtyPageTracker::DirtyPageTracker(Mode mode, const MemoryMap& memory_map, const MemoryMap::Filter& filter)
+    : m_mode(mode)
+    , m_pid(memory_map.pid())
+    , m_page_size(static_cast<size_t>(sysconf(_SC_PAGESIZE)))
+{
+    if (mode == Mode::WriteProtect && m_pid != 0 && m_pid != getpid())
+        throw std::invalid_argument("Write protection can only track this process");
+
+    if (mode == Mode::SoftDirty && !is_supported(Mode::SoftDirty))
+        throw Platform::PlatformException("Kernel doesn't track soft-dirty pages");
+
+    m_pagemap = open_proc(m_pid, "pagemap", O_RDONLY);
+    if (m_pagemap == -1)
+        throw Platform::PlatformException(errno);
+
+    // The destructor won't run if we throw.
+    ScopeGuard close_on_failure{[this] { close_files(); }};
+    m_buffer.resize(buffer_size * sizeof(page_region) / sizeof(uint64_t));
+
+    if (mode == Mode::SoftDirty)
+    {
+        m_clear_refs = open_proc(m_pid, "clear_refs", O_WRONLY);
+        if (m_clear_refs == -1)
+            throw Platform::PlatformException(errno);
+
+        memory_map.for_each_matching(filter, [&](const MemoryMap::Region& region) {
+            m_tracked.push_back({region.start, region.end});
+        });
+
+        clear_soft_dirty();
+        close_on_failure.disarm();
+        return;
+    }
+
+    m_userfaultfd = open_userfaultfd();
+    if (m_userfaultfd == -1)
+        throw Platform::PlatformException("Kernel doesn't support asynchronous write protection");
+
+    // Registering fails for some mappings (like the vsyscall page), which we can't know about until then.
+    memory_map.for_each_matching(filter, [&](const MemoryMap::Region& region) {
+        uffdio_register registration{};
+        registration.range = {region.start, region.size()};
+        registration.mode = UFFDIO_REGISTER_MODE_WP;
+
+        if (ioctl(m_userfaultfd, UFFDIO_REGISTER, &registration) == 0)
+            m_tracked.push_back({region.start, region.end});
+        else
+            m_untracked.push_back({region.start, region.end});
+    });
+
+    // Nothing is write protected until the first scan, which also finds everything written so far.
+    std::vector<std::span<const uint8_t>> ignored;
+    for (auto range : m_tracked)
+        collect_written(range, ignored);
+
+    close_on_failure.disarm();
+}
+
+DirtyPageTracker::~DirtyPageTracker() { close_files(); }
+
+void DirtyPageTracker::close_files()
+{
+    // Closing the userfaultfd unregisters everything, and lets written pages be written without protection.
+    for (auto* fd : {&m_userfaultfd, &m_pagemap, &m_clear_refs})
+    {
+        if (*fd != -1)
+            close(*fd);
+
+        *fd = -1;
+    }
+}
+
+size_t DirtyPageTracker::tracked_size() const
+{
+    size_t size{};
+    for (auto range : m_tracked)
+        size += range.end - range.start;
+
+    return size;
+}
+
+std::vector<std::span<const uint8_t>> DirtyPageTracker::collect_dirty()
+{
+    std::vector<std::span<const uint8_t>> dirty;
+
+    for (auto range : m_tracked)
+    {
+        if (m_mode == Mode::WriteProtect)
+            collect_written(range, dirty);
+        else
+            collect_soft_dirty(range, dirty);
+    }
+
+    if (m_mode == Mode::SoftDirty)
+        clear_soft_dirty();
+
+    if (m_untracked.empty())
+        return dirty;
+
+    for (auto range : m_untracked)
+        dirty.push_back({reinterpret_cast<const uint8_t*>(range.start), range.end - range.start});
+
+    std::sort(dirty.begin(), dirty.end(), [](auto a, auto b) { return a.data() < b.data(); });
+    return dirty;
+}
+
+void DirtyPageTracker::collect_written(Range range, std::vector<std::span<const uint8_t>>& dirty)
+{
+    auto* regions = reinterpret_cast<page_region*>(m_buffer.data());
+
+    pm_scan_arg arg{};
+    arg.size = sizeof(arg);
+    // Finding the written pages and protecting them again is one step, so a write can't happen in between.
+    arg.flags = PM_SCAN_WP_MATCHING;
+    arg.start = range.start;
+    arg.end = range.end;
+    arg.vec = reinterpret_cast<uintptr_t>(regions);
+    arg.vec_len = buffer_size;
+    arg.category_mask = PAGE_IS_WRITTEN;
+    arg.return_mask = PAGE_IS_WRITTEN;
+
+    while (arg.start < arg.end)
+    {
+        auto count = ioctl(m_pagemap, PAGEMAP_SCAN, &arg);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw Platform::PlatformException(errno);
+        }
+
+        for (long i = 0; i < count; i++)
+            append(dirty, regions[i].start, regions[i].end);
+
+        // The walk stops early when we ran out of room for regions.
+        if (arg.walk_end <= arg.start)
+            break;
+
+        arg.start = arg.walk_end;
+    }
+}
+
+void DirtyPageTracker::collect_soft_dirty(Range range, std::vector<std::span<const uint8_t>>& dirty)
+{
+    auto first_page = range.start / m_page_size;
+    auto last_page = range.end / m_page_size;
+
+    for (auto page = first_page; page < last_page;)
+    {
+        auto count = std::min<size_t>(m_buffer.size(), last_page - page);
+        auto result = pread(m_pagemap, m_buffer.data(), count * sizeof(uint64_t), static_cast<off_t>(page * sizeof(uint64_t)));
+        if (result == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw Platform::PlatformException(errno);
+        }
+
+        // Reading past the end of the address space reads nothing, which is where we stop.
+        auto entries = static_cast<size_t>(result) / sizeof(uint64_t);
+        if (entries == 0)
+            break;
+
+        for (size_t i = 0; i < entries; i++)
+        {
+            if (m_buffer[i] & soft_dirty_bit)
+                append(dirty, (page + i) * m_page_size, (page + i + 1) * m_page_size);
+        }
+
+        page += entries;
+    }
+}
+
+void DirtyPageTracker::clear_soft_dirty()
+{
+    // Clears the soft-dirty bit of every page in the process, not only the ones we track.
+    if (write(m_clear_refs, "4", 1) != 1)
+        throw Platform::PlatformException(errno);
+}
+}
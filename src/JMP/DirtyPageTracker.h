@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "MemoryMap.h"
+#include <cstdint>
+#include <span>
+#include <sys/types.h>
+#include <vector>
+
+namespace JMP
+{
+// Finds which pages were written to since we last asked, so a scan can skip the (usually many) that weren't.
+//
+//     DirtyPageTracker tracker(MemoryMap::self());
+//     auto results = scan.scan(memory_map);
+//     // ... later
+//     auto changed = scan.scan(tracker.collect_dirty());
+//
+// It's up to the kernel to tell us: either with userfaultfd's asynchronous write protection, which only works on our
+// own process, or with soft-dirty bits, which work on any but cost a write to clear_refs that touches every page the
+// process has. Only the regions mapped when tracking started are tracked, pages mapped since are never reported.
+class DirtyPageTracker
+{
+public:
+    enum class Mode
+    {
+        // Pages are write protected (without faulting to us), and PAGEMAP_SCAN returns and protects again the ones
+        // that were written in the same call. Linux 6.7 or later.
+        WriteProtect,
+        // Soft-dirty bits from pagemap, cleared through clear_refs. Not every kernel is built with them. A page written
+        // between reading the bits and clearing them is missed, so this is only exact for a stopped process.
+        SoftDirty
+    };
+
+    // Picks the best mode there is. Which regions are tracked is up to the filter, the same as what ValueScan scans.
+    explicit DirtyPageTracker(const MemoryMap&, const MemoryMap::Filter& = {{true, true, false}, {}});
+    DirtyPageTracker(Mode, const MemoryMap&, const MemoryMap::Filter& = {{true, true, false}, {}});
+    ~DirtyPageTracker();
+
+    DirtyPageTracker(const DirtyPageTracker&) = delete;
+    DirtyPageTracker& operator=(const DirtyPageTracker&) = delete;
+
+    static bool is_supported(Mode);
+
+    // The pages written since the last call (or since tracking started), merged into ranges sorted by address, and
+    // starts over. Regions the kernel wouldn't let us track are always included.
+    std::vector<std::span<const uint8_t>> collect_dirty();
+
+    Mode mode() const { return m_mode; }
+    size_t tracked_size() const;
+
+private:
+    struct Range
+    {
+        uintptr_t start{};
+        uintptr_t end{};
+    };
+
+    void collect_written(Range, std::vector<std::span<const uint8_t>>& dirty);
+    void collect_soft_dirty(Range, std::vector<std::span<const uint8_t>>& dirty);
+    void clear_soft_dirty();
+    void close_files();
+
+    Mode m_mode{};
+    pid_t m_pid{};
+    size_t m_page_size{};
+    int m_userfaultfd{-1};
+    int m_pagemap{-1};
+    int m_clear_refs{-1};
+    std::vector<Range> m_tracked;
+    std::vector<Range> m_untracked;
+    std::vector<uint64_t> m_buffer;
+};
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ElfImage.h"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <stdexcept>
+
+namespace JMP
+{
+namespace
+{
+// Set in a symbol's version for the versions that aren't the default (like memcpy@GLIBC_2.2.5).
+constexpr uint16_t hidden_version = 0x8000;
+}
+
+ElfImage::ElfImage(const ModuleTable::Module& module)
+    : m_base(module.base)
+{
+    if (!module.dynamic)
+        throw std::invalid_argument("Module has no dynamic section");
+
+    // glibc relocates the addresses in the dynamic section of everything it loads, but not those of the vDSO.
+    auto address = [this](ElfW(Addr) value) { return value < m_base ? m_base + value : value; };
+
+    uintptr_t plt_relocations{};
+    size_t plt_relocations_size{};
+    uintptr_t relocations{};
+    size_t relocations_size{};
+    uintptr_t gnu_hash_table{};
+
+    for (auto* entry = reinterpret_cast<const ElfW(Dyn)*>(module.dynamic); entry->d_tag != DT_NULL; entry++)
+    {
+        switch (entry->d_tag)
+        {
+            case DT_SYMTAB:
+                m_symbols = reinterpret_cast<const Symbol*>(address(entry->d_un.d_ptr));
+                break;
+            case DT_STRTAB:
+                m_strings = reinterpret_cast<const char*>(address(entry->d_un.d_ptr));
+                break;
+            case DT_VERSYM:
+                m_versions = reinterpret_cast<const uint16_t*>(address(entry->d_un.d_ptr));
+                break;
+            case DT_GNU_HASH:
+                gnu_hash_table = address(entry->d_un.d_ptr);
+                break;
+            case DT_HASH:
+                // The second word of the SysV hash table is the size of its chain array, one for every symbol.
+                m_hash_symbol_count = reinterpret_cast<const uint32_t*>(address(entry->d_un.d_ptr))[1];
+                break;
+            case DT_JMPREL:
+                plt_relocations = address(entry->d_un.d_ptr);
+                break;
+            case DT_PLTRELSZ:
+                plt_relocations_size = entry->d_un.d_val;
+                break;
+            case DT_PLTREL:
+                if (entry->d_un.d_val != DT_RELA)
+                    throw std::runtime_error("Module's PLT relocations aren't RELA");
+                break;
+            case DT_RELA:
+                relocations = address(entry->d_un.d_ptr);
+                break;
+            case DT_RELASZ:
+                relocations_size = entry->d_un.d_val;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!m_symbols || !m_strings)
+        throw std::runtime_error("Module has no dynamic symbols");
+
+    if (plt_relocations)
+        m_plt_relocations = {reinterpret_cast<const Relocation*>(plt_relocations), plt_relocations_size / sizeof(Relocation)};
+
+    if (relocations)
+        m_relocations = {reinterpret_cast<const Relocation*>(relocations), relocations_size / sizeof(Relocation)};
+
+    if (gnu_hash_table)
+    {
+        auto* header = reinterpret_cast<const uint32_t*>(gnu_hash_table);
+        m_bucket_count = header[0];
+        m_first_hashed_symbol = header[1];
+        m_bloom_size = header[2];
+        m_bloom_shift = header[3];
+        m_bloom = reinterpret_cast<const ElfW(Addr)*>(header + 4);
+        m_buckets = reinterpret_cast<const uint32_t*>(m_bloom + m_bloom_size);
+        m_chains = m_buckets + m_bucket_count;
+    }
+}
+
+uint32_t ElfImage::gnu_hash(std::string_view name)
+{
+    uint32_t hash = 5381;
+    for (auto c : name)
+        hash = hash * 33 + static_cast<uint8_t>(c);
+
+    return hash;
+}
+
+size_t ElfImage::symbol_count() const
+{
+    if (m_hash_symbol_count || !m_buckets)
+        return m_hash_symbol_count;
+
+    // The last symbol is the end of the chain that starts last, so we find that chain and follow it to its end.
+    uint32_t last_chain{};
+    for (uint32_t i = 0; i < m_bucket_count; i++)
+        last_chain = std::max(last_chain, m_buckets[i]);
+
+    if (last_chain < m_first_hashed_symbol)
+        return m_first_hashed_symbol;
+
+    while (!(m_chains[last_chain - m_first_hashed_symbol] & 1))
+        last_chain++;
+
+    return last_chain + 1;
+}
+
+const ElfImage::Symbol* ElfImage::find_symbol(std::string_view name, uint32_t hash) const
+{
+    if (!m_buckets || !m_bucket_count)
+        return nullptr;
+
+    // The bloom filter turns away most symbols the module doesn't have without touching the buckets.
+    constexpr uint32_t bits = sizeof(ElfW(Addr)) * 8;
+    auto word = m_bloom[(hash / bits) % m_bloom_size];
+    auto mask = (ElfW(Addr){1} << (hash % bits)) | (ElfW(Addr){1} << ((hash >> m_bloom_shift) % bits));
+    if ((word & mask) != mask)
+        return nullptr;
+
+    auto index = m_buckets[hash % m_bucket_count];
+    if (index < m_first_hashed_symbol)
+        return nullptr;
+
+    // Each chain is the symbols of one bucket, with the low bit of the last one's hash set.
+    for (;; index++)
+    {
+        auto chain_hash = m_chains[index - m_first_hashed_symbol];
+
+        if ((chain_hash | 1) == (hash | 1))
+        {
+            auto& symbol = m_symbols[index];
+            auto* symbol_name = m_strings + symbol.st_name;
+            auto is_hidden_version = m_versions && (m_versions[index] & hidden_version);
+
+            if (strncmp(symbol_name, name.data(), name.size()) == 0 && symbol_name[name.size()] == '\0' &&
+                symbol.st_shndx != SHN_UNDEF && !is_hidden_version)
+                return &symbol;
+        }
+
+        if (chain_hash & 1)
+            return nullptr;
+    }
+}
+}
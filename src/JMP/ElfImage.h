@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ModuleTable.h"
+#include <cstdint>
+#include <link.h>
+#include <span>
+#include <string_view>
+
+namespace JMP
+{
+// The dynamic linking structures (symbols, strings, relocations and the GNU hash table) of a module that's already
+// loaded, read in place from its memory. Nothing is copied, so this must not outlive the module.
+class ElfImage
+{
+public:
+    using Symbol = ElfW(Sym);
+    using Relocation = ElfW(Rela);
+
+    explicit ElfImage(const ModuleTable::Module&);
+
+    // The hash DT_GNU_HASH tables are built with.
+    static uint32_t gnu_hash(std::string_view name);
+
+    // Only finds what the module defines (and exports), as that's all the GNU hash table has. Versioned symbols are
+    // only found by their default version.
+    const Symbol* find_symbol(std::string_view name) const { return find_symbol(name, gnu_hash(name)); }
+    const Symbol* find_symbol(std::string_view name, uint32_t hash) const;
+
+    const Symbol& symbol(size_t index) const { return m_symbols[index]; }
+    // Nothing in the dynamic section says how many symbols there are, so this is worked out from the hash table,
+    // which takes a moment for a large module.
+    size_t symbol_count() const;
+    std::string_view symbol_name(const Symbol& symbol) const { return m_strings + symbol.st_name; }
+    uintptr_t symbol_address(const Symbol& symbol) const { return m_base + symbol.st_value; }
+
+    // Relocations for the PLT (DT_JMPREL), and everything else (DT_RELA).
+    std::span<const Relocation> plt_relocations() const { return m_plt_relocations; }
+    std::span<const Relocation> relocations() const { return m_relocations; }
+
+    uintptr_t base() const { return m_base; }
+    bool has_gnu_hash() const { return m_buckets != nullptr; }
+
+private:
+    uintptr_t m_base{};
+    const Symbol* m_symbols{};
+    const char* m_strings{};
+    // Versions for each symbol, if the module has them.
+    const uint16_t* m_versions{};
+    std::span<const Relocation> m_plt_relocations;
+    std::span<const Relocation> m_relocations;
+
+    uint32_t m_bucket_count{};
+    // The first symbol the hash table knows about, as undefined symbols come before it.
+    uint32_t m_first_hashed_symbol{};
+    uint32_t m_bloom_size{};
+    uint32_t m_bloom_shift{};
+    const ElfW(Addr)* m_bloom{};
+    const uint32_t* m_buckets{};
+    const uint32_t* m_chains{};
+    // The number of symbols, from DT_HASH, if the module has one as well.
+    uint32_t m_hash_symbol_count{};
+};
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ExecutableArena.h"
+#include "MemoryMap.h"
+#include "Platform.h"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <sys/mman.h>
+
+// Older headers don't have it, but the kernel has since 4.17 (and just treats it as a hint before that, which we check).
+#ifndef MAP_FIXED_NOREPLACE
+#    define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+namespace JMP
+{
+static constexpr uintptr_t lowest_user_address = 0x10000;
+static constexpr uintptr_t highest_user_address = 0x7FFFFFFFFFFF;
+
+static uintptr_t align_up(uintptr_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+static uintptr_t align_down(uintptr_t value, size_t alignment) { return value & ~(alignment - 1); }
+
+ExecutableArena::~ExecutableArena()
+{
+    for (auto& block : m_blocks)
+        munmap(reinterpret_cast<void*>(block.start), block_size);
+}
+
+size_t ExecutableArena::size_class_for(size_t size)
+{
+    auto size_class = std::countr_zero(std::bit_ceil(std::max(size, minimum_size_class))) -
+                      std::countr_zero(minimum_size_class);
+
+    return static_cast<size_t>(size_class) < number_of_size_classes ? size_class : number_of_size_classes;
+}
+
+bool ExecutableArena::is_reachable(uintptr_t near, uintptr_t start, uintptr_t end)
+{
+    auto distance = [near](uintptr_t address) {
+        return address > near ? static_cast<int64_t>(address - near) : static_cast<int64_t>(near - address);
+    };
+
+    return distance(start) <= maximum_distance && distance(end) <= maximum_distance;
+}
+
+std::span<uint8_t> ExecutableArena::allocate(const void* near, size_t size, size_t alignment)
+{
+    if (size == 0 || !std::has_single_bit(alignment))
+        throw std::invalid_argument("Invalid ExecutableArena allocation");
+
+    auto near_address = reinterpret_cast<uintptr_t>(near);
+
+    for (auto& block : m_blocks)
+    {
+        if (!block.writable || !is_reachable(near_address, block.start, block.end()))
+            continue;
+
+        if (auto bytes = allocate_in(block, near_address, size, alignment); !bytes.empty())
+            return bytes;
+    }
+
+    // Rather than reserving a block for every seal, reopen a sealed one with room. It stays executable while we write
+    // to it, as code in it could be running, and where that isn't allowed we just reserve a new block instead.
+    for (auto& block : m_blocks)
+    {
+        if (block.writable || !is_reachable(near_address, block.start, block.end()) ||
+            !has_room(block, near_address, size, alignment))
+            continue;
+
+        if (!Platform::try_modify_memory_protection({reinterpret_cast<uint8_t*>(block.start), block_size},
+                                                    {.read = true, .write = true, .execute = true}))
+            break;
+
+        block.writable = true;
+        return allocate_in(block, near_address, size, alignment);
+    }
+
+    auto bytes = allocate_in(reserve_block_near(near_address), near_address, size, alignment);
+    if (bytes.empty())
+        throw std::invalid_argument("ExecutableArena allocation is larger than a block");
+
+    return bytes;
+}
+
+bool ExecutableArena::has_room(const Block& block, uintptr_t near, size_t size, size_t alignment)
+{
+    alignment = std::max(alignment, minimum_size_class);
+
+    auto size_class = size_class_for(size);
+    if (size_class < number_of_size_classes && alignment == minimum_size_class &&
+        !block.free_offsets[size_class].empty())
+        return true;
+
+    auto rounded_size = size_class < number_of_size_classes ? minimum_size_class << size_class
+                                                            : align_up(size, minimum_size_class);
+    auto start = align_up(block.start + block.used, alignment);
+
+    return start + rounded_size <= block.end() && is_reachable(near, start, start + rounded_size);
+}
+
+std::span<uint8_t> ExecutableArena::allocate_in(Block& block, uintptr_t near, size_t size, size_t alignment)
+{
+    alignment = std::max(alignment, minimum_size_class);
+
+    auto size_class = size_class_for(size);
+    auto rounded_size = size_class < number_of_size_classes ? minimum_size_class << size_class
+                                                            : align_up(size, minimum_size_class);
+
+    uintptr_t start{};
+
+    if (size_class < number_of_size_classes && alignment == minimum_size_class &&
+        !block.free_offsets[size_class].empty())
+    {
+        start = block.start + block.free_offsets[size_class].back();
+        block.free_offsets[size_class].pop_back();
+    }
+    else
+    {
+        auto unused = block.start + block.used;
+        start = align_up(unused, alignment);
+        if (start + rounded_size > block.end() || !is_reachable(near, start, start + rounded_size))
+            return {};
+
+        m_lost_bytes += start - unused;
+        block.used = start + rounded_size - block.start;
+    }
+
+    block.dirty = true;
+    m_requested_bytes += size;
+    m_allocated_bytes += rounded_size;
+
+    return {reinterpret_cast<uint8_t*>(start), size};
+}
+
+void ExecutableArena::free(std::span<uint8_t> bytes)
+{
+    auto address = reinterpret_cast<uintptr_t>(bytes.data());
+
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), address,
+                               [](auto address, auto& block) { return address < block.start; });
+
+    if (it == m_blocks.begin() || address >= std::prev(it)->end())
+        throw std::invalid_argument("Freeing memory that isn't from this ExecutableArena");
+
+    auto& block = *std::prev(it);
+    auto size_class = size_class_for(bytes.size());
+    auto rounded_size = size_class < number_of_size_classes ? minimum_size_class << size_class
+                                                            : align_up(bytes.size(), minimum_size_class);
+
+    m_requested_bytes -= bytes.size();
+    m_allocated_bytes -= rounded_size;
+
+    if (size_class < number_of_size_classes && !block.has_been_sealed)
+        block.free_offsets[size_class].push_back(static_cast<uint16_t>(address - block.start));
+    else
+        m_lost_bytes += rounded_size;
+}
+
+ExecutableArena::Block& ExecutableArena::reserve_block_near(uintptr_t near)
+{
+    MemoryMap memory_map(0);
+
+    auto lower = near > lowest_user_address + maximum_distance ? near - maximum_distance : lowest_user_address;
+    auto upper = std::min(near + maximum_distance, highest_user_address);
+
+    // The closest block-aligned address to near in every gap between mappings, closest first.
+    std::vector<std::pair<uintptr_t, uintptr_t>> candidates;
+    uintptr_t gap_start = lowest_user_address;
+
+    auto consider_gap = [&](uintptr_t gap_end) {
+        auto first = align_up(std::max(gap_start, lower), block_size);
+        auto last_end = std::min(gap_end, upper);
+
+        if (last_end < first + block_size)
+            return;
+
+        auto last = align_down(last_end - block_size, block_size);
+        auto candidate = std::clamp(align_down(near, block_size), first, last);
+        auto distance = candidate > near ? candidate - near : near - candidate;
+
+        candidates.emplace_back(distance, candidate);
+    };
+
+    for (auto& region : memory_map.regions())
+    {
+        if (region.start > gap_start)
+            consider_gap(region.start);
+
+        gap_start = std::max(gap_start, region.end);
+    }
+
+    consider_gap(highest_user_address);
+
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto [distance, candidate] : candidates)
+    {
+        auto* mapping = mmap(reinterpret_cast<void*>(candidate), block_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+        if (mapping == MAP_FAILED)
+            continue;
+
+        if (reinterpret_cast<uintptr_t>(mapping) != candidate)
+        {
+            munmap(mapping, block_size);
+            continue;
+        }
+
+        Block block;
+        block.start = candidate;
+
+        auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), candidate,
+                                   [](auto address, auto& block) { return address < block.start; });
+
+        return *m_blocks.insert(it, std::move(block));
+    }
+
+    throw Platform::PlatformException("Unable to reserve executable memory near the requested address");
+}
+
+void ExecutableArena::seal()
+{
+    // Neighbouring blocks are flipped together.
+    for (size_t i = 0; i < m_blocks.size();)
+    {
+        if (!m_blocks[i].writable || !m_blocks[i].dirty)
+        {
+            i++;
+            continue;
+        }
+
+        auto first = i;
+        while (i + 1 < m_blocks.size() && m_blocks[i + 1].writable && m_blocks[i + 1].dirty &&
+               m_blocks[i + 1].start == m_blocks[i].end())
+            i++;
+
+        auto start = m_blocks[first].start;
+        auto end = m_blocks[i].end();
+        Platform::modify_memory_protection({reinterpret_cast<uint8_t*>(start), end - start},
+                                           {.read = true, .write = false, .execute = true});
+
+        for (auto j = first; j <= i; j++)
+        {
+            m_blocks[j].writable = false;
+            m_blocks[j].dirty = false;
+            m_blocks[j].has_been_sealed = true;
+        }
+
+        i++;
+    }
+}
+
+ExecutableArena::Statistics ExecutableArena::statistics() const
+{
+    Statistics statistics;
+    statistics.blocks = m_blocks.size();
+    statistics.reserved_bytes = m_blocks.size() * block_size;
+    statistics.allocated_bytes = m_requested_bytes;
+    statistics.wasted_bytes = m_allocated_bytes - m_requested_bytes + m_lost_bytes;
+
+    for (auto& block : m_blocks)
+    {
+        statistics.unused_bytes += block_size - block.used;
+
+        for (size_t i = 0; i < number_of_size_classes; i++)
+            statistics.free_bytes += block.free_offsets[i].size() * (minimum_size_class << i);
+    }
+
+    return statistics;
+}
+}
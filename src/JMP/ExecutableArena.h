@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace JMP
+{
+// Small executable allocations (trampolines, stubs) within rel32 reach of wherever they'll be jumped to from.
+//
+// Memory is reserved in blocks near the requested address, and handed out from them by size class. New allocations
+// are writable, and nothing becomes executable until seal() is called, which flips every block written to since
+// the last seal in as few syscalls as possible. Allocating from a sealed block makes it writable again until the next
+// seal, but never takes away execute, and memory that has been sealed is never handed out again, as code in it could
+// be running.
+class ExecutableArena
+{
+public:
+    static constexpr size_t block_size = 64 * 1024;
+    // How far a rel32 can reach, less a block so that anything in the block is reachable.
+    static constexpr int64_t maximum_distance = INT32_MAX - block_size;
+
+    struct Statistics
+    {
+        size_t blocks{};
+        size_t reserved_bytes{};
+        size_t allocated_bytes{};
+        // Freed, and waiting to be reused by an allocation of the same size class.
+        size_t free_bytes{};
+        // Never handed out yet, at the end of each block.
+        size_t unused_bytes{};
+        // Lost to rounding allocations up to their size class, to alignment, and to freed allocations that were
+        // sealed or are too large to have a size class.
+        size_t wasted_bytes{};
+
+        // How much of what we've handed out so far isn't being used by anything.
+        double fragmentation() const
+        {
+            auto touched = reserved_bytes - unused_bytes;
+            return touched ? static_cast<double>(free_bytes + wasted_bytes) / static_cast<double>(touched) : 0;
+        }
+    };
+
+    ExecutableArena() = default;
+    ExecutableArena(const ExecutableArena&) = delete;
+    ExecutableArena& operator=(const ExecutableArena&) = delete;
+    ~ExecutableArena();
+
+    // Returns writable memory that is within rel32 reach of near (from anywhere in the returned bytes).
+    std::span<uint8_t> allocate(const void* near, size_t size, size_t alignment = 16);
+    // Must be given exactly what allocate returned.
+    void free(std::span<uint8_t> bytes);
+
+    // Makes every block allocated from since the last seal executable, and no longer writable.
+    void seal();
+    // Forgets every block without unmapping it, for when code that jumps into them couldn't be unpatched.
+    void leak() { m_blocks.clear(); }
+
+    Statistics statistics() const;
+
+private:
+    static constexpr size_t minimum_size_class = 16;
+    static constexpr size_t number_of_size_classes = 9; // 16 to 4096 bytes
+
+    struct Block
+    {
+        uintptr_t start{};
+        size_t used{};
+        bool writable{true};
+        bool dirty{};
+        // Anything freed from it since could still be running, so it can't go on the free lists.
+        bool has_been_sealed{};
+        std::array<std::vector<uint16_t>, number_of_size_classes> free_offsets;
+
+        uintptr_t end() const { return start + block_size; }
+    };
+
+    static size_t size_class_for(size_t size);
+    static bool is_reachable(uintptr_t near, uintptr_t start, uintptr_t end);
+    // Whether allocate_in would succeed, without allocating anything.
+    static bool has_room(const Block&, uintptr_t near, size_t size, size_t alignment);
+
+    std::span<uint8_t> allocate_in(Block&, uintptr_t near, size_t size, size_t alignment);
+    Block& reserve_block_near(uintptr_t near);
+
+    // Sorted by address.
+    std::vector<Block> m_blocks;
+    // Live allocations, as asked for, and as rounded up to their size class.
+    size_t m_requested_bytes{};
+    size_t m_allocated_bytes{};
+    size_t m_lost_bytes{};
+};
+}
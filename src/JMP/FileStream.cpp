@@ -6,6 +6,7 @@
 
 #include "FileStream.h"
 #include <cassert>
+#include <cerrno>
 #include <stdexcept>
 
 namespace JMP
@@ -24,29 +25,75 @@ std::vector<uint8_t> FileStream::read(size_t number_of_bytes)
     std::vector<uint8_t> bytes;
     bytes.resize(number_of_bytes);
 
-    if (fread(bytes.data(), 1, number_of_bytes, m_file) != number_of_bytes)
+    if (auto result = try_read(bytes); !result || *result != number_of_bytes)
         throw std::runtime_error("Failed to fread for stream for all bytes requested");
 
     return std::move(bytes);
 }
 
+void FileStream::read_into(std::span<uint8_t> bytes)
+{
+    if (auto result = try_read(bytes); !result || *result != bytes.size())
+        throw std::runtime_error("Failed to fread for stream for all bytes requested");
+}
+
 void FileStream::write(std::span<uint8_t> bytes_to_write)
 {
-    if (fwrite(bytes_to_write.data(), 1, bytes_to_write.size(), m_file) != bytes_to_write.size())
+    if (!try_write(bytes_to_write))
         throw std::runtime_error("Failed to fwrite for stream for all bytes requested");
 }
 
 void FileStream::seek(size_t offset, SeekOrigin seek_origin)
 {
-    if (fseek(m_file, offset, whence_for_seek_origin(seek_origin)) != 0)
+    if (!try_seek(offset, seek_origin))
         throw std::runtime_error("Failed to fseek for stream");
 }
 
 size_t FileStream::index() const
+{
+    auto index = try_index();
+    if (!index)
+        throw std::runtime_error("Failed to ftell for stream to get index");
+
+    return *index;
+}
+
+std::expected<size_t, Platform::Error> FileStream::try_read(std::span<uint8_t> bytes)
+{
+    auto number_read = fread(bytes.data(), 1, bytes.size(), m_file);
+    if (number_read != bytes.size() && ferror(m_file))
+    {
+        clearerr(m_file);
+        return std::unexpected(errno);
+    }
+
+    return number_read;
+}
+
+std::expected<void, Platform::Error> FileStream::try_write(std::span<const uint8_t> bytes)
+{
+    if (fwrite(bytes.data(), 1, bytes.size(), m_file) != bytes.size())
+    {
+        clearerr(m_file);
+        return std::unexpected(errno);
+    }
+
+    return {};
+}
+
+std::expected<void, Platform::Error> FileStream::try_seek(size_t offset, SeekOrigin seek_origin)
+{
+    if (fseek(m_file, offset, whence_for_seek_origin(seek_origin)) != 0)
+        return std::unexpected(errno);
+
+    return {};
+}
+
+std::expected<size_t, Platform::Error> FileStream::try_index() const
 {
     auto tell = ftell(m_file);
     if (tell == -1)
-        throw std::runtime_error("Failed to ftell for stream to get index");
+        return std::unexpected(errno);
 
     return tell;
 }
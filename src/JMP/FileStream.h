@@ -6,8 +6,10 @@
 
 #pragma once
 
+#include "Platform.h"
 #include "Stream.h"
 #include <cstdio>
+#include <expected>
 
 namespace JMP
 {
@@ -27,10 +29,18 @@ public:
     ~FileStream();
 
     std::vector<uint8_t> read(size_t number_of_bytes) override;
+    void read_into(std::span<uint8_t> bytes) override;
     void write(std::span<uint8_t> bytes_to_write) override;
     void seek(size_t offset, SeekOrigin seek_origin) override;
     size_t index() const override;
 
+    // The same as above, but returning the error instead of throwing. Reading fills as much of bytes as there is to
+    // read, and returns how much that was, which is less only at the end of the file.
+    std::expected<size_t, Platform::Error> try_read(std::span<uint8_t> bytes);
+    std::expected<void, Platform::Error> try_write(std::span<const uint8_t> bytes);
+    std::expected<void, Platform::Error> try_seek(size_t offset, SeekOrigin);
+    std::expected<size_t, Platform::Error> try_index() const;
+
 private:
     explicit FileStream(FILE* file) : m_file(file) {}
 
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ImportHooks.h"
+#include "ProtectionTransaction.h"
+#include <atomic>
+#include <elf.h>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace JMP
+{
+namespace
+{
+bool is_function(const ElfImage::Symbol& symbol)
+{
+    // Undefined symbols are often NOTYPE, but data imports (stdout, environ) are always OBJECT.
+    auto type = ELF64_ST_TYPE(symbol.st_info);
+    return type == STT_FUNC || type == STT_GNU_IFUNC || type == STT_NOTYPE;
+}
+}
+
+ImportHooks::ImportHooks(const ModuleTable& modules, const ModuleTable::Module& module)
+    : m_modules(modules)
+    , m_module_start(module.start)
+    , m_module_end(module.end)
+{
+    ElfImage image(module);
+
+    auto index = [&](std::span<const ElfImage::Relocation> relocations) {
+        for (auto& relocation : relocations)
+        {
+            auto type = ELF64_R_TYPE(relocation.r_info);
+            auto symbol_index = ELF64_R_SYM(relocation.r_info);
+
+            if ((type != R_X86_64_JUMP_SLOT && type != R_X86_64_GLOB_DAT) || symbol_index == 0)
+                continue;
+
+            auto& symbol = image.symbol(symbol_index);
+            if (!is_function(symbol))
+                continue;
+
+            auto* slot = reinterpret_cast<uintptr_t*>(image.base() + relocation.r_offset);
+            auto& import = m_imports[image.symbol_name(symbol)];
+            import.slots.push_back(slot);
+            import.weak = ELF64_ST_BIND(symbol.st_info) == STB_WEAK;
+        }
+    };
+
+    index(image.plt_relocations());
+    index(image.relocations());
+}
+
+ImportHooks::~ImportHooks()
+{
+    try
+    {
+        uninstall_all();
+    }
+    catch (...)
+    {
+        // The slots couldn't be made writable again (their module is gone, most likely), so there's nothing to put
+        // back.
+    }
+}
+
+const ImportHooks::Import& ImportHooks::find_import(std::string_view symbol) const
+{
+    auto it = m_imports.find(symbol);
+    if (it == m_imports.end())
+        throw std::invalid_argument("Module doesn't import symbol");
+
+    return it->second;
+}
+
+std::vector<std::string_view> ImportHooks::imported_symbols() const
+{
+    std::vector<std::string_view> symbols;
+    symbols.reserve(m_imports.size());
+
+    for (auto& [symbol, import] : m_imports)
+        symbols.push_back(symbol);
+
+    return symbols;
+}
+
+void* ImportHooks::resolve(std::string_view symbol) const
+{
+    return reinterpret_cast<void*>(resolve(symbol, find_import(symbol)));
+}
+
+uintptr_t ImportHooks::resolve(std::string_view symbol, const Import& import) const
+{
+    // A .got.plt slot that hasn't been bound yet points back into the module's own PLT, while a GLOB_DAT one is
+    // always bound, so any slot pointing outside of the module has the answer.
+    for (auto* slot : import.slots)
+    {
+        auto value = std::atomic_ref(*slot).load(std::memory_order_acquire);
+        if (value < m_module_start || value >= m_module_end)
+            return value;
+    }
+
+    return resolve_lazily(symbol, import);
+}
+
+uintptr_t ImportHooks::resolve_lazily(std::string_view symbol, const Import& import) const
+{
+    auto hash = ElfImage::gnu_hash(symbol);
+
+    // The same search the loader does: every module in load order, and the first to define it wins.
+    for (auto& module : m_modules.modules())
+    {
+        if (!module.dynamic)
+            continue;
+
+        ElfImage image(module);
+        auto* definition = image.find_symbol(symbol, hash);
+        if (!definition)
+            continue;
+
+        auto address = image.symbol_address(*definition);
+
+        // We want the implementation the resolver picks for this CPU, not the resolver.
+        if (ELF64_ST_TYPE(definition->st_info) == STT_GNU_IFUNC)
+            address = reinterpret_cast<uintptr_t (*)()>(address)();
+
+        return address;
+    }
+
+    if (import.weak)
+        return 0;
+
+    throw std::runtime_error("Unable to resolve lazily bound import");
+}
+
+std::vector<void*> ImportHooks::install(std::span<const Request> requests)
+{
+    std::unordered_set<std::string_view> symbols;
+    std::vector<void*> originals;
+    originals.reserve(requests.size());
+
+    ProtectionTransaction transaction;
+
+    for (auto& request : requests)
+    {
+        auto& import = find_import(request.symbol);
+        if (is_installed(request.symbol) || !symbols.insert(request.symbol).second)
+            throw std::invalid_argument("Import is already hooked");
+
+        originals.push_back(reinterpret_cast<void*>(resolve(request.symbol, import)));
+
+        for (auto* slot : import.slots)
+            transaction.add({reinterpret_cast<uint8_t*>(slot), sizeof(*slot)}, {true, true, false});
+    }
+
+    auto restore_protection = transaction.apply();
+
+    for (auto& request : requests)
+    {
+        auto it = m_imports.find(request.symbol);
+
+        Hook hook;
+        hook.replacement = reinterpret_cast<uintptr_t>(request.replacement);
+        hook.original_values.reserve(it->second.slots.size());
+
+        for (auto* slot : it->second.slots)
+            hook.original_values.push_back(std::atomic_ref(*slot).exchange(hook.replacement, std::memory_order_acq_rel));
+
+        m_hooks.emplace(it->first, std::move(hook));
+    }
+
+    return originals;
+}
+
+void* ImportHooks::install(std::string_view symbol, const void* replacement)
+{
+    Request request{symbol, replacement};
+    return install(std::span(&request, 1)).front();
+}
+
+void ImportHooks::uninstall(std::span<const std::string_view> symbols)
+{
+    std::unordered_set<std::string_view> unique_symbols;
+    ProtectionTransaction transaction;
+
+    for (auto symbol : symbols)
+    {
+        if (!is_installed(symbol))
+            throw std::invalid_argument("Unable to uninstall hook that isn't installed");
+
+        if (!unique_symbols.insert(symbol).second)
+            throw std::invalid_argument("Unable to uninstall the same hook twice");
+
+        for (auto* slot : m_imports.find(symbol)->second.slots)
+            transaction.add({reinterpret_cast<uint8_t*>(slot), sizeof(*slot)}, {true, true, false});
+    }
+
+    auto restore_protection = transaction.apply();
+
+    for (auto symbol : symbols)
+    {
+        auto it = m_hooks.find(symbol);
+        auto& slots = m_imports.find(symbol)->second.slots;
+
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            auto expected = it->second.replacement;
+            std::atomic_ref(*slots[i]).compare_exchange_strong(expected, it->second.original_values[i],
+                                                                std::memory_order_acq_rel);
+        }
+
+        m_hooks.erase(it);
+    }
+}
+
+void ImportHooks::uninstall(std::string_view symbol) { uninstall(std::span(&symbol, 1)); }
+
+void ImportHooks::uninstall_all()
+{
+    std::vector<std::string_view> symbols;
+    symbols.reserve(m_hooks.size());
+
+    for (auto& [symbol, hook] : m_hooks)
+        symbols.push_back(symbol);
+
+    if (!symbols.empty())
+        uninstall(symbols);
+}
+}
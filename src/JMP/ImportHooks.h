@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ElfImage.h"
+#include "ModuleTable.h"
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace JMP
+{
+// Hooks the functions a module imports by pointing its GOT slots somewhere else. Its calls through the PLT (and
+// anything it took the address of through the GOT) then go straight to the replacement, so unlike an inline hook
+// nothing is added to the call path, and no code is written. Calls from any other module are unaffected.
+//
+// Every import is indexed when constructed, so hooking any number of them doesn't look through the relocations again.
+// Slots are swapped atomically, so a thread calling an import sees either the old or the new function, and each
+// batch changes protection (for RELRO) once.
+class ImportHooks
+{
+public:
+    struct Request
+    {
+        std::string_view symbol;
+        const void* replacement{};
+    };
+
+    // modules is used to find what lazily bound imports (that haven't been called yet) resolve to, and must outlive
+    // this, as must module being loaded.
+    ImportHooks(const ModuleTable& modules, const ModuleTable::Module& module);
+    ImportHooks(const ImportHooks&) = delete;
+    ImportHooks& operator=(const ImportHooks&) = delete;
+    ~ImportHooks();
+
+    // Returns what each import resolved to (to call the original), in the same order as the requests.
+    std::vector<void*> install(std::span<const Request> requests);
+    void* install(std::string_view symbol, const void* replacement);
+
+    // A slot that someone else has changed since we hooked it is left alone.
+    void uninstall(std::span<const std::string_view> symbols);
+    void uninstall(std::string_view symbol);
+    void uninstall_all();
+
+    bool is_installed(std::string_view symbol) const { return m_hooks.contains(symbol); }
+    bool imports(std::string_view symbol) const { return m_imports.contains(symbol); }
+    std::vector<std::string_view> imported_symbols() const;
+
+    // What calling the import from this module would call right now, resolving it if it's lazily bound.
+    void* resolve(std::string_view symbol) const;
+
+private:
+    struct GnuHash
+    {
+        size_t operator()(std::string_view name) const { return ElfImage::gnu_hash(name); }
+    };
+
+    struct Import
+    {
+        // Usually just the one in .got.plt, but a GLOB_DAT one as well when the module took the function's address.
+        std::vector<uintptr_t*> slots;
+        // Nothing has to define a weak import, and then it resolves to null.
+        bool weak{};
+    };
+
+    struct Hook
+    {
+        uintptr_t replacement{};
+        // What each of the import's slots had before, in the same order.
+        std::vector<uintptr_t> original_values;
+    };
+
+    const Import& find_import(std::string_view symbol) const;
+    uintptr_t resolve(std::string_view symbol, const Import&) const;
+    uintptr_t resolve_lazily(std::string_view symbol, const Import&) const;
+
+    const ModuleTable& m_modules;
+    uintptr_t m_module_start{};
+    uintptr_t m_module_end{};
+    // Keyed by names in the module's own string table.
+    std::unordered_map<std::string_view, Import, GnuHash> m_imports;
+    std::unordered_map<std::string_view, Hook, GnuHash> m_hooks;
+};
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "Platform.h"
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+
+namespace JMP
+{
+// An allocator for containers that can grow to gigabytes, like scan buffers and snapshots: anything of at least a huge
+// page comes from Platform::allocate_large (backed by huge pages when we can get them), and anything smaller comes from
+// the heap as usual.
+//
+//     std::vector<uint8_t, LargeAllocator<uint8_t>> snapshot(size);
+template<typename T>
+class LargeAllocator
+{
+public:
+    using value_type = T;
+
+    LargeAllocator() = default;
+
+    template<typename U>
+    LargeAllocator(const LargeAllocator<U>&)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+            throw std::bad_array_new_length();
+
+        if (!is_large(count))
+            return std::allocator<T>().allocate(count);
+
+        return reinterpret_cast<T*>(Platform::allocate_large(count * sizeof(T)).bytes.data());
+    }
+
+    void deallocate(T* pointer, size_t count)
+    {
+        if (!is_large(count))
+            return std::allocator<T>().deallocate(pointer, count);
+
+        Platform::free_large({reinterpret_cast<uint8_t*>(pointer), count * sizeof(T)});
+    }
+
+    template<typename U>
+    bool operator==(const LargeAllocator<U>&) const
+    {
+        return true;
+    }
+
+private:
+    static bool is_large(size_t count) { return count * sizeof(T) >= Platform::huge_page_size(); }
+};
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "MemoryMap.h"
+#include "ScopeGuard.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace JMP
+{
+namespace
+{
+// Every line of maps looks like this, and we only need to handle exactly this:
+// 7f2c3a1f0000-7f2c3a212000 r-xp 00028000 08:01 1234567                    /usr/lib/libc.so.6
+class LineParser
+{
+public:
+    LineParser(const char* current, const char* end) : m_current(current), m_end(end) {}
+
+    bool at_end() const { return m_current >= m_end; }
+
+    uint64_t hexadecimal()
+    {
+        uint64_t value{};
+
+        for (; m_current < m_end; m_current++)
+        {
+            auto c = *m_current;
+            if (c >= '0' && c <= '9')
+                value = (value << 4) | (c - '0');
+            else if (c >= 'a' && c <= 'f')
+                value = (value << 4) | (c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                value = (value << 4) | (c - 'A' + 10);
+            else
+                break;
+        }
+
+        return value;
+    }
+
+    char next() { return m_current < m_end ? *m_current++ : '\0'; }
+
+    void skip_past(char c)
+    {
+        while (m_current < m_end && *m_current++ != c)
+            ;
+    }
+
+    void skip_spaces()
+    {
+        while (m_current < m_end && *m_current == ' ')
+            m_current++;
+    }
+
+    std::string_view rest_of_line()
+    {
+        auto* start = m_current;
+        while (m_current < m_end && *m_current != '\n')
+            m_current++;
+
+        std::string_view line(start, m_current - start);
+        if (m_current < m_end)
+            m_current++;
+
+        return line;
+    }
+
+private:
+    const char* m_current;
+    const char* m_end;
+};
+}
+
+bool MemoryMap::Filter::matches(const Region& region) const
+{
+    if (protection.read && !region.protection.read)
+        return false;
+
+    if (protection.write && !region.protection.write)
+        return false;
+
+    if (protection.execute && !region.protection.execute)
+        return false;
+
+    return path.empty() || region.path.find(path) != std::string_view::npos;
+}
+
+void MemoryMap::refresh()
+{
+    char path[32];
+    if (m_pid == 0)
+        snprintf(path, sizeof(path), "/proc/self/maps");
+    else
+        snprintf(path, sizeof(path), "/proc/%d/maps", m_pid);
+
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw Platform::PlatformException(errno);
+
+    ScopeGuard close_fd{[fd] { close(fd); }};
+
+    if (m_buffer.empty())
+        m_buffer.resize(64 * 1024);
+
+    // The kernel generates maps as we read it, so there is no size to ask for up front. Keep whatever size we needed
+    // last time, so reading the same process again doesn't have to grow it.
+    size_t size{};
+
+    while (true)
+    {
+        if (size == m_buffer.size())
+            m_buffer.resize(m_buffer.size() * 2);
+
+        auto result = read(fd, m_buffer.data() + size, m_buffer.size() - size);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw Platform::PlatformException(errno);
+        }
+
+        if (result == 0)
+            break;
+
+        size += result;
+    }
+
+    m_regions.clear();
+
+    LineParser parser(m_buffer.data(), m_buffer.data() + size);
+
+    while (!parser.at_end())
+    {
+        Region region;
+        region.start = parser.hexadecimal();
+        parser.next();
+        region.end = parser.hexadecimal();
+        parser.next();
+
+        region.protection.read = parser.next() == 'r';
+        region.protection.write = parser.next() == 'w';
+        region.protection.execute = parser.next() == 'x';
+        region.shared = parser.next() == 's';
+        parser.next();
+
+        region.offset = parser.hexadecimal();
+        parser.next();
+
+        // Device and inode, which we have no use for.
+        parser.skip_past(' ');
+        parser.skip_past(' ');
+        parser.skip_spaces();
+
+        region.path = parser.rest_of_line();
+
+        m_regions.push_back(region);
+    }
+}
+
+const MemoryMap::Region* MemoryMap::find(uintptr_t address) const
+{
+    // The kernel always gives us regions sorted, and never overlapping.
+    auto it = std::upper_bound(m_regions.begin(), m_regions.end(), address,
+                               [](auto address, auto& region) { return address < region.start; });
+
+    if (it == m_regions.begin())
+        return nullptr;
+
+    auto& region = *std::prev(it);
+    if (!region.contains(address))
+        return nullptr;
+
+    return &region;
+}
+
+DisjointSpan<uint8_t> MemoryMap::bytes_matching(const Filter& filter) const
+{
+    DisjointSpan<uint8_t> bytes;
+
+    for_each_matching(filter, [&bytes](auto& region) { bytes.push(region.bytes()); });
+
+    return bytes;
+}
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "DisjointSpan.h"
+#include "Platform.h"
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace JMP
+{
+// A snapshot of the address space of a process, parsed from /proc/<pid>/maps. Refreshing reuses the storage of the
+// previous snapshot, so once it has grown large enough it never allocates again.
+class MemoryMap
+{
+public:
+    struct Region
+    {
+        uintptr_t start{};
+        uintptr_t end{};
+        Platform::MemoryProtection protection;
+        bool shared{};
+        uint64_t offset{};
+        // Points into the snapshot, and is only valid until the next refresh.
+        std::string_view path;
+
+        size_t size() const { return end - start; }
+        bool contains(uintptr_t address) const { return address >= start && address < end; }
+        std::span<uint8_t> bytes() const { return {reinterpret_cast<uint8_t*>(start), size()}; }
+    };
+
+    // Regions match if they have at least the protection asked for, and their path contains the given path.
+    struct Filter
+    {
+        Platform::MemoryProtection protection;
+        std::string_view path;
+
+        bool matches(const Region&) const;
+    };
+
+    MemoryMap() = default;
+    explicit MemoryMap(pid_t pid) : m_pid(pid) { refresh(); }
+
+    // Region paths point into our buffer, which a copy wouldn't share. Moving keeps the buffer where it is.
+    MemoryMap(const MemoryMap&) = delete;
+    MemoryMap& operator=(const MemoryMap&) = delete;
+    MemoryMap(MemoryMap&&) = default;
+    MemoryMap& operator=(MemoryMap&&) = default;
+
+    static MemoryMap self() { return MemoryMap(0); }
+
+    // Zero means this process, through /proc/self/maps.
+    pid_t pid() const { return m_pid; }
+
+    void refresh();
+
+    std::span<const Region> regions() const { return m_regions; }
+    const Region* find(uintptr_t address) const;
+    const Region* find(const void* address) const { return find(reinterpret_cast<uintptr_t>(address)); }
+
+    // Only makes sense for our own process, the spans are of our address space.
+    DisjointSpan<uint8_t> bytes_matching(const Filter&) const;
+
+    template<typename Callback>
+    void for_each_matching(const Filter& filter, Callback callback) const
+    {
+        for (auto& region : m_regions)
+        {
+            if (filter.matches(region))
+                callback(region);
+        }
+    }
+
+private:
+    pid_t m_pid{};
+    std::vector<char> m_buffer;
+    std::vector<Region> m_regions;
+};
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ModuleScan.h"
+#include "Threads.h"
+#include <algorithm>
+#include <atomic>
+
+namespace JMP
+{
+namespace
+{
+bool matches_any(const ModuleTable::Module& module, const std::vector<std::string>& names)
+{
+    return std::any_of(names.begin(), names.end(),
+                       [&](const std::string& name) { return name == module.name || name == module.path; });
+}
+}
+
+bool ModuleScan::is_scanned(const ModuleTable::Module& module) const
+{
+    if (!m_included.empty() && !matches_any(module, m_included))
+        return false;
+
+    return !matches_any(module, m_excluded);
+}
+
+std::vector<ModuleScan::Job> ModuleScan::plan_jobs(size_t signature_length) const
+{
+    std::vector<Job> jobs;
+    auto& modules = m_modules.modules();
+
+    for (size_t i = 0; i < modules.size(); i++)
+    {
+        if (!is_scanned(modules[i]))
+            continue;
+
+        for (auto& segment : modules[i].segments)
+        {
+            if (!segment.protection.read || (m_executable_only && !segment.protection.execute))
+                continue;
+
+            if (segment.size < signature_length)
+                continue;
+
+            // Consecutive jobs overlap by one less than the signature, so a match straddling the boundary is found by
+            // exactly one of them.
+            auto candidates = segment.size - signature_length + 1;
+            for (size_t offset = 0; offset < candidates; offset += job_size)
+            {
+                auto job_candidates = std::min(job_size, candidates - offset);
+                jobs.push_back({i, segment.start + offset, job_candidates + signature_length - 1});
+            }
+        }
+    }
+
+    return jobs;
+}
+
+std::vector<ModuleScan::Match> ModuleScan::find_first(const Signature& signature) const
+{
+    if (signature.values().empty())
+        return {};
+
+    auto jobs = plan_jobs(signature.values().size());
+    auto thread_count = resolve_thread_count(m_thread_count, jobs.size());
+    auto& modules = m_modules.modules();
+
+    // The earliest match in each module so far. Jobs of a module are planned in address order, so once one has a
+    // match, most of the jobs after it are skipped without being scanned.
+    std::vector<std::atomic<uintptr_t>> firsts(modules.size());
+    for (auto& first : firsts)
+        first.store(UINTPTR_MAX, std::memory_order_relaxed);
+
+    // find_in doesn't change the signature, but isn't const, so each thread gets its own.
+    std::vector<Signature> signatures(thread_count, signature);
+
+    for_each_on_threads(thread_count, jobs.size(), [&](size_t thread_index, size_t i) {
+        auto& job = jobs[i];
+        auto& first = firsts[job.module_index];
+        if (job.start >= first.load(std::memory_order_relaxed))
+            return;
+
+        auto* match = signatures[thread_index].find_in({reinterpret_cast<uint8_t*>(job.start), job.size});
+        if (!match)
+            return;
+
+        auto address = reinterpret_cast<uintptr_t>(match);
+        auto current = first.load(std::memory_order_relaxed);
+        while (address < current && !first.compare_exchange_weak(current, address, std::memory_order_relaxed))
+        {
+        }
+    });
+
+    std::vector<Match> matches;
+    for (size_t i = 0; i < modules.size(); i++)
+    {
+        auto address = firsts[i].load(std::memory_order_relaxed);
+        if (address != UINTPTR_MAX)
+            matches.push_back({&modules[i], address});
+    }
+
+    return matches;
+}
+
+std::vector<ModuleScan::Match> ModuleScan::find_all(const Signature& signature) const
+{
+    if (signature.values().empty())
+        return {};
+
+    auto jobs = plan_jobs(signature.values().size());
+    auto thread_count = resolve_thread_count(m_thread_count, jobs.size());
+    auto& modules = m_modules.modules();
+
+    std::vector<Signature> signatures(thread_count, signature);
+    std::vector<std::vector<uintptr_t>> job_matches(jobs.size());
+
+    for_each_on_threads(thread_count, jobs.size(), [&](size_t thread_index, size_t i) {
+        std::span<uint8_t> bytes{reinterpret_cast<uint8_t*>(jobs[i].start), jobs[i].size};
+
+        // Keep going from just past each match, until there are too few bytes left for another.
+        while (auto* match = static_cast<uint8_t*>(signatures[thread_index].find_in(bytes)))
+        {
+            job_matches[i].push_back(reinterpret_cast<uintptr_t>(match));
+            bytes = bytes.subspan(match - bytes.data() + 1);
+        }
+    });
+
+    std::vector<Match> matches;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        for (auto address : job_matches[i])
+            matches.push_back({&modules[jobs[i].module_index], address});
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) { return a.address < b.address; });
+    return matches;
+}
+}
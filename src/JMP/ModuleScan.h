@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ModuleTable.h"
+#include "Signature.h"
+#include "Threads.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace JMP
+{
+// Scans every loaded module for a signature at once, for when we don't know which library it's in.
+//
+//     ModuleTable modules;
+//     auto matches = ModuleScan(modules).exclude("libc.so.6").find_first(Signature("48 8B 05 ? ? ? ? C3"));
+//     for (auto& match : matches)
+//         printf("%s+%#lx\n", match.module->name.c_str(), match.module_offset());
+//
+// Each segment is split into jobs, which are shared out between threads, so a library with one huge segment doesn't
+// leave every other thread waiting on it.
+class ModuleScan
+{
+public:
+    struct Match
+    {
+        // Points into the table we scanned, so it's only good until the table is refreshed.
+        const ModuleTable::Module* module{};
+        uintptr_t address{};
+
+        uintptr_t module_offset() const { return address - module->base; }
+    };
+
+    // The most of a segment one thread scans at a time.
+    static constexpr size_t job_size = 1024 * 1024;
+
+    explicit ModuleScan(const ModuleTable& modules) : m_modules(modules) {}
+
+    // Names are matched against a module's filename, or its full path. With nothing included, every module that isn't
+    // excluded is scanned.
+    ModuleScan& include(std::string_view name)
+    {
+        m_included.emplace_back(name);
+        return *this;
+    }
+
+    ModuleScan& exclude(std::string_view name)
+    {
+        m_excluded.emplace_back(name);
+        return *this;
+    }
+
+    // Whether to only scan executable segments, which is where signatures usually are. On by default.
+    ModuleScan& set_executable_only(bool executable_only)
+    {
+        m_executable_only = executable_only;
+        return *this;
+    }
+
+    ModuleScan& set_thread_count(size_t thread_count)
+    {
+        m_thread_count = thread_count;
+        return *this;
+    }
+
+    // The first match in each module that has one, in the order of the table. Jobs past a match we already have are
+    // skipped.
+    std::vector<Match> find_first(const Signature&) const;
+    // Every match in every module, sorted by address.
+    std::vector<Match> find_all(const Signature&) const;
+
+    bool is_scanned(const ModuleTable::Module&) const;
+
+private:
+    struct Job
+    {
+        size_t module_index{};
+        uintptr_t start{};
+        // Includes the bytes needed for a match starting at the job's last candidate, which is the next job's first.
+        size_t size{};
+    };
+
+    std::vector<Job> plan_jobs(size_t signature_length) const;
+
+    const ModuleTable& m_modules;
+    std::vector<std::string> m_included;
+    std::vector<std::string> m_excluded;
+    bool m_executable_only{true};
+    size_t m_thread_count{every_core};
+};
+}
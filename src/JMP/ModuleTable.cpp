@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ModuleTable.h"
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <link.h>
+
+namespace JMP
+{
+namespace
+{
+struct Counters
+{
+    unsigned long long adds{};
+    unsigned long long subs{};
+};
+
+Counters loader_counters()
+{
+    Counters counters;
+
+    // Every entry has the same counters, so we only need to look at the first one.
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data) {
+            auto& counters = *static_cast<Counters*>(data);
+            counters.adds = info->dlpi_adds;
+            counters.subs = info->dlpi_subs;
+            return 1;
+        },
+        &counters);
+
+    return counters;
+}
+
+std::vector<uint8_t> read_build_id(const dl_phdr_info& info, const ElfW(Phdr) & header)
+{
+    // Notes are aligned to 4 bytes, unless the segment says otherwise (which it only does to say 8).
+    auto alignment = std::max<size_t>(header.p_align, 4);
+    auto align = [alignment](size_t value) { return (value + alignment - 1) & ~(alignment - 1); };
+
+    auto* notes = reinterpret_cast<const uint8_t*>(info.dlpi_addr + header.p_vaddr);
+    size_t offset{};
+
+    while (offset + sizeof(ElfW(Nhdr)) <= header.p_memsz)
+    {
+        auto* note = reinterpret_cast<const ElfW(Nhdr)*>(notes + offset);
+        auto* name = notes + offset + sizeof(ElfW(Nhdr));
+        auto* description = name + align(note->n_namesz);
+
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && memcmp(name, "GNU", 4) == 0)
+            return {description, description + note->n_descsz};
+
+        offset += sizeof(ElfW(Nhdr)) + align(note->n_namesz) + align(note->n_descsz);
+    }
+
+    return {};
+}
+
+ModuleTable::Module make_module(const dl_phdr_info& info)
+{
+    ModuleTable::Module module;
+    module.path = info.dlpi_name ? info.dlpi_name : "";
+    module.base = info.dlpi_addr;
+    module.start = UINTPTR_MAX;
+
+    if (auto last_slash = module.path.rfind('/'); last_slash != std::string::npos)
+        module.name = module.path.substr(last_slash + 1);
+    else
+        module.name = module.path;
+
+    for (auto i = 0; i < info.dlpi_phnum; i++)
+    {
+        auto& header = info.dlpi_phdr[i];
+
+        if (header.p_type == PT_NOTE && module.build_id.empty())
+            module.build_id = read_build_id(info, header);
+
+        if (header.p_type == PT_DYNAMIC)
+            module.dynamic = info.dlpi_addr + header.p_vaddr;
+
+        if (header.p_type != PT_LOAD)
+            continue;
+
+        ModuleTable::Segment segment;
+        segment.start = info.dlpi_addr + header.p_vaddr;
+        segment.size = header.p_memsz;
+        segment.protection.read = header.p_flags & PF_R;
+        segment.protection.write = header.p_flags & PF_W;
+        segment.protection.execute = header.p_flags & PF_X;
+
+        module.start = std::min(module.start, segment.start);
+        module.end = std::max(module.end, segment.end());
+        module.segments.push_back(segment);
+    }
+
+    if (module.segments.empty())
+        module.start = module.end = module.base;
+
+    return module;
+}
+}
+
+bool ModuleTable::has_unloaded_modules() const { return loader_counters().subs != m_subs; }
+
+bool ModuleTable::refresh()
+{
+    auto counters = loader_counters();
+    if (!m_modules.empty() && counters.adds == m_adds && counters.subs == m_subs)
+        return false;
+
+    struct Context
+    {
+        ModuleTable& table;
+        std::unordered_multimap<uintptr_t, size_t> indices_by_base;
+        std::vector<bool> seen;
+        std::vector<Module> added;
+    } context{*this, {}, std::vector<bool>(m_modules.size()), {}};
+
+    for (size_t i = 0; i < m_modules.size(); i++)
+        context.indices_by_base.emplace(m_modules[i].base, i);
+
+    dl_iterate_phdr(
+        [](dl_phdr_info* info, size_t, void* data) {
+            auto& context = *static_cast<Context*>(data);
+            std::string_view path = info->dlpi_name ? info->dlpi_name : "";
+
+            // Only modules we haven't seen before need their headers looked at.
+            auto [begin, end] = context.indices_by_base.equal_range(info->dlpi_addr);
+            for (auto it = begin; it != end; it++)
+            {
+                if (context.table.m_modules[it->second].path == path)
+                {
+                    context.seen[it->second] = true;
+                    return 0;
+                }
+            }
+
+            context.added.push_back(make_module(*info));
+            return 0;
+        },
+        &context);
+
+    if (counters.subs != m_subs)
+    {
+        size_t kept{};
+        for (size_t i = 0; i < m_modules.size(); i++)
+        {
+            if (!context.seen[i])
+                continue;
+
+            if (kept != i)
+                m_modules[kept] = std::move(m_modules[i]);
+
+            kept++;
+        }
+
+        m_modules.resize(kept);
+    }
+
+    for (auto& module : context.added)
+        m_modules.push_back(std::move(module));
+
+    m_adds = counters.adds;
+    m_subs = counters.subs;
+
+    rebuild_indices();
+    return true;
+}
+
+void ModuleTable::rebuild_indices()
+{
+    m_indices_by_name.clear();
+    m_indices_by_address.clear();
+
+    for (size_t i = 0; i < m_modules.size(); i++)
+    {
+        auto& module = m_modules[i];
+
+        // If two modules have the same filename, the first one loaded wins, just like symbol resolution.
+        m_indices_by_name.try_emplace(module.path, i);
+        m_indices_by_name.try_emplace(module.name, i);
+
+        if (!module.segments.empty())
+            m_indices_by_address.push_back(i);
+    }
+
+    std::sort(m_indices_by_address.begin(), m_indices_by_address.end(),
+              [this](auto a, auto b) { return m_modules[a].start < m_modules[b].start; });
+}
+
+const ModuleTable::Module* ModuleTable::find_by_name(const char* name) const
+{
+    return find_by_name(std::string_view(name ? name : ""));
+}
+
+const ModuleTable::Module* ModuleTable::find_by_name(std::string_view name) const
+{
+    auto it = m_indices_by_name.find(name);
+    if (it == m_indices_by_name.end())
+        return nullptr;
+
+    return &m_modules[it->second];
+}
+
+const ModuleTable::Module* ModuleTable::find_by_address(uintptr_t address) const
+{
+    auto it = std::upper_bound(m_indices_by_address.begin(), m_indices_by_address.end(), address,
+                               [this](auto address, auto index) { return address < m_modules[index].start; });
+
+    if (it == m_indices_by_address.begin())
+        return nullptr;
+
+    auto& module = m_modules[*std::prev(it)];
+    if (!module.contains(address))
+        return nullptr;
+
+    return &module;
+}
+
+const ModuleTable::Module* ModuleTable::main_module() const { return find_by_name(std::string_view()); }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "Platform.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace JMP
+{
+// A snapshot of every module (executable and shared object) loaded into this process, built from dl_iterate_phdr.
+// Lookups never touch the loader or the filesystem, only refresh() does.
+class ModuleTable
+{
+public:
+    struct Segment
+    {
+        uintptr_t start{};
+        size_t size{};
+        Platform::MemoryProtection protection;
+
+        uintptr_t end() const { return start + size; }
+        std::span<uint8_t> bytes() const { return {reinterpret_cast<uint8_t*>(start), size}; }
+    };
+
+    struct Module
+    {
+        std::string path;
+        // The filename part of the path, which is what you'd usually pass to dlopen. Empty for the main executable.
+        std::string name;
+        // What the loader added to every virtual address in the ELF, not necessarily where the first segment is.
+        uintptr_t base{};
+        // Covers every loadable segment, including whatever gaps are between them.
+        uintptr_t start{};
+        uintptr_t end{};
+        std::vector<Segment> segments;
+        std::vector<uint8_t> build_id;
+        // Where the dynamic section is, or 0 for a module without one.
+        uintptr_t dynamic{};
+
+        bool contains(uintptr_t address) const { return address >= start && address < end; }
+        std::span<uint8_t> bytes() const { return {reinterpret_cast<uint8_t*>(start), end - start}; }
+    };
+
+    ModuleTable() { refresh(); }
+
+    // Picks up modules loaded or unloaded since the last refresh, only inspecting the ones that are new. Returns
+    // whether anything changed, which is cheap to find out if nothing did.
+    bool refresh();
+    // Whether a module was unloaded since the last refresh, so what we have could be of memory that's gone. Only asks
+    // the loader for its counters.
+    bool has_unloaded_modules() const;
+
+    // By full path, or by filename. nullptr finds the main executable, like dlopen does.
+    const Module* find_by_name(const char* name) const;
+    const Module* find_by_name(std::string_view name) const;
+    const Module* find_by_address(uintptr_t address) const;
+    const Module* find_by_address(const void* address) const
+    {
+        return find_by_address(reinterpret_cast<uintptr_t>(address));
+    }
+
+    const Module* main_module() const;
+    const std::vector<Module>& modules() const { return m_modules; }
+
+private:
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+    };
+
+    void rebuild_indices();
+
+    std::vector<Module> m_modules;
+    std::unordered_map<std::string, size_t, StringHash, std::equal_to<>> m_indices_by_name;
+    // Module indices sorted by start address.
+    std::vector<size_t> m_indices_by_address;
+
+    unsigned long long m_adds{};
+    unsigned long long m_subs{};
+};
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "NarrowingScan.h"
+#include "LargeAllocator.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+#include <unistd.h>
+
+namespace JMP
+{
+namespace
+{
+constexpr size_t block_size = 64;
+
+// The unsigned integer the same size as T, to compare bits and to do arithmetic that wraps.
+template<typename T>
+using Bits = std::conditional_t<
+    sizeof(T) == 1, uint8_t,
+    std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+
+template<typename T>
+T load(const uint8_t* bytes)
+{
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+template<typename T>
+T decode(uint64_t bits)
+{
+    return std::bit_cast<T>(static_cast<Bits<T>>(bits));
+}
+
+// Where the candidates that survived a pass go, before we know how best to store them.
+template<typename T>
+struct Survivors
+{
+    std::vector<uint32_t, LargeAllocator<uint32_t>> positions;
+    std::vector<T, LargeAllocator<T>> values;
+    size_t count{};
+};
+
+// A run's old values are contiguous, as are the values in memory, so each block compares with SIMD. Only blocks that
+// had a survivor look at each result.
+template<typename T, size_t Stride, typename Compare>
+void narrow_run(const uint8_t* memory, const uint8_t* old_values, uint32_t start, uint32_t length, Compare compare,
+                Survivors<T>& survivors)
+{
+    uint32_t i{};
+    uint8_t hits[block_size];
+    T current[block_size];
+
+    for (; i + block_size <= length; i += block_size)
+    {
+        for (size_t j = 0; j < block_size; j++)
+        {
+            current[j] = load<T>(memory + (i + j) * Stride);
+            hits[j] = compare(load<T>(old_values + (i + j) * sizeof(T)), current[j]);
+        }
+
+        uint64_t any{};
+        for (size_t j = 0; j < block_size; j += sizeof(uint64_t))
+            any |= load<uint64_t>(hits + j);
+
+        if (!any)
+            continue;
+
+        for (size_t j = 0; j < block_size; j++)
+        {
+            survivors.positions[survivors.count] = start + i + static_cast<uint32_t>(j);
+            survivors.values[survivors.count] = current[j];
+            survivors.count += hits[j];
+        }
+    }
+
+    for (; i < length; i++)
+    {
+        auto value = load<T>(memory + i * Stride);
+        if (compare(load<T>(old_values + i * sizeof(T)), value))
+        {
+            survivors.positions[survivors.count] = start + i;
+            survivors.values[survivors.count] = value;
+            survivors.count++;
+        }
+    }
+}
+}
+
+NarrowingScan::NarrowingScan(ValueScan::Type type, std::span<const std::span<const uint8_t>> ranges, bool aligned)
+    : m_type(type)
+    , m_value_size(ValueScan::size_of(type))
+    , m_stride(aligned ? m_value_size : 1)
+{
+    snapshot(ranges);
+}
+
+NarrowingScan::NarrowingScan(ValueScan::Type type, const MemoryMap& memory_map, const MemoryMap::Filter& filter,
+                             bool aligned)
+    : m_type(type)
+    , m_value_size(ValueScan::size_of(type))
+    , m_stride(aligned ? m_value_size : 1)
+    , m_check_mapped(true)
+{
+    if (memory_map.pid() != 0 && memory_map.pid() != getpid())
+        throw std::invalid_argument("Memory map must be of this process");
+
+    std::vector<std::span<const uint8_t>> ranges;
+    memory_map.for_each_matching(filter, [&](const MemoryMap::Region& region) { ranges.push_back(region.bytes()); });
+
+    snapshot(ranges);
+}
+
+void NarrowingScan::snapshot(std::span<const std::span<const uint8_t>> ranges)
+{
+    // The positions of a range, which start at first and end before end.
+    auto bounds = [&](std::span<const uint8_t> range) {
+        auto start = reinterpret_cast<uintptr_t>(range.data());
+        auto first = (start + m_stride - 1) & ~(m_stride - 1);
+        // Positions past this would read beyond the range.
+        auto end = start + range.size() - m_value_size + 1;
+        return std::pair{first, std::max(first, end)};
+    };
+
+    // Growing the segments would free their old storage while we're copying the heap, so they're reserved up front.
+    size_t segment_count{};
+    for (auto range : ranges)
+    {
+        if (range.size() < m_value_size)
+            continue;
+
+        auto [first, end] = bounds(range);
+        segment_count += (end - first + ValueScan::chunk_size - 1) / ValueScan::chunk_size;
+    }
+
+    m_segments.reserve(m_segments.size() + segment_count);
+
+    for (auto range : ranges)
+    {
+        if (range.size() < m_value_size)
+            continue;
+
+        auto [first, end] = bounds(range);
+        for (auto position = first; position < end; position += ValueScan::chunk_size)
+        {
+            auto size = std::min<size_t>(end - position, ValueScan::chunk_size);
+            auto count = static_cast<uint32_t>((size + m_stride - 1) / m_stride);
+
+            Segment segment;
+            segment.base = position;
+            segment.position_count = count;
+            segment.has_runs = true;
+            segment.runs.push_back({0, count});
+            segment.values.resize(count * m_value_size);
+
+            auto* bytes = reinterpret_cast<const uint8_t*>(position);
+            if (m_stride == m_value_size)
+                memcpy(segment.values.data(), bytes, segment.values.size());
+            else
+            {
+                for (size_t i = 0; i < count; i++)
+                    memcpy(segment.values.data() + i * m_value_size, bytes + i, m_value_size);
+            }
+
+            m_candidate_count += count;
+            m_segments.push_back(std::move(segment));
+        }
+    }
+}
+
+size_t NarrowingScan::memory_usage() const
+{
+    auto usage = m_segments.capacity() * sizeof(Segment);
+    for (auto& segment : m_segments)
+    {
+        usage += segment.runs.capacity() * sizeof(Run) + segment.positions.capacity() * sizeof(uint32_t) +
+                 segment.values.capacity();
+    }
+
+    return usage;
+}
+
+std::vector<NarrowingScan::Segment> NarrowingScan::forget_unmapped_segments()
+{
+    m_memory_map.refresh();
+
+    // A segment can span more than one region, if part of what was one region has since had its protection changed.
+    auto is_mapped = [&](const Segment& segment) {
+        auto end = segment.base + (segment.position_count - 1) * m_stride + m_value_size;
+
+        for (auto address = segment.base; address < end;)
+        {
+            auto* region = m_memory_map.find(address);
+            if (!region || !region->protection.read)
+                return false;
+
+            address = region->end;
+        }
+
+        return true;
+    };
+
+    // Moved out rather than erased, as freeing them now could trim the heap the segments we keep still cover.
+    std::vector<Segment> forgotten;
+    forgotten.reserve(m_segments.size());
+
+    size_t kept{};
+    for (size_t i = 0; i < m_segments.size(); i++)
+    {
+        if (!is_mapped(m_segments[i]))
+            forgotten.push_back(std::move(m_segments[i]));
+        else if (kept++ != i)
+            m_segments[kept - 1] = std::move(m_segments[i]);
+    }
+
+    // Only what was moved from is left past kept, which has nothing to free.
+    m_segments.erase(m_segments.begin() + kept, m_segments.end());
+    return forgotten;
+}
+
+template<typename T, size_t Stride, typename Compare>
+void NarrowingScan::narrow_with(Compare compare)
+{
+    uint32_t largest_segment{};
+    for (auto& segment : m_segments)
+        largest_segment = std::max(largest_segment, segment.position_count);
+
+    Survivors<T> survivors;
+    survivors.positions.resize(largest_segment);
+    survivors.values.resize(largest_segment);
+
+    // The old segments are only freed once we're done, for the same reason as ValueScan's buffers.
+    std::vector<Segment> narrowed;
+    narrowed.reserve(m_segments.size());
+    size_t candidate_count{};
+
+    for (auto& segment : m_segments)
+    {
+        auto* memory = reinterpret_cast<const uint8_t*>(segment.base);
+        survivors.count = 0;
+
+        if (segment.has_runs)
+        {
+            auto* old_values = segment.values.data();
+            for (auto& run : segment.runs)
+            {
+                narrow_run<T, Stride>(memory + run.start * Stride, old_values, run.start, run.length, compare, survivors);
+                old_values += run.length * sizeof(T);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < segment.positions.size(); i++)
+            {
+                auto position = segment.positions[i];
+                auto value = load<T>(memory + position * Stride);
+
+                survivors.positions[survivors.count] = position;
+                survivors.values[survivors.count] = value;
+                survivors.count += compare(load<T>(segment.values.data() + i * sizeof(T)), value);
+            }
+        }
+
+        if (!survivors.count)
+            continue;
+
+        // When everything survived only the values changed, and we can keep the rest of the segment as it is.
+        if (survivors.count * sizeof(T) == segment.values.size())
+        {
+            memcpy(segment.values.data(), survivors.values.data(), segment.values.size());
+            candidate_count += survivors.count;
+            narrowed.push_back(std::move(segment));
+            continue;
+        }
+
+        Segment next;
+        next.base = segment.base;
+        next.position_count = segment.position_count;
+
+        size_t run_count = 1;
+        for (size_t i = 1; i < survivors.count; i++)
+            run_count += survivors.positions[i] != survivors.positions[i - 1] + 1;
+
+        // Whichever is smaller: a run for each group of consecutive survivors, or a position for each survivor.
+        next.has_runs = run_count * sizeof(Run) <= survivors.count * sizeof(uint32_t);
+        if (next.has_runs)
+        {
+            next.runs.reserve(run_count);
+            for (size_t i = 0; i < survivors.count; i++)
+            {
+                if (i && survivors.positions[i] == survivors.positions[i - 1] + 1)
+                    next.runs.back().length++;
+                else
+                    next.runs.push_back({survivors.positions[i], 1});
+            }
+        }
+        else
+            next.positions.assign(survivors.positions.begin(), survivors.positions.begin() + survivors.count);
+
+        next.values.resize(survivors.count * sizeof(T));
+        memcpy(next.values.data(), survivors.values.data(), next.values.size());
+
+        candidate_count += survivors.count;
+        narrowed.push_back(std::move(next));
+    }
+
+    m_segments = std::move(narrowed);
+    m_candidate_count = candidate_count;
+}
+
+template<typename T>
+void NarrowingScan::narrow_as(Condition condition, uint64_t first, uint64_t second)
+{
+    auto with = [this](auto compare) {
+        if (m_stride == sizeof(T))
+            narrow_with<T, sizeof(T)>(compare);
+        else
+            narrow_with<T, 1>(compare);
+    };
+
+    auto bits = [](T value) { return std::bit_cast<Bits<T>>(value); };
+    auto minimum = decode<T>(first);
+    auto maximum = decode<T>(second);
+
+    switch (condition)
+    {
+        case Condition::Changed:
+            with([bits](T old_value, T value) -> uint8_t { return bits(value) != bits(old_value); });
+            break;
+        case Condition::Unchanged:
+            with([bits](T old_value, T value) -> uint8_t { return bits(value) == bits(old_value); });
+            break;
+        case Condition::Increased:
+            with([](T old_value, T value) -> uint8_t { return value > old_value; });
+            break;
+        case Condition::Decreased:
+            with([](T old_value, T value) -> uint8_t { return value < old_value; });
+            break;
+        case Condition::IncreasedBy:
+            if constexpr (std::is_floating_point_v<T>)
+                with([minimum](T old_value, T value) -> uint8_t { return value == old_value + minimum; });
+            else
+            {
+                with([bits, minimum](T old_value, T value) -> uint8_t {
+                    return bits(value) == static_cast<Bits<T>>(bits(old_value) + bits(minimum));
+                });
+            }
+            break;
+        case Condition::DecreasedBy:
+            if constexpr (std::is_floating_point_v<T>)
+                with([minimum](T old_value, T value) -> uint8_t { return value == old_value - minimum; });
+            else
+            {
+                with([bits, minimum](T old_value, T value) -> uint8_t {
+                    return bits(value) == static_cast<Bits<T>>(bits(old_value) - bits(minimum));
+                });
+            }
+            break;
+        case Condition::Between:
+            with([minimum, maximum](T, T value) -> uint8_t { return (value >= minimum) & (value <= maximum); });
+            break;
+    }
+}
+
+void NarrowingScan::narrow(Condition condition, uint64_t first, uint64_t second)
+{
+    // Only freed once the pass is over.
+    std::vector<Segment> forgotten;
+    if (m_check_mapped)
+        forgotten = forget_unmapped_segments();
+
+    switch (m_type)
+    {
+        case ValueScan::Type::U8:
+            return narrow_as<uint8_t>(condition, first, second);
+        case ValueScan::Type::U16:
+            return narrow_as<uint16_t>(condition, first, second);
+        case ValueScan::Type::U32:
+            return narrow_as<uint32_t>(condition, first, second);
+        case ValueScan::Type::U64:
+            return narrow_as<uint64_t>(condition, first, second);
+        case ValueScan::Type::I8:
+            return narrow_as<int8_t>(condition, first, second);
+        case ValueScan::Type::I16:
+            return narrow_as<int16_t>(condition, first, second);
+        case ValueScan::Type::I32:
+            return narrow_as<int32_t>(condition, first, second);
+        case ValueScan::Type::I64:
+            return narrow_as<int64_t>(condition, first, second);
+        case ValueScan::Type::F32:
+            return narrow_as<float>(condition, first, second);
+        case ValueScan::Type::F64:
+            return narrow_as<double>(condition, first, second);
+    }
+}
+
+void NarrowingScan::keep_changed() { narrow(Condition::Changed, 0, 0); }
+void NarrowingScan::keep_unchanged() { narrow(Condition::Unchanged, 0, 0); }
+void NarrowingScan::keep_increased() { narrow(Condition::Increased, 0, 0); }
+void NarrowingScan::keep_decreased() { narrow(Condition::Decreased, 0, 0); }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "MemoryMap.h"
+#include "ValueScan.h"
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace JMP
+{
+// A search for a value we don't know, only how it changes: snapshot every value, then repeatedly keep the ones that
+// (for example) increased since the last pass, until few enough are left to look at.
+//
+//     NarrowingScan scan(ValueScan::Type::I32, MemoryMap::self());
+//     // ... take some damage
+//     scan.keep_decreased();
+//     // ... heal by 10
+//     scan.keep_increased_by<int32_t>(10);
+//
+// Candidates are kept per chunk of memory, either as runs of consecutive values or as a list of single ones (whichever
+// is smaller), along with only their values from the last pass. So memory use shrinks with the number of candidates,
+// although the first snapshot is still a copy of everything. Each run's values are compared against memory in blocks,
+// which vectorizes like ValueScan does.
+class NarrowingScan
+{
+public:
+    // The values must stay mapped between passes. When they came from a memory map, we check that they still are on
+    // each pass, and forget the ones that aren't.
+    NarrowingScan(ValueScan::Type, std::span<const std::span<const uint8_t>> ranges, bool aligned = true);
+    // The memory map must be of our own process.
+    NarrowingScan(ValueScan::Type, const MemoryMap&, const MemoryMap::Filter& = {{true, true, false}, {}},
+                  bool aligned = true);
+
+    // Changed and unchanged compare the bits, so a float that's still NaN is unchanged.
+    void keep_changed();
+    void keep_unchanged();
+    void keep_increased();
+    void keep_decreased();
+
+    // Integers wrap around, and floats have to be exactly that much more (or less).
+    template<typename T>
+    void keep_increased_by(T delta)
+    {
+        narrow(check_type<T>(Condition::IncreasedBy), ValueScan::encode(delta), 0);
+    }
+
+    template<typename T>
+    void keep_decreased_by(T delta)
+    {
+        narrow(check_type<T>(Condition::DecreasedBy), ValueScan::encode(delta), 0);
+    }
+
+    // Both ends are included.
+    template<typename T>
+    void keep_between(T minimum, T maximum)
+    {
+        narrow(check_type<T>(Condition::Between), ValueScan::encode(minimum), ValueScan::encode(maximum));
+    }
+
+    template<typename T>
+    void keep_equal_to(T value)
+    {
+        keep_between(value, value);
+    }
+
+    ValueScan::Type type() const { return m_type; }
+    size_t candidate_count() const { return m_candidate_count; }
+    // Bytes used to keep track of candidates and their values.
+    size_t memory_usage() const;
+
+    // Calls back with the address of every candidate, and its value as of the last pass.
+    template<typename Callback>
+    void for_each(Callback callback) const
+    {
+        for (auto& segment : m_segments)
+        {
+            auto* value = segment.values.data();
+            auto visit = [&](uint32_t position) {
+                callback(segment.base + position * m_stride, value);
+                value += m_value_size;
+            };
+
+            if (segment.has_runs)
+            {
+                for (auto& run : segment.runs)
+                {
+                    for (auto position = run.start; position < run.start + run.length; position++)
+                        visit(position);
+                }
+            }
+            else
+            {
+                for (auto position : segment.positions)
+                    visit(position);
+            }
+        }
+    }
+
+private:
+    enum class Condition : uint8_t
+    {
+        Changed,
+        Unchanged,
+        Increased,
+        Decreased,
+        IncreasedBy,
+        DecreasedBy,
+        Between
+    };
+
+    // Consecutive candidates, as positions (one per value we could look at) from the start of a segment.
+    struct Run
+    {
+        uint32_t start{};
+        uint32_t length{};
+    };
+
+    // At most ValueScan::chunk_size of memory, so a position always fits in 32 bits.
+    struct Segment
+    {
+        uintptr_t base{};
+        // Every position there is, not how many are candidates.
+        uint32_t position_count{};
+        bool has_runs{};
+        std::vector<Run> runs;
+        std::vector<uint32_t> positions;
+        // The value of each candidate, in order.
+        std::vector<uint8_t> values;
+    };
+
+    template<typename T>
+    Condition check_type(Condition condition) const
+    {
+        if (ValueScan::type_of<T>() != m_type)
+            throw std::invalid_argument("Value type doesn't match the scan's");
+
+        return condition;
+    }
+
+    void snapshot(std::span<const std::span<const uint8_t>> ranges);
+    void narrow(Condition, uint64_t first, uint64_t second);
+    template<typename T>
+    void narrow_as(Condition, uint64_t first, uint64_t second);
+    template<typename T, size_t Stride, typename Compare>
+    void narrow_with(Compare);
+    // Returns what it forgot, for the caller to free once its pass is done.
+    std::vector<Segment> forget_unmapped_segments();
+
+    ValueScan::Type m_type{};
+    size_t m_value_size{};
+    size_t m_stride{};
+    std::vector<Segment> m_segments;
+    size_t m_candidate_count{};
+
+    // Only when we were given a memory map, to check against on each pass.
+    bool m_check_mapped{};
+    MemoryMap m_memory_map;
+};
+}
@@ -6,7 +6,10 @@
 
 #pragma once
 
+#include <bit>
 #include <cinttypes>
+#include <expected>
+#include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
@@ -21,12 +24,80 @@ struct MemoryProtection
     bool read{};
     bool write{};
     bool execute{};
+
+    bool operator==(const MemoryProtection&) const = default;
 };
 
+// One range of this process to copy, which doesn't have to be mapped (or readable).
+struct MemoryRead
+{
+    uintptr_t address{};
+    std::span<uint8_t> bytes;
+    // Set by read_memory.
+    bool succeeded{};
+};
+
+// Memory for large scratch buffers and snapshots, straight from the kernel, and zeroed.
+struct LargeAllocation
+{
+    enum class Pages : uint8_t
+    {
+        Normal,
+        // Asked for, but it's up to the kernel to actually use them, and it may take a while.
+        TransparentHuge,
+        Huge
+    };
+
+    std::span<uint8_t> bytes;
+    // What we actually got, which can be less than we asked for: huge pages have to be reserved ahead of time, and
+    // transparent ones can be turned off.
+    Pages pages{};
+    // Whether pages prefer the NUMA node of the thread that allocated it, over the node of whichever thread first
+    // touches them.
+    bool node_local{};
+};
+
+struct LargeAllocationPolicy
+{
+    bool huge_pages{true};
+    bool node_local{};
+};
+
+size_t page_size();
+// The size of a huge page, or what it would be if the system had them.
+size_t huge_page_size();
+// Sizes of at least a huge page are rounded up to a multiple of one (so huge pages can be used), smaller ones to a
+// multiple of a page, and are never backed by huge pages.
+LargeAllocation allocate_large(size_t size, const LargeAllocationPolicy& = {});
+// Takes the bytes of an allocation, or the same address with the size that was asked for.
+void free_large(std::span<uint8_t> bytes);
+
 std::span<uint8_t> get_bytes_for_library_name(const char* library_name);
 void modify_memory_protection(std::span<uint8_t> memory_region, MemoryProtection);
 std::string convert_error_to_string(Error);
 
+// The same as above, but returning the error instead of throwing, for loops where failing is normal (like probing
+// regions that might not be mapped) and unwinding would cost more than the syscall did.
+std::expected<std::span<uint8_t>, Error> try_get_bytes_for_library_name(const char* library_name);
+std::expected<void, Error> try_modify_memory_protection(std::span<uint8_t> memory_region, MemoryProtection);
+
+// Reads memory of this process that may not be there, without faulting (so no signal handlers are involved). Reads that
+// can't be done are marked as failed, and their bytes may have been partly written, up to where the memory stopped
+// being readable. The kernel does the copying, so a batch costs a syscall for every thousand or so reads, plus one for
+// each read that fails. Returns how many were read.
+size_t read_memory(std::span<MemoryRead> reads);
+bool read_memory(uintptr_t address, std::span<uint8_t> bytes);
+
+template<typename T>
+std::optional<T> read_memory(uintptr_t address)
+{
+    uint8_t bytes[sizeof(T)];
+    if (!read_memory(address, bytes))
+        return {};
+
+    return std::bit_cast<T>(bytes);
+}
+
 class PlatformException : public std::runtime_error
 {
 public:
@@ -5,35 +5,216 @@
  */
 
 #include "../Platform.h"
+#include "../ModuleTable.h"
+#include "../ScopeGuard.h"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <dlfcn.h>
 #include <link.h>
+#include <mutex>
+#include <shared_mutex>
 #include <sys/mman.h>
-#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace JMP::Platform
 {
-std::span<uint8_t> get_bytes_for_library_name(const char* library_name)
+size_t page_size()
+{
+    static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+namespace
+{
+// What's in a small sysfs file, or nothing if we can't read it.
+std::string read_setting(const char* path)
+{
+    auto* file = fopen(path, "re");
+    if (!file)
+        return {};
+
+    char buffer[256];
+    auto size = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+
+    return {buffer, size};
+}
+
+// Only if it's set to never does madvise quietly do nothing.
+bool are_transparent_huge_pages_enabled()
+{
+    static const auto enabled = [] {
+        auto setting = read_setting("/sys/kernel/mm/transparent_hugepage/enabled");
+        return !setting.empty() && setting.find("[never]") == std::string::npos;
+    }();
+
+    return enabled;
+}
+
+// Prefers (rather than insists on, which would rather fail than use another node) the node we're running on. There's
+// no wrapper for mbind without libnuma, so we make the syscalls ourselves.
+bool prefer_local_node(std::span<uint8_t> bytes)
+{
+    constexpr int preferred_policy = 1; // MPOL_PREFERRED
+    constexpr size_t max_nodes = 1024;
+
+    unsigned cpu{};
+    unsigned node{};
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == -1 || node >= max_nodes)
+        return false;
+
+    unsigned long nodes[max_nodes / (sizeof(unsigned long) * CHAR_BIT)]{};
+    nodes[node / (sizeof(unsigned long) * CHAR_BIT)] = 1ul << (node % (sizeof(unsigned long) * CHAR_BIT));
+
+    // The kernel counts one less node than we say, and has done for long enough that it's never going to change.
+    return syscall(SYS_mbind, bytes.data(), bytes.size(), preferred_policy, nodes, max_nodes + 1, 0) == 0;
+}
+}
+
+size_t huge_page_size()
+{
+    static const auto huge_page_size = [] {
+        auto setting = read_setting("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+        auto size = strtoull(setting.c_str(), nullptr, 10);
+        return size ? static_cast<size_t>(size) : size_t{2 * 1024 * 1024};
+    }();
+
+    return huge_page_size;
+}
+
+LargeAllocation allocate_large(size_t size, const LargeAllocationPolicy& policy)
+{
+    if (size == 0)
+        throw std::invalid_argument("Allocation is empty");
+
+    auto huge = size >= huge_page_size();
+    auto alignment = huge ? huge_page_size() : page_size();
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    LargeAllocation allocation;
+    void* address = MAP_FAILED;
+
+    // Most systems don't reserve any, so this usually fails, and we ask for transparent ones instead.
+    if (huge && policy.huge_pages)
+    {
+        auto size_flag = std::countr_zero(huge_page_size()) << MAP_HUGE_SHIFT;
+        address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag, -1,
+                       0);
+        if (address != MAP_FAILED)
+            allocation.pages = LargeAllocation::Pages::Huge;
+    }
+
+    if (address == MAP_FAILED)
+    {
+        // Transparent huge pages only back whole huge pages that are aligned, so we map an extra one and trim what's
+        // before and after the aligned part.
+        auto mapped_size = huge ? size + alignment : size;
+        auto* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw PlatformException(errno);
+
+        auto start = reinterpret_cast<uintptr_t>(mapped);
+        auto aligned = (start + alignment - 1) & ~(alignment - 1);
+        if (aligned != start)
+            munmap(mapped, aligned - start);
+
+        if (auto end = start + mapped_size; end != aligned + size)
+            munmap(reinterpret_cast<void*>(aligned + size), end - aligned - size);
+
+        address = reinterpret_cast<void*>(aligned);
+
+        if (huge && policy.huge_pages && are_transparent_huge_pages_enabled() &&
+            madvise(address, size, MADV_HUGEPAGE) == 0)
+            allocation.pages = LargeAllocation::Pages::TransparentHuge;
+    }
+
+    allocation.bytes = {static_cast<uint8_t*>(address), size};
+
+    // Nothing is touched yet, so every page is still to be placed.
+    if (policy.node_local)
+        allocation.node_local = prefer_local_node(allocation.bytes);
+
+    return allocation;
+}
+
+void free_large(std::span<uint8_t> bytes)
+{
+    auto alignment = bytes.size() >= huge_page_size() ? huge_page_size() : page_size();
+    munmap(bytes.data(), (bytes.size() + alignment - 1) & ~(alignment - 1));
+}
+
+namespace
+{
+// Returns why we couldn't find it, if we couldn't.
+std::expected<std::span<uint8_t>, const char*> find_library(const char* library_name)
 {
-    // dlopen actually returns a link_map*
-    auto* dynamic_library = static_cast<link_map*>(dlopen(library_name, RTLD_NOW));
+    // Looking up a module we already know about shouldn't have to inspect every module again, or touch the
+    // filesystem. We only trust what we know if nothing has been unloaded since, though.
+    static ModuleTable module_table;
+    static std::shared_mutex module_table_mutex;
+
+    {
+        std::shared_lock lock(module_table_mutex);
+        if (!module_table.has_unloaded_modules())
+        {
+            if (auto* module = module_table.find_by_name(library_name))
+                return module->bytes();
+        }
+    }
+
+    std::unique_lock lock(module_table_mutex);
+    module_table.refresh();
+
+    if (auto* module = module_table.find_by_name(library_name))
+        return module->bytes();
+
+    // The name might not be the filename, like a symlink (or anything else that dlopen would still find) would be.
+    // Ask the loader, without loading it if it's not already loaded.
+    auto* dynamic_library = static_cast<link_map*>(dlopen(library_name, RTLD_NOW | RTLD_NOLOAD));
     if (!dynamic_library)
-        throw PlatformException(std::string(dlerror()));
+        return std::unexpected("Library is not loaded: ");
 
-    // We have the base address of the library, but we need the size. stat-ing the l_name for the size should be fine.
-    // If we pass nullptr to dlopen, it gives us ourselves. However, that doesn't give us a path that we can stat.
-    // We can use "/proc/self/exe", which is just a symlink to the executable. Really nifty!
+    ScopeGuard close_dynamic_library{[dynamic_library] { dlclose(dynamic_library); }};
 
-    const char* path_to_binary = library_name ? dynamic_library->l_name : "/proc/self/exe";
-    struct stat dynamic_library_stat = {};
-    if (stat(path_to_binary, &dynamic_library_stat) == -1)
-        throw PlatformException(errno);
+    if (auto* module = module_table.find_by_address(dynamic_library->l_ld))
+        return module->bytes();
 
-    dlclose(dynamic_library);
+    return std::unexpected("Library is not in the module table: ");
+}
+}
 
-    return {reinterpret_cast<uint8_t*>(dynamic_library->l_addr), static_cast<size_t>(dynamic_library_stat.st_size)};
+std::span<uint8_t> get_bytes_for_library_name(const char* library_name)
+{
+    auto bytes = find_library(library_name);
+    if (!bytes)
+        throw PlatformException(bytes.error() + std::string(library_name));
+
+    return *bytes;
+}
+
+std::expected<std::span<uint8_t>, Error> try_get_bytes_for_library_name(const char* library_name)
+{
+    if (auto bytes = find_library(library_name))
+        return *bytes;
+
+    return std::unexpected(ENOENT);
 }
 
 void modify_memory_protection(std::span<uint8_t> memory_region, MemoryProtection memory_protection)
+{
+    if (auto result = try_modify_memory_protection(memory_region, memory_protection); !result)
+        throw PlatformException(result.error());
+}
+
+std::expected<void, Error> try_modify_memory_protection(std::span<uint8_t> memory_region,
+                                                        MemoryProtection memory_protection)
 {
     int platform_protection{};
 
@@ -47,7 +228,82 @@ void modify_memory_protection(std::span<uint8_t> memory_region, MemoryProtection
         platform_protection |= PROT_EXEC;
 
     if (mprotect(memory_region.data(), memory_region.size(), platform_protection) == -1)
-        throw PlatformException(errno);
+        return std::unexpected(errno);
+
+    return {};
+}
+
+size_t read_memory(std::span<MemoryRead> reads)
+{
+    // Checking our regions first wouldn't be enough, as another thread could unmap anything between the check and the
+    // copy. process_vm_readv on ourselves does both at once, and fails instead of faulting.
+    auto pid = getpid();
+    size_t number_read{};
+
+    iovec local[IOV_MAX];
+    iovec remote[IOV_MAX];
+    uint16_t read_indices[IOV_MAX];
+
+    for (size_t chunk = 0; chunk < reads.size(); chunk += IOV_MAX)
+    {
+        auto chunk_reads = reads.subspan(chunk, std::min<size_t>(reads.size() - chunk, IOV_MAX));
+        size_t count{};
+
+        for (size_t i = 0; i < chunk_reads.size(); i++)
+        {
+            auto& read = chunk_reads[i];
+            read.succeeded = read.bytes.empty();
+            number_read += read.succeeded;
+
+            // Nothing is ever mapped in the first page, which is where following a null pointer (plus an offset) ends
+            // up, so we don't need a syscall to tell that it fails.
+            if (read.bytes.empty() || read.address < page_size() || read.address + read.bytes.size() < read.address)
+                continue;
+
+            local[count] = {read.bytes.data(), read.bytes.size()};
+            remote[count] = {reinterpret_cast<void*>(read.address), read.bytes.size()};
+            read_indices[count] = static_cast<uint16_t>(i);
+            count++;
+        }
+
+        size_t index{};
+        while (index < count)
+        {
+            auto result = process_vm_readv(pid, local + index, count - index, remote + index, count - index, 0);
+            if (result == -1)
+            {
+                // The first one is not readable, skip past it and try again with the rest.
+                if (errno == EFAULT || errno == ENOMEM)
+                {
+                    index++;
+                    continue;
+                }
+
+                throw PlatformException(errno);
+            }
+
+            auto transferred = static_cast<size_t>(result);
+            while (index < count && transferred >= remote[index].iov_len)
+            {
+                transferred -= remote[index].iov_len;
+                chunk_reads[read_indices[index]].succeeded = true;
+                number_read++;
+                index++;
+            }
+
+            // A short read stops at the first one that failed, which may have been partly copied before it did.
+            if (index < count)
+                index++;
+        }
+    }
+
+    return number_read;
+}
+
+bool read_memory(uintptr_t address, std::span<uint8_t> bytes)
+{
+    MemoryRead read{address, bytes};
+    return read_memory(std::span(&read, 1)) == 1;
 }
 
 std::string convert_error_to_string(Error value) { return strerror(value); }
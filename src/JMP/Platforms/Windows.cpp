@@ -13,20 +13,108 @@
 
 namespace JMP::Platform
 {
+size_t page_size()
+{
+    static const auto page_size = [] {
+        SYSTEM_INFO system_info{};
+        GetSystemInfo(&system_info);
+        return static_cast<size_t>(system_info.dwPageSize);
+    }();
+
+    return page_size;
+}
+
+size_t huge_page_size()
+{
+    static const auto huge_page_size = [] {
+        auto size = GetLargePageMinimum();
+        return size ? static_cast<size_t>(size) : size_t{2 * 1024 * 1024};
+    }();
+
+    return huge_page_size;
+}
+
+LargeAllocation allocate_large(size_t size, const LargeAllocationPolicy& policy)
+{
+    if (size == 0)
+        throw std::invalid_argument("Allocation is empty");
+
+    auto huge = size >= huge_page_size();
+    auto alignment = huge ? huge_page_size() : page_size();
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    // The node is only a preference, the same as on Linux.
+    auto node = static_cast<DWORD>(NUMA_NO_PREFERRED_NODE);
+    if (policy.node_local)
+    {
+        PROCESSOR_NUMBER processor{};
+        GetCurrentProcessorNumberEx(&processor);
+
+        USHORT current_node{};
+        if (GetNumaProcessorNodeEx(&processor, &current_node))
+            node = current_node;
+    }
+
+    auto allocate = [&](DWORD type) {
+        return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, type, PAGE_READWRITE, node);
+    };
+
+    LargeAllocation allocation;
+    void* address{};
+
+    // Large pages need the "Lock pages in memory" privilege, which hardly anyone has. There's nothing like
+    // transparent huge pages to fall back to.
+    if (huge && policy.huge_pages)
+    {
+        address = allocate(MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES);
+        if (address)
+            allocation.pages = LargeAllocation::Pages::Huge;
+    }
+
+    if (!address)
+        address = allocate(MEM_RESERVE | MEM_COMMIT);
+
+    if (!address)
+        throw PlatformException(static_cast<Error>(GetLastError()));
+
+    allocation.bytes = {static_cast<uint8_t*>(address), size};
+    allocation.node_local = node != NUMA_NO_PREFERRED_NODE;
+    return allocation;
+}
+
+void free_large(std::span<uint8_t> bytes) { VirtualFree(bytes.data(), 0, MEM_RELEASE); }
+
 std::span<uint8_t> get_bytes_for_library_name(const char* library_name)
+{
+    auto bytes = try_get_bytes_for_library_name(library_name);
+    if (!bytes)
+        throw PlatformException(bytes.error());
+
+    return *bytes;
+}
+
+std::expected<std::span<uint8_t>, Error> try_get_bytes_for_library_name(const char* library_name)
 {
     auto module = GetModuleHandleA(library_name);
     if (!module)
-        throw PlatformException(GetLastError());
+        return std::unexpected(static_cast<Error>(GetLastError()));
 
     MODULEINFO module_info{};
     if (!GetModuleInformation(GetCurrentProcess(), module, &module_info, sizeof(module_info)))
-        throw PlatformException(GetLastError());
+        return std::unexpected(static_cast<Error>(GetLastError()));
 
-    return {reinterpret_cast<uint8_t*>(module_info.lpBaseOfDll), static_cast<size_t>(module_info.SizeOfImage)};
+    return std::span<uint8_t>{reinterpret_cast<uint8_t*>(module_info.lpBaseOfDll),
+                              static_cast<size_t>(module_info.SizeOfImage)};
 }
 
 void modify_memory_protection(std::span<uint8_t> memory_region, MemoryProtection memory_protection)
+{
+    if (auto result = try_modify_memory_protection(memory_region, memory_protection); !result)
+        throw PlatformException(result.error());
+}
+
+std::expected<void, Error> try_modify_memory_protection(std::span<uint8_t> memory_region,
+                                                        MemoryProtection memory_protection)
 {
     DWORD platform_protection{};
 
@@ -51,7 +139,34 @@ void modify_memory_protection(std::span<uint8_t> memory_region, MemoryProtection
     DWORD original_platform_protection{};
 
     if (!VirtualProtect(memory_region.data(), memory_region.size(), platform_protection, &original_platform_protection))
-        throw PlatformException(GetLastError());
+        return std::unexpected(static_cast<Error>(GetLastError()));
+
+    return {};
+}
+
+size_t read_memory(std::span<MemoryRead> reads)
+{
+    // ReadProcessMemory on ourselves fails instead of faulting, even if another thread unmaps the memory mid-copy.
+    // There's no batched version, so this is a syscall for every read.
+    size_t number_read{};
+
+    for (auto& read : reads)
+    {
+        SIZE_T transferred{};
+        read.succeeded = read.bytes.empty() ||
+                         (ReadProcessMemory(GetCurrentProcess(), reinterpret_cast<LPCVOID>(read.address),
+                                            read.bytes.data(), read.bytes.size(), &transferred) &&
+                          transferred == read.bytes.size());
+        number_read += read.succeeded;
+    }
+
+    return number_read;
+}
+
+bool read_memory(uintptr_t address, std::span<uint8_t> bytes)
+{
+    MemoryRead read{address, bytes};
+    return read_memory(std::span(&read, 1)) == 1;
 }
 
 // See: https://stackoverflow.com/questions/1387064
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "PointerMap.h"
+#include "Reader.h"
+#include "Threads.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace JMP
+{
+namespace
+{
+constexpr size_t chunk_size = 1024 * 1024;
+constexpr char magic[8] = {'J', 'M', 'P', 'P', 'T', 'R', 'S', '\0'};
+constexpr uint32_t version = 1;
+
+struct Range
+{
+    uintptr_t start{};
+    uintptr_t end{};
+};
+
+// Returns how many pointers it wrote to entries, which must have room for one per aligned value in the chunk.
+size_t scan_chunk(Range chunk, std::span<const Range> targets, PointerMap::Entry* entries)
+{
+    auto lowest = targets.front().start;
+    auto span = targets.back().end - lowest;
+    // Pointers tend to point near the last one, so we look there before searching.
+    auto* last = &targets.front();
+    size_t count{};
+
+    for (auto address = chunk.start; address + sizeof(uintptr_t) <= chunk.end; address += sizeof(uintptr_t))
+    {
+        auto value = *reinterpret_cast<const uintptr_t*>(address);
+        if (value - lowest >= span)
+            continue;
+
+        if (value < last->start || value >= last->end)
+        {
+            auto next = std::upper_bound(targets.begin(), targets.end(), value,
+                                         [](uintptr_t value, const Range& range) { return value < range.start; });
+            if (next == targets.begin() || value >= std::prev(next)->end)
+                continue;
+
+            last = &*std::prev(next);
+        }
+
+        entries[count++] = {value, address};
+    }
+
+    return count;
+}
+
+void write_bytes(Stream& stream, const void* bytes, size_t size)
+{
+    stream.write({static_cast<uint8_t*>(const_cast<void*>(bytes)), size});
+}
+
+template<typename T>
+void write_value(Stream& stream, T value)
+{
+    write_bytes(stream, &value, sizeof(T));
+}
+
+// Straight into values, as the entries can be gigabytes, and a copy would need twice that.
+template<typename T, typename Allocator>
+void read_array(Stream& stream, Reader& reader, std::vector<T, Allocator>& values)
+{
+    values.resize(reader.read<uint64_t>());
+    stream.read_into({reinterpret_cast<uint8_t*>(values.data()), values.size() * sizeof(T)});
+}
+}
+
+std::optional<uintptr_t> PointerPath::resolve(const ModuleTable& module_table) const
+{
+    auto* found = module_table.find_by_name(module.empty() ? nullptr : module.c_str());
+    if (!found)
+        return {};
+
+    auto address = found->start + module_offset;
+    for (auto offset : offsets)
+    {
+        auto pointer = Platform::read_memory<uintptr_t>(address);
+        if (!pointer)
+            return {};
+
+        address = *pointer + offset;
+    }
+
+    return address;
+}
+
+std::string PointerPath::to_string() const
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "+0x%" PRIxPTR, module_offset);
+
+    auto string = (module.empty() ? std::string("<main>") : module) + buffer;
+    for (auto offset : offsets)
+    {
+        snprintf(buffer, sizeof(buffer), " -> +0x%zx", offset);
+        string += buffer;
+    }
+
+    return string;
+}
+
+PointerMap PointerMap::build(const ModuleTable& module_table, const MemoryMap& memory_map, size_t thread_count)
+{
+    if (memory_map.pid() != 0 && memory_map.pid() != getpid())
+        throw std::invalid_argument("Memory map must be of this process");
+
+    PointerMap map;
+    for (auto& module : module_table.modules())
+    {
+        map.m_modules.push_back({module.name, module.start});
+        for (auto& segment : module.segments)
+        {
+            if (segment.protection.write)
+                map.m_static_ranges.push_back({segment.start, segment.end(), map.m_modules.size() - 1});
+        }
+    }
+
+    std::sort(map.m_static_ranges.begin(), map.m_static_ranges.end(),
+              [](const StaticRange& a, const StaticRange& b) { return a.start < b.start; });
+
+    // Where pointers can be, and what they can point to. Neighbouring regions are merged, as a pointer past the end of
+    // one is still into the next. The vvar pages can fault when read, even though they say they're readable.
+    std::vector<Range> ranges;
+    memory_map.for_each_matching({{true, false, false}, {}}, [&](const MemoryMap::Region& region) {
+        if (region.protection.execute || region.path.starts_with("[vvar"))
+            return;
+
+        if (!ranges.empty() && ranges.back().end == region.start)
+            ranges.back().end = region.end;
+        else
+            ranges.push_back({region.start, region.end});
+    });
+
+    if (ranges.empty())
+        return map;
+
+    std::vector<Range> chunks;
+    for (auto range : ranges)
+    {
+        auto first = (range.start + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+        for (auto start = first; start < range.end; start += chunk_size)
+            chunks.push_back({start, std::min(start + chunk_size, range.end)});
+    }
+
+    thread_count = resolve_thread_count(thread_count, chunks.size());
+
+    // Allocated up front, for the same reason as ValueScan's buffers.
+    std::vector<std::vector<Entry>> chunk_entries(chunks.size());
+    std::vector<std::vector<Entry, LargeAllocator<Entry>>> scratch(
+        thread_count, std::vector<Entry, LargeAllocator<Entry>>(chunk_size / sizeof(uintptr_t)));
+    auto by_value = [](const Entry& a, const Entry& b) { return a.value < b.value; };
+
+    for_each_on_threads(thread_count, chunks.size(), [&](size_t thread, size_t i) {
+        auto& entries = scratch[thread];
+        auto count = scan_chunk(chunks[i], ranges, entries.data());
+        std::sort(entries.begin(), entries.begin() + count, by_value);
+
+        if (count)
+            chunk_entries[i].assign(entries.begin(), entries.begin() + count);
+    });
+
+    size_t total{};
+    for (auto& entries : chunk_entries)
+        total += entries.size();
+
+    // Every chunk is already sorted, so merging them pairwise is linear in each of the log(chunks) rounds.
+    std::vector<size_t> bounds{0};
+    map.m_entries.reserve(total);
+    for (auto& entries : chunk_entries)
+    {
+        if (entries.empty())
+            continue;
+
+        map.m_entries.insert(map.m_entries.end(), entries.begin(), entries.end());
+        bounds.push_back(map.m_entries.size());
+    }
+
+    while (bounds.size() > 2)
+    {
+        std::vector<size_t> merged{0};
+        for (size_t i = 0; i + 2 < bounds.size(); i += 2)
+        {
+            std::inplace_merge(map.m_entries.begin() + bounds[i], map.m_entries.begin() + bounds[i + 1],
+                               map.m_entries.begin() + bounds[i + 2], by_value);
+            merged.push_back(bounds[i + 2]);
+        }
+
+        if (merged.back() != bounds.back())
+            merged.push_back(bounds.back());
+
+        bounds = std::move(merged);
+    }
+
+    return map;
+}
+
+const PointerMap::StaticRange* PointerMap::find_static_range(uintptr_t address) const
+{
+    auto next = std::upper_bound(m_static_ranges.begin(), m_static_ranges.end(), address,
+                                 [](uintptr_t address, const StaticRange& range) { return address < range.start; });
+    if (next == m_static_ranges.begin() || address >= std::prev(next)->end)
+        return nullptr;
+
+    return &*std::prev(next);
+}
+
+std::vector<PointerPath> PointerMap::find_paths(uintptr_t target, const Limits& limits) const
+{
+    // Every address we've found a way to, and how: each one is where a pointer is, and links to the addresses (one
+    // level closer to the target) it's a pointer to, plus an offset. The target is the only one with no links.
+    struct Link
+    {
+        uint32_t from{};
+        uint32_t to{};
+        size_t offset{};
+    };
+
+    // A pointer in a module's writable segments, which is where a path starts.
+    struct Root
+    {
+        const StaticRange* range{};
+        uintptr_t location{};
+        uint32_t to{};
+        size_t offset{};
+    };
+
+    // A pointer near an address we're looking for.
+    struct Found
+    {
+        size_t entry{};
+        uint32_t to{};
+        size_t offset{};
+    };
+
+    std::vector<uintptr_t> nodes{target};
+    std::unordered_map<uintptr_t, uint32_t> node_indices{{target, 0}};
+    std::vector<Link> links;
+    std::vector<Root> roots;
+
+    size_t level_start{};
+    size_t level_end = 1;
+
+    // Each level is searched in batches, so what we find at once stays small however wide the level gets. Every root
+    // makes at least one path, so we stop once there are enough of them.
+    constexpr size_t batch_size = 64 * 1024;
+
+    for (size_t depth = 1; depth <= limits.max_depth && level_start < level_end; depth++)
+    {
+        for (auto batch_start = level_start; batch_start < level_end && roots.size() < limits.max_paths;
+             batch_start += batch_size)
+        {
+            auto batch_end = std::min(batch_start + batch_size, level_end);
+            // Once there's no room for more addresses, only pointers a path can start at are worth finding.
+            auto only_roots = depth == limits.max_depth || nodes.size() >= limits.max_nodes;
+
+            // Finding what points near each address is the expensive part, and doesn't depend on the others.
+            auto thread_count = resolve_thread_count(limits.thread_count, (batch_end - batch_start + 1023) / 1024);
+            std::vector<std::vector<Found>> found(thread_count);
+
+            run_on_threads(thread_count, [&](size_t thread) {
+                auto count = batch_end - batch_start;
+                auto first = batch_start + count * thread / thread_count;
+                auto last = batch_start + count * (thread + 1) / thread_count;
+
+                for (auto i = first; i < last; i++)
+                {
+                    auto address = nodes[i];
+                    auto lowest = address - std::min(address, limits.max_offset);
+                    auto entry = std::lower_bound(m_entries.begin(), m_entries.end(), lowest,
+                                                  [](const Entry& entry, uintptr_t value) { return entry.value < value; });
+
+                    for (; entry != m_entries.end() && entry->value <= address; entry++)
+                    {
+                        if (only_roots && !find_static_range(entry->location))
+                            continue;
+
+                        found[thread].push_back({static_cast<size_t>(entry - m_entries.begin()),
+                                                 static_cast<uint32_t>(i), address - entry->value});
+                    }
+                }
+            });
+
+            for (auto& thread_found : found)
+            {
+                for (auto& link : thread_found)
+                {
+                    auto location = m_entries[link.entry].location;
+                    if (auto* range = find_static_range(location))
+                    {
+                        if (roots.size() < limits.max_paths)
+                            roots.push_back({range, location, link.to, link.offset});
+
+                        continue;
+                    }
+
+                    if (only_roots)
+                        continue;
+
+                    auto [it, inserted] = node_indices.try_emplace(location, static_cast<uint32_t>(nodes.size()));
+                    if (inserted)
+                    {
+                        if (nodes.size() >= limits.max_nodes)
+                        {
+                            node_indices.erase(it);
+                            continue;
+                        }
+
+                        nodes.push_back(location);
+                    }
+                    // An address we already found a shorter way to only makes longer paths.
+                    else if (it->second < level_end)
+                        continue;
+
+                    links.push_back({it->second, link.to, link.offset});
+                }
+            }
+        }
+
+        level_start = level_end;
+        level_end = nodes.size();
+    }
+
+    // Walk from each root to the target, through every way there is.
+    std::sort(links.begin(), links.end(), [](const Link& a, const Link& b) { return a.from < b.from; });
+    std::vector<size_t> first_link(nodes.size() + 1);
+    for (auto& link : links)
+        first_link[link.from + 1]++;
+    for (size_t i = 1; i < first_link.size(); i++)
+        first_link[i] += first_link[i - 1];
+
+    std::vector<PointerPath> paths;
+    PointerPath path;
+
+    auto walk = [&](auto& self, uint32_t node) -> void {
+        if (paths.size() >= limits.max_paths)
+            return;
+
+        if (node == 0)
+        {
+            paths.push_back(path);
+            return;
+        }
+
+        for (auto i = first_link[node]; i < first_link[node + 1]; i++)
+        {
+            path.offsets.push_back(links[i].offset);
+            self(self, links[i].to);
+            path.offsets.pop_back();
+        }
+    };
+
+    // The target might be in a module itself, which is a path with nothing to dereference.
+    if (auto* range = find_static_range(target))
+        paths.push_back({m_modules[range->module].name, target - m_modules[range->module].start, {}});
+
+    for (auto& root : roots)
+    {
+        auto& module = m_modules[root.range->module];
+        path.module = module.name;
+        path.module_offset = root.location - module.start;
+        path.offsets = {root.offset};
+        walk(walk, root.to);
+    }
+
+    return paths;
+}
+
+std::vector<PointerPath> PointerMap::intersect(std::span<const PointerPath> first, std::span<const PointerPath> second)
+{
+    std::vector<PointerPath> sorted_first(first.begin(), first.end());
+    std::vector<PointerPath> sorted_second(second.begin(), second.end());
+    std::sort(sorted_first.begin(), sorted_first.end());
+    std::sort(sorted_second.begin(), sorted_second.end());
+
+    std::vector<PointerPath> paths;
+    std::set_intersection(sorted_first.begin(), sorted_first.end(), sorted_second.begin(), sorted_second.end(),
+                          std::back_inserter(paths));
+
+    return paths;
+}
+
+void PointerMap::save(Stream& stream) const
+{
+    write_bytes(stream, magic, sizeof(magic));
+    write_value<uint32_t>(stream, version);
+    write_value<uint32_t>(stream, sizeof(uintptr_t));
+
+    write_value<uint64_t>(stream, m_modules.size());
+    for (auto& module : m_modules)
+    {
+        write_value<uint64_t>(stream, module.start);
+        write_value<uint64_t>(stream, module.name.size());
+        write_bytes(stream, module.name.data(), module.name.size());
+    }
+
+    write_value<uint64_t>(stream, m_static_ranges.size());
+    write_bytes(stream, m_static_ranges.data(), m_static_ranges.size() * sizeof(StaticRange));
+    write_value<uint64_t>(stream, m_entries.size());
+    write_bytes(stream, m_entries.data(), m_entries.size() * sizeof(Entry));
+}
+
+PointerMap PointerMap::load(Stream& stream)
+{
+    Reader reader(stream);
+
+    auto header = stream.read(sizeof(magic));
+    if (memcmp(header.data(), magic, sizeof(magic)) != 0)
+        throw std::runtime_error("Not a pointer map");
+
+    if (reader.read<uint32_t>() != version)
+        throw std::runtime_error("Unsupported pointer map version");
+
+    if (reader.read<uint32_t>() != sizeof(uintptr_t))
+        throw std::runtime_error("Pointer map is of a process with a different pointer size");
+
+    PointerMap map;
+    map.m_modules.resize(reader.read<uint64_t>());
+    for (auto& module : map.m_modules)
+    {
+        module.start = reader.read<uint64_t>();
+        auto name = stream.read(reader.read<uint64_t>());
+        module.name.assign(name.begin(), name.end());
+    }
+
+    read_array(stream, reader, map.m_static_ranges);
+    read_array(stream, reader, map.m_entries);
+
+    for (auto& range : map.m_static_ranges)
+    {
+        if (range.module >= map.m_modules.size())
+            throw std::runtime_error("Pointer map has a range of a module it doesn't have");
+    }
+
+    return map;
+}
+}
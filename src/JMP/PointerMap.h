@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "LargeAllocator.h"
+#include "MemoryMap.h"
+#include "ModuleTable.h"
+#include "Stream.h"
+#include "Threads.h"
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace JMP
+{
+// A way to get to an address that moves around from one that doesn't: start at an offset into a module, then
+// dereference and add each offset in turn.
+//
+//     libgame.so+0x1f2a0 -> +0x18 -> +0x40 -> +0x10
+//
+// is *(*(*(libgame.so + 0x1f2a0) + 0x18) + 0x40) + 0x10.
+struct PointerPath
+{
+    // Empty for the main executable.
+    std::string module;
+    uintptr_t module_offset{};
+    std::vector<size_t> offsets;
+
+    auto operator<=>(const PointerPath&) const = default;
+
+    // Follows the path through our own memory, or returns nothing if a pointer along it isn't readable.
+    std::optional<uintptr_t> resolve(const ModuleTable&) const;
+    std::string to_string() const;
+};
+
+// Every pointer in a process, sorted by where it points, so we can ask "what points near this address?" without
+// looking at memory again. That makes finding paths to an address a search through the map, and the map can be saved
+// and searched later, or on another run, to keep only the paths that work both times.
+//
+//     auto map = PointerMap::build(ModuleTable(), MemoryMap::self());
+//     auto paths = map.find_paths(reinterpret_cast<uintptr_t>(&player->health));
+//
+// Only aligned values that point into a readable, non-executable region count as pointers, and the writable segments
+// of modules are where paths start.
+class PointerMap
+{
+public:
+    struct Entry
+    {
+        uintptr_t value{};
+        uintptr_t location{};
+    };
+
+    struct Limits
+    {
+        // The most pointers a path dereferences.
+        size_t max_depth{5};
+        // The furthest past what a pointer points to that the next address can be, like the size of a struct.
+        size_t max_offset{0x1000};
+        size_t max_paths{100'000};
+        // Addresses in the middle of a path we keep track of, after which we stop looking deeper.
+        size_t max_nodes{1 << 20};
+        size_t thread_count{every_core};
+    };
+
+    // Scans our own memory, which must stay mapped until we're done. We never free anything while scanning, so our own
+    // allocations can't shrink the heap from under us.
+    static PointerMap build(const ModuleTable&, const MemoryMap&, size_t thread_count = every_core);
+
+    static PointerMap load(Stream&);
+    void save(Stream&) const;
+
+    std::vector<PointerPath> find_paths(uintptr_t target) const { return find_paths(target, Limits()); }
+    std::vector<PointerPath> find_paths(uintptr_t target, const Limits&) const;
+
+    // The paths in both, which (if they came from different runs) are the ones more likely to always work.
+    static std::vector<PointerPath> intersect(std::span<const PointerPath>, std::span<const PointerPath>);
+
+    // Sorted by value.
+    std::span<const Entry> entries() const { return m_entries; }
+    size_t size() const { return m_entries.size(); }
+
+private:
+    struct Module
+    {
+        std::string name;
+        uintptr_t start{};
+    };
+
+    struct StaticRange
+    {
+        uintptr_t start{};
+        uintptr_t end{};
+        uint64_t module{};
+    };
+
+    const StaticRange* find_static_range(uintptr_t address) const;
+
+    std::vector<Module> m_modules;
+    // Sorted by start.
+    std::vector<StaticRange> m_static_ranges;
+    // Can be gigabytes for a big process.
+    std::vector<Entry, LargeAllocator<Entry>> m_entries;
+};
+}
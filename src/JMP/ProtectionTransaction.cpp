@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ProtectionTransaction.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace JMP
+{
+static Platform::MemoryProtection combine(Platform::MemoryProtection a, Platform::MemoryProtection b)
+{
+    return {a.read || b.read, a.write || b.write, a.execute || b.execute};
+}
+
+void ProtectionTransaction::add(std::span<uint8_t> bytes, Platform::MemoryProtection protection)
+{
+    if (bytes.empty())
+        return;
+
+    auto page_mask = ~(Platform::page_size() - 1);
+    auto start = reinterpret_cast<uintptr_t>(bytes.data());
+    auto end = start + bytes.size();
+
+    m_requested.push_back({start & page_mask, (end + Platform::page_size() - 1) & page_mask, protection});
+}
+
+void ProtectionTransaction::apply_changes()
+{
+    m_memory_map.refresh();
+    apply_changes(m_memory_map);
+}
+
+void ProtectionTransaction::apply_changes(const MemoryMap& memory_map)
+{
+    if (!m_changes.empty() || !m_originals.empty())
+        throw std::runtime_error("ProtectionTransaction was already applied");
+
+    std::sort(m_requested.begin(), m_requested.end(), [](auto& a, auto& b) { return a.start < b.start; });
+
+    // Overlapping ranges have to be changed together, so they get everything either of them asked for. Ranges that
+    // only touch are merged if they want the same thing.
+    std::vector<Change> merged;
+
+    for (auto& requested : m_requested)
+    {
+        if (!merged.empty())
+        {
+            auto& last = merged.back();
+
+            if (requested.start < last.end)
+            {
+                last.end = std::max(last.end, requested.end);
+                last.protection = combine(last.protection, requested.protection);
+                continue;
+            }
+
+            if (requested.start == last.end && requested.protection == last.protection)
+            {
+                last.end = requested.end;
+                continue;
+            }
+        }
+
+        merged.push_back(requested);
+    }
+
+    // Work out what to restore from the snapshot. Parts that already have the protection we want don't need restoring,
+    // and a change that is entirely made of those doesn't need doing at all.
+    for (auto& change : merged)
+    {
+        auto address = change.start;
+        auto already_protected = true;
+
+        while (address < change.end)
+        {
+            auto* region = memory_map.find(address);
+            if (!region)
+            {
+                m_requested.clear();
+                m_changes.clear();
+                m_originals.clear();
+                throw Platform::PlatformException("Unable to change protection of memory that isn't mapped");
+            }
+
+            auto end = std::min(region->end, change.end);
+
+            if (region->protection != change.protection)
+            {
+                already_protected = false;
+
+                if (!m_originals.empty() && m_originals.back().end == address &&
+                    m_originals.back().protection == region->protection)
+                    m_originals.back().end = end;
+                else
+                    m_originals.push_back({address, end, region->protection});
+            }
+
+            address = end;
+        }
+
+        if (!already_protected)
+            m_changes.push_back(change);
+    }
+
+    for (auto& change : m_changes)
+    {
+        if (auto result = Platform::try_modify_memory_protection(change.bytes(), change.protection); !result)
+        {
+            // Restoring what we didn't get to change yet just sets what it already is, which is harmless.
+            restore();
+            throw Platform::PlatformException(result.error());
+        }
+    }
+}
+
+bool ProtectionTransaction::restore() noexcept
+{
+    auto originals = std::move(m_originals);
+
+    m_requested.clear();
+    m_changes.clear();
+    m_originals.clear();
+
+    auto restored = true;
+    for (auto& original : originals)
+        restored &= Platform::try_modify_memory_protection(original.bytes(), original.protection).has_value();
+
+    return restored;
+}
+}
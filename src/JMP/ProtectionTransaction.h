@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "MemoryMap.h"
+#include "Platform.h"
+#include "ScopeGuard.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace JMP
+{
+// Changes the protection of many ranges at once, with as few syscalls as possible, and restores what they were before.
+// Ranges are widened to whole pages, and neighbouring ranges wanting the same protection are changed together.
+//
+//     ProtectionTransaction transaction;
+//     for (auto site : patch_sites)
+//         transaction.add(site, {.read = true, .write = true, .execute = true});
+//
+//     auto restore = transaction.apply();
+//     // ... write the patches, everything is restored when restore goes out of scope.
+class ProtectionTransaction
+{
+public:
+    struct Change
+    {
+        uintptr_t start{};
+        uintptr_t end{};
+        Platform::MemoryProtection protection;
+
+        std::span<uint8_t> bytes() const { return {reinterpret_cast<uint8_t*>(start), end - start}; }
+    };
+
+    void add(std::span<uint8_t> bytes, Platform::MemoryProtection);
+
+    // The guard must not outlive the transaction.
+    [[nodiscard]] auto apply()
+    {
+        apply_changes();
+        return ScopeGuard{[this] { restore(); }};
+    }
+
+    // Uses an existing snapshot for the original protections, instead of taking one.
+    [[nodiscard]] auto apply(const MemoryMap& memory_map)
+    {
+        apply_changes(memory_map);
+        return ScopeGuard{[this] { restore(); }};
+    }
+
+    // Puts back the protection each page had before we applied, and forgets every range. Does nothing if we haven't
+    // applied since the last restore. Runs from the guard's destructor, so it can't throw: a range that fails to
+    // restore doesn't stop the rest, and we return whether they all were.
+    bool restore() noexcept;
+
+    // What apply() changed, and what restore() will change back. One syscall each.
+    const std::vector<Change>& changes() const { return m_changes; }
+    const std::vector<Change>& originals() const { return m_originals; }
+
+private:
+    void apply_changes();
+    void apply_changes(const MemoryMap&);
+
+    std::vector<Change> m_requested;
+    std::vector<Change> m_changes;
+    std::vector<Change> m_originals;
+    MemoryMap m_memory_map;
+};
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "RemotePatchSet.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace JMP
+{
+void RemotePatchSet::add(uintptr_t address, std::span<const uint8_t> bytes)
+{
+    if (m_applied)
+        throw std::runtime_error("Can't add a patch while applied");
+
+    if (bytes.empty())
+        throw std::invalid_argument("Patch is empty");
+
+    m_patches.push_back({address, bytes.size(), m_patch_bytes.size()});
+    m_patch_bytes.insert(m_patch_bytes.end(), bytes.begin(), bytes.end());
+}
+
+void RemotePatchSet::plan_groups()
+{
+    std::sort(m_patches.begin(), m_patches.end(), [](const Patch& a, const Patch& b) { return a.address < b.address; });
+
+    for (size_t i = 1; i < m_patches.size(); i++)
+    {
+        if (m_patches[i].address < m_patches[i - 1].address + m_patches[i - 1].size)
+            throw std::invalid_argument("Patches overlap");
+    }
+
+    auto page_size = Platform::page_size();
+    m_groups.clear();
+
+    for (auto& patch : m_patches)
+    {
+        auto end = patch.address + patch.size;
+
+        if (!m_groups.empty())
+        {
+            auto& group = m_groups.back();
+            auto group_end = group.address + group.size;
+
+            if (patch.address - group_end <= m_merge_distance && (end - 1) / page_size == group.address / page_size)
+            {
+                group.size = end - group.address;
+                continue;
+            }
+        }
+
+        auto offset = m_groups.empty() ? 0 : m_groups.back().offset + m_groups.back().size;
+        m_groups.push_back({patch.address, patch.size, offset, false});
+    }
+
+    // Where the target can't write is written through its memory file instead. Regions can change after we looked, in
+    // which case writing normally fails, and we write through the memory file after all.
+    for (auto& group : m_groups)
+    {
+        auto* region = m_process.memory_map().find(group.address);
+        group.writable = region && region->protection.write && group.address + group.size <= region->end;
+    }
+}
+
+std::vector<size_t> RemotePatchSet::write_groups(std::vector<uint8_t>& bytes, std::span<const size_t> groups)
+{
+    std::vector<size_t> forced;
+    std::vector<RemoteProcess::Transfer> transfers;
+    std::vector<size_t> transferred_groups;
+
+    for (auto index : groups)
+    {
+        auto& group = m_groups[index];
+        if (!group.writable)
+        {
+            forced.push_back(index);
+            continue;
+        }
+
+        transfers.push_back({group.address, {bytes.data() + group.offset, group.size}});
+        transferred_groups.push_back(index);
+    }
+
+    auto written = m_process.write(transfers);
+    for (size_t i = 0; i < written.size(); i++)
+    {
+        if (!written[i])
+            forced.push_back(transferred_groups[i]);
+    }
+
+    transfers.clear();
+    for (auto index : forced)
+        transfers.push_back({m_groups[index].address, {bytes.data() + m_groups[index].offset, m_groups[index].size}});
+
+    std::vector<size_t> failed;
+    written = m_process.write_through_memory_file(transfers);
+    for (size_t i = 0; i < written.size(); i++)
+    {
+        if (!written[i])
+            failed.push_back(forced[i]);
+    }
+
+    // Groups that weren't writable come before the ones that failed to transfer, so put them back in order.
+    std::sort(failed.begin(), failed.end());
+    return failed;
+}
+
+void RemotePatchSet::apply()
+{
+    if (m_applied)
+        return;
+
+    plan_groups();
+
+    auto size = m_groups.empty() ? 0 : m_groups.back().offset + m_groups.back().size;
+    m_original.resize(size);
+
+    std::vector<RemoteProcess::Transfer> transfers;
+    transfers.reserve(m_groups.size());
+    for (auto& group : m_groups)
+        transfers.push_back({group.address, {m_original.data() + group.offset, group.size}});
+
+    if (m_process.read(transfers) != transfers.size())
+        throw Platform::PlatformException("Patch target isn't readable");
+
+    // The patched bytes are the original ones with each patch on top, as groups include what's between patches.
+    m_patched = m_original;
+    size_t group_index{};
+    for (auto& patch : m_patches)
+    {
+        while (patch.address >= m_groups[group_index].address + m_groups[group_index].size)
+            group_index++;
+
+        auto& group = m_groups[group_index];
+        memcpy(m_patched.data() + group.offset + (patch.address - group.address), m_patch_bytes.data() + patch.offset,
+               patch.size);
+    }
+
+    std::vector<size_t> groups(m_groups.size());
+    for (size_t i = 0; i < groups.size(); i++)
+        groups[i] = i;
+
+    auto failed = write_groups(m_patched, groups);
+    if (failed.empty())
+    {
+        m_applied = true;
+        return;
+    }
+
+    // Put back the ones we did write. Anything failing to restore now would have failed to write in the first place.
+    std::vector<size_t> written;
+    std::set_difference(groups.begin(), groups.end(), failed.begin(), failed.end(), std::back_inserter(written));
+    write_groups(m_original, written);
+
+    throw Platform::PlatformException("Unable to write patch");
+}
+
+void RemotePatchSet::restore()
+{
+    if (!m_applied)
+        return;
+
+    std::vector<size_t> groups(m_groups.size());
+    for (size_t i = 0; i < groups.size(); i++)
+        groups[i] = i;
+
+    if (!write_groups(m_original, groups).empty())
+        throw Platform::PlatformException("Unable to restore patch");
+
+    m_applied = false;
+}
+
+size_t RemotePatchSet::verify() const
+{
+    // Start with the opposite of every byte we expect, so a patch we can't read back doesn't match either.
+    std::vector<uint8_t> bytes(m_patch_bytes.size());
+    for (size_t i = 0; i < bytes.size(); i++)
+        bytes[i] = ~m_patch_bytes[i];
+
+    std::vector<RemoteProcess::Transfer> transfers;
+    transfers.reserve(m_patches.size());
+    for (auto& patch : m_patches)
+        transfers.push_back({patch.address, {bytes.data() + patch.offset, patch.size}});
+
+    m_process.read(transfers);
+
+    size_t mismatched{};
+    for (auto& patch : m_patches)
+        mismatched += memcmp(bytes.data() + patch.offset, m_patch_bytes.data() + patch.offset, patch.size) != 0;
+
+    return mismatched;
+}
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "RemoteProcess.h"
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+namespace JMP
+{
+// Many small patches to another process, applied (and restored) together in a few syscalls, instead of a few for each.
+//
+//     RemotePatchSet patches(process);
+//     patches.add(0x401000, {0x90, 0x90});
+//     patches.add(0x402000, {0xc3});
+//     patches.apply();
+//
+// Patches close together on the same page are grouped into a single write (along with whatever is between them, as it
+// was when we read it), and every group that the target can write goes out in one process_vm_writev. Groups on pages
+// it can't write, like code, are written through /proc/<pid>/mem, one pwrite each.
+class RemotePatchSet
+{
+public:
+    // The most bytes between two patches that are still grouped together. What's between them is written back as it
+    // was read, so this should only be more than zero if the target won't be changing it.
+    static constexpr size_t default_merge_distance = 64;
+
+    explicit RemotePatchSet(const RemoteProcess& process, size_t merge_distance = default_merge_distance)
+        : m_process(process)
+        , m_merge_distance(merge_distance)
+    {
+    }
+
+    // Patches can't overlap each other, or be added while applied.
+    void add(uintptr_t address, std::span<const uint8_t> bytes);
+    void add(uintptr_t address, std::initializer_list<uint8_t> bytes)
+    {
+        add(address, std::span(bytes.begin(), bytes.size()));
+    }
+
+    // Reads what's there, then writes every patch. If any can't be read or written, the ones that were are restored
+    // before throwing.
+    void apply();
+    // Writes back what was there before we applied.
+    void restore();
+    // Reads every patch back in one batch, and returns how many don't hold what we wrote.
+    size_t verify() const;
+
+    bool is_applied() const { return m_applied; }
+    size_t size() const { return m_patches.size(); }
+    // How many writes applying takes, after grouping.
+    size_t group_count() const { return m_groups.size(); }
+
+private:
+    struct Patch
+    {
+        uintptr_t address{};
+        size_t size{};
+        // Where its bytes are in m_patch_bytes.
+        size_t offset{};
+    };
+
+    // Patches that are written together, whose original and patched bytes are at the same offset in m_original and
+    // m_patched.
+    struct Group
+    {
+        uintptr_t address{};
+        size_t size{};
+        size_t offset{};
+        bool writable{};
+    };
+
+    void plan_groups();
+    // Returns the groups that couldn't be written, in order, or none if they all were.
+    std::vector<size_t> write_groups(std::vector<uint8_t>& bytes, std::span<const size_t> groups);
+
+    const RemoteProcess& m_process;
+    size_t m_merge_distance{};
+    bool m_applied{};
+
+    std::vector<Patch> m_patches;
+    std::vector<uint8_t> m_patch_bytes;
+    std::vector<Group> m_groups;
+    std::vector<uint8_t> m_original;
+    std::vector<uint8_t> m_patched;
+};
+}
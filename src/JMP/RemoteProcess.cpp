@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "RemoteProcess.h"
+#include "LargeAllocator.h"
+#include "ScopeGuard.h"
+#include "Signature.h"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <semaphore>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+namespace JMP
+{
+namespace
+{
+// A part of a region, copied into a batch buffer at buffer_offset.
+struct Piece
+{
+    uintptr_t remote_address{};
+    size_t size{};
+    size_t buffer_offset{};
+};
+
+struct Batch
+{
+    std::vector<Piece> pieces;
+    size_t size{};
+};
+
+enum class Direction
+{
+    Read,
+    Write
+};
+
+// process_vm_readv won't take more than IOV_MAX iovecs at once, so larger batches are split into multiple calls. Each
+// iovec that couldn't be (fully) read is marked as failed and skipped, the rest of them are still read. Writing with
+// process_vm_writev works the same way.
+size_t transfer_iovecs(pid_t pid, std::span<iovec> local, std::span<iovec> remote, std::vector<bool>& succeeded,
+                       Direction direction)
+{
+    succeeded.assign(remote.size(), false);
+
+    size_t index{};
+    size_t number_read{};
+
+    while (index < remote.size())
+    {
+        auto count = std::min<size_t>(remote.size() - index, IOV_MAX);
+
+        auto result = direction == Direction::Read
+                          ? process_vm_readv(pid, local.data() + index, count, remote.data() + index, count, 0)
+                          : process_vm_writev(pid, local.data() + index, count, remote.data() + index, count, 0);
+        if (result == -1)
+        {
+            // The first iovec is not readable (or writable), skip past it and try again with the rest.
+            if (errno == EFAULT || errno == ENOMEM)
+            {
+                index++;
+                continue;
+            }
+
+            throw Platform::PlatformException(errno);
+        }
+
+        auto transferred = static_cast<size_t>(result);
+        auto end = index + count;
+
+        while (index < end && transferred >= remote[index].iov_len)
+        {
+            transferred -= remote[index].iov_len;
+            succeeded[index] = true;
+            number_read++;
+            index++;
+        }
+
+        // A short read stops at the first iovec that failed, which we can't use (even if part of it was copied).
+        if (index < end)
+            index++;
+    }
+
+    return number_read;
+}
+
+std::vector<Batch> plan_batches(std::span<const RemoteProcess::Region> regions, size_t batch_size,
+                                size_t signature_length)
+{
+    // Consecutive pieces of the same region overlap by this much, so matches that straddle the boundary between two
+    // pieces are still found.
+    auto overlap = signature_length - 1;
+    batch_size = std::max(batch_size, signature_length * 2);
+
+    std::vector<Batch> batches;
+    Batch current;
+
+    auto flush = [&] {
+        if (current.pieces.empty())
+            return;
+
+        batches.push_back(std::move(current));
+        current = {};
+    };
+
+    for (auto& region : regions)
+    {
+        if (!region.protection.read || region.size() < signature_length)
+            continue;
+
+        auto address = region.start;
+
+        while (true)
+        {
+            if (batch_size - current.size < signature_length || current.pieces.size() == IOV_MAX)
+                flush();
+
+            auto size = std::min<size_t>(region.end - address, batch_size - current.size);
+            current.pieces.push_back({address, size, current.size});
+            current.size += size;
+
+            if (address + size == region.end)
+                break;
+
+            address += size - overlap;
+        }
+    }
+
+    flush();
+
+    return batches;
+}
+
+size_t transfer(pid_t pid, std::span<const RemoteProcess::Transfer> transfers, std::vector<bool>& succeeded,
+                Direction direction)
+{
+    std::vector<iovec> local;
+    std::vector<iovec> remote;
+
+    local.reserve(transfers.size());
+    remote.reserve(transfers.size());
+
+    for (auto& transfer : transfers)
+    {
+        local.push_back({transfer.local_bytes.data(), transfer.local_bytes.size()});
+        remote.push_back({reinterpret_cast<void*>(transfer.remote_address), transfer.local_bytes.size()});
+    }
+
+    return transfer_iovecs(pid, local, remote, succeeded, direction);
+}
+}
+
+size_t RemoteProcess::read(std::span<const Transfer> transfers) const
+{
+    std::vector<bool> succeeded;
+    return transfer(m_pid, transfers, succeeded, Direction::Read);
+}
+
+std::vector<bool> RemoteProcess::write(std::span<const Transfer> transfers) const
+{
+    std::vector<bool> succeeded;
+    transfer(m_pid, transfers, succeeded, Direction::Write);
+    return succeeded;
+}
+
+std::vector<bool> RemoteProcess::write_through_memory_file(std::span<const Transfer> transfers) const
+{
+    std::vector<bool> succeeded(transfers.size());
+    if (transfers.empty())
+        return succeeded;
+
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/mem", m_pid);
+
+    auto fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw Platform::PlatformException(errno);
+
+    ScopeGuard close_fd{[fd] { close(fd); }};
+
+    for (size_t i = 0; i < transfers.size(); i++)
+    {
+        auto& transfer = transfers[i];
+        ssize_t result;
+
+        do
+            result = pwrite(fd, transfer.local_bytes.data(), transfer.local_bytes.size(),
+                            static_cast<off_t>(transfer.remote_address));
+        while (result == -1 && errno == EINTR);
+
+        succeeded[i] = result == static_cast<ssize_t>(transfer.local_bytes.size());
+    }
+
+    return succeeded;
+}
+
+std::optional<uintptr_t> RemoteProcess::find(Signature& signature) const
+{
+    return find_in_regions(signature, m_memory_map.regions());
+}
+
+std::optional<uintptr_t> RemoteProcess::find_in_regions(Signature& signature, std::span<const Region> regions) const
+{
+    if (signature.values().empty())
+        return {};
+
+    auto batches = plan_batches(regions, m_batch_size, signature.values().size());
+    if (batches.empty())
+        return {};
+
+    struct Slot
+    {
+        std::vector<uint8_t, LargeAllocator<uint8_t>> buffer;
+        std::vector<iovec> local;
+        std::vector<iovec> remote;
+        std::vector<bool> succeeded;
+        std::binary_semaphore free{1};
+        std::binary_semaphore filled{0};
+        // Set along with reader_exception, and only read once filled, so we know to stop without racing the reader.
+        bool reader_failed{};
+    };
+
+    Slot slots[2];
+    for (auto& slot : slots)
+        slot.buffer.resize(std::max(m_batch_size, signature.values().size() * 2));
+
+    // Double-buffering: the reader thread copies the next batch out of the target while we scan the current one.
+    std::exception_ptr reader_exception;
+
+    std::jthread reader([&](std::stop_token stop_token) {
+        for (size_t i = 0; i < batches.size(); i++)
+        {
+            auto& slot = slots[i % 2];
+            slot.free.acquire();
+
+            if (stop_token.stop_requested())
+                return;
+
+            slot.local.clear();
+            slot.remote.clear();
+
+            for (auto& piece : batches[i].pieces)
+            {
+                slot.local.push_back({slot.buffer.data() + piece.buffer_offset, piece.size});
+                slot.remote.push_back({reinterpret_cast<void*>(piece.remote_address), piece.size});
+            }
+
+            try
+            {
+                transfer_iovecs(m_pid, slot.local, slot.remote, slot.succeeded, Direction::Read);
+            }
+            catch (...)
+            {
+                reader_exception = std::current_exception();
+                slot.reader_failed = true;
+                slot.succeeded.assign(slot.remote.size(), false);
+                slot.filled.release();
+                return;
+            }
+
+            slot.filled.release();
+        }
+    });
+
+    std::optional<uintptr_t> match;
+
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        auto& slot = slots[i % 2];
+        slot.filled.acquire();
+
+        auto& pieces = batches[i].pieces;
+        for (size_t j = 0; j < pieces.size(); j++)
+        {
+            if (!slot.succeeded[j])
+                continue;
+
+            auto bytes = std::span(slot.buffer).subspan(pieces[j].buffer_offset, pieces[j].size);
+            if (auto* local_match = static_cast<uint8_t*>(signature.find_in(bytes)))
+            {
+                match = pieces[j].remote_address + (local_match - bytes.data());
+                break;
+            }
+        }
+
+        auto should_stop = match.has_value() || slot.reader_failed;
+        if (should_stop)
+            reader.request_stop();
+
+        slot.free.release();
+
+        if (should_stop)
+            break;
+    }
+
+    // The reader is done with reader_exception once it's joined.
+    reader.join();
+
+    if (reader_exception)
+        std::rethrow_exception(reader_exception);
+
+    return match;
+}
+}
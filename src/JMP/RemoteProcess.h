@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "MemoryMap.h"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <sys/types.h>
+#include <vector>
+
+namespace JMP
+{
+class Signature;
+
+// Reads (and scans) the memory of another process, without ptrace-attaching to it. The target only needs to be
+// something we would be allowed to ptrace.
+class RemoteProcess
+{
+public:
+    using Region = MemoryMap::Region;
+
+    // A single range of the target to copy into a local buffer.
+    struct Transfer
+    {
+        uintptr_t remote_address{};
+        std::span<uint8_t> local_bytes;
+    };
+
+    explicit RemoteProcess(pid_t pid) : m_pid(pid), m_memory_map(pid) {}
+
+    pid_t pid() const { return m_pid; }
+
+    // Regions are read once on construction, call this if the target has mapped or unmapped memory since.
+    void refresh_regions() { m_memory_map.refresh(); }
+    std::span<const Region> regions() const { return m_memory_map.regions(); }
+    const MemoryMap& memory_map() const { return m_memory_map; }
+
+    // Copies all transfers with as few syscalls as possible. Transfers that can't be read (unmapped since, or not
+    // readable by us) are skipped, and their local bytes are left untouched. Returns how many transfers were read.
+    size_t read(std::span<const Transfer> transfers) const;
+
+    // Copies local bytes into the target the same way, returning which transfers were written. Only memory the target
+    // could write to itself can be written like this.
+    std::vector<bool> write(std::span<const Transfer> transfers) const;
+    // Writes through /proc/<pid>/mem instead, which ignores the target's protection the way a debugger does, so
+    // read-only memory (like code) can be written too. Costs a syscall for each transfer.
+    std::vector<bool> write_through_memory_file(std::span<const Transfer> transfers) const;
+
+    // Scans every readable region for the signature, returning the address in the target of the first match.
+    std::optional<uintptr_t> find(Signature&) const;
+    std::optional<uintptr_t> find_in_regions(Signature&, std::span<const Region> regions) const;
+
+    // How much of the target we copy per read. Two buffers of this size are kept for as long as a scan runs, one
+    // being read into while the other is scanned.
+    void set_batch_size(size_t batch_size) { m_batch_size = batch_size; }
+
+private:
+    pid_t m_pid{};
+    MemoryMap m_memory_map;
+    size_t m_batch_size{4 * 1024 * 1024};
+};
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ShadowVirtualTable.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+namespace JMP
+{
+namespace
+{
+// How much of the vtable is before the first function: the complete object locator for MSVC, and the offset to top
+// and type info for everyone else (the Itanium ABI).
+#ifdef _MSC_VER
+constexpr size_t prefix_size = 1;
+#else
+constexpr size_t prefix_size = 2;
+#endif
+
+std::atomic_ref<uintptr_t> entry(void** slot) { return std::atomic_ref(*reinterpret_cast<uintptr_t*>(slot)); }
+}
+
+ShadowVirtualTable::ShadowVirtualTable(void* object, size_t function_count)
+    : m_object(static_cast<void**>(object))
+    , m_original_table(static_cast<void**>(*m_object))
+    , m_table(std::make_unique<void*[]>(prefix_size + function_count))
+    , m_function_count(function_count)
+{
+    if (function_count == 0)
+        throw std::invalid_argument("Virtual table must have at least one function");
+
+    std::copy_n(m_original_table - prefix_size, prefix_size + function_count, m_table.get());
+
+    // Other threads may be making virtual calls on the object while we swap its vtable pointer, which is fine as both
+    // tables have the same functions until something is installed.
+    entry(m_object).store(reinterpret_cast<uintptr_t>(m_table.get() + prefix_size), std::memory_order_release);
+}
+
+ShadowVirtualTable::~ShadowVirtualTable()
+{
+    // If something else has replaced the object's vtable pointer since, we leave it be.
+    auto expected = reinterpret_cast<uintptr_t>(m_table.get() + prefix_size);
+    entry(m_object).compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(m_original_table),
+                                            std::memory_order_acq_rel);
+}
+
+void ShadowVirtualTable::check_index(size_t index) const
+{
+    if (index >= m_function_count)
+        throw std::out_of_range("Virtual function index is outside of the table");
+}
+
+void* ShadowVirtualTable::install(size_t index, const void* replacement)
+{
+    check_index(index);
+    if (is_installed(index))
+        throw std::invalid_argument("Virtual function is already hooked");
+
+    entry(&m_table[prefix_size + index]).store(reinterpret_cast<uintptr_t>(replacement), std::memory_order_release);
+    return m_original_table[index];
+}
+
+void ShadowVirtualTable::uninstall(size_t index)
+{
+    check_index(index);
+    entry(&m_table[prefix_size + index]).store(reinterpret_cast<uintptr_t>(m_original_table[index]),
+                                               std::memory_order_release);
+}
+
+void ShadowVirtualTable::uninstall_all()
+{
+    for (size_t i = 0; i < m_function_count; i++)
+        uninstall(i);
+}
+
+bool ShadowVirtualTable::is_installed(size_t index) const
+{
+    check_index(index);
+    return m_table[prefix_size + index] != m_original_table[index];
+}
+
+void* ShadowVirtualTable::original(size_t index) const
+{
+    check_index(index);
+    return m_original_table[index];
+}
+}
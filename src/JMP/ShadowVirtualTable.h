@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace JMP
+{
+// Hooks the virtual functions of a single object, by pointing it at our own copy of its vtable. Nothing is written to
+// the real vtable, so other objects of the same class are unaffected, and no protection is ever changed: installing
+// and uninstalling is just a store into memory we own.
+//
+// The object goes back to its real vtable when this is destroyed, so this must not outlive it. The copy includes
+// what's before the first virtual function (the RTTI, and the offset to the top of the object), so typeid and
+// dynamic_cast still work, but not the virtual base offsets of classes with virtual bases.
+class ShadowVirtualTable
+{
+public:
+    // function_count is how many virtual functions the object's vtable has, which nothing in the vtable says.
+    ShadowVirtualTable(void* object, size_t function_count);
+    ShadowVirtualTable(const ShadowVirtualTable&) = delete;
+    ShadowVirtualTable& operator=(const ShadowVirtualTable&) = delete;
+    ~ShadowVirtualTable();
+
+    // Returns the original, to call it.
+    void* install(size_t index, const void* replacement);
+    void uninstall(size_t index);
+    void uninstall_all();
+
+    bool is_installed(size_t index) const;
+    void* original(size_t index) const;
+
+    size_t function_count() const { return m_function_count; }
+
+private:
+    void check_index(size_t index) const;
+
+    void** m_object{};
+    void** m_original_table{};
+    // The prefix (RTTI and the like), followed by the functions.
+    std::unique_ptr<void*[]> m_table;
+    size_t m_function_count{};
+};
+}
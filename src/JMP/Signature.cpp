@@ -5,11 +5,197 @@
  */
 
 #include "Signature.h"
+#include <algorithm>
+#include <bit>
 #include <cctype>
 #include <charconv>
+#include <cstring>
+#include <stdexcept>
 
 namespace JMP
 {
+namespace
+{
+// Shift-add (Baeza-Yates & Gonnet) keeps a small mismatch counter for every position of the pattern, packed next to
+// each other into machine words. Each byte of input shifts every counter into the next position, and adds one to the
+// positions whose expected byte differs. The counter for the last position is how many bytes mismatched for the window
+// ending at this byte. Each counter has a high bit to catch overflow, which we move into a separate overflow mask.
+constexpr size_t maximum_shift_add_words = 16;
+
+struct ShiftAddLayout
+{
+    size_t bits_per_field{};
+    size_t fields_per_word{};
+    size_t words{};
+    uint64_t used_mask{};
+    uint64_t overflow_mask{};
+};
+
+template<size_t StaticWords>
+void shift_add(std::span<uint8_t> bytes, const ShiftAddLayout& layout, const std::vector<uint64_t>& table,
+               size_t pattern_length, size_t max_mismatches, std::vector<Signature::ApproximateMatch>& matches)
+{
+    const auto words = StaticWords ? StaticWords : layout.words;
+    const auto bits = layout.bits_per_field;
+    const auto carry_shift = (layout.fields_per_word - 1) * bits;
+    const auto last_word = (pattern_length - 1) / layout.fields_per_word;
+    const auto last_offset = ((pattern_length - 1) % layout.fields_per_word) * bits;
+    const uint64_t counter_mask = (1ull << (bits - 1)) - 1;
+    const uint64_t overflow_bit = 1ull << (bits - 1);
+
+    uint64_t state[maximum_shift_add_words]{};
+    uint64_t overflow[maximum_shift_add_words];
+
+    // Until we've seen a whole pattern's worth of bytes, the counters are for windows that start before our bytes.
+    std::fill_n(overflow, words, layout.overflow_mask);
+
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        auto* mismatches = table.data() + bytes[i] * words;
+
+        // Go from the highest word down, so the top counter of the word below hasn't been shifted out yet.
+        for (size_t w = words; w-- > 0;)
+        {
+            auto carried_state = w ? state[w - 1] >> carry_shift : 0;
+            auto carried_overflow = w ? overflow[w - 1] >> carry_shift : 0;
+
+            state[w] = (((state[w] << bits) | carried_state) & layout.used_mask) + mismatches[w];
+            overflow[w] = (((overflow[w] << bits) | carried_overflow) & layout.used_mask) |
+                          (state[w] & layout.overflow_mask);
+            state[w] &= ~layout.overflow_mask;
+        }
+
+        if ((overflow[last_word] >> last_offset) & overflow_bit)
+            continue;
+
+        auto count = (state[last_word] >> last_offset) & counter_mask;
+        if (count <= max_mismatches)
+            matches.push_back({bytes.data() + i + 1 - pattern_length, count});
+    }
+}
+
+void find_with_shift_add(std::span<uint8_t> bytes, const ShiftAddLayout& layout,
+                         const std::vector<std::optional<uint8_t>>& values, size_t max_mismatches,
+                         std::vector<Signature::ApproximateMatch>& matches)
+{
+    // For every possible byte, which positions of the pattern it would mismatch. Wildcards never mismatch.
+    std::vector<uint64_t> table(256 * layout.words);
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (!values[i].has_value())
+            continue;
+
+        auto word = i / layout.fields_per_word;
+        auto bit = 1ull << ((i % layout.fields_per_word) * layout.bits_per_field);
+
+        for (auto c = 0; c < 256; c++)
+        {
+            if (c != *values[i])
+                table[c * layout.words + word] |= bit;
+        }
+    }
+
+    switch (layout.words)
+    {
+        case 1:
+            shift_add<1>(bytes, layout, table, values.size(), max_mismatches, matches);
+            break;
+        case 2:
+            shift_add<2>(bytes, layout, table, values.size(), max_mismatches, matches);
+            break;
+        case 3:
+            shift_add<3>(bytes, layout, table, values.size(), max_mismatches, matches);
+            break;
+        case 4:
+            shift_add<4>(bytes, layout, table, values.size(), max_mismatches, matches);
+            break;
+        default:
+            shift_add<0>(bytes, layout, table, values.size(), max_mismatches, matches);
+            break;
+    }
+}
+
+// Splitting the pattern into max_mismatches + 1 pieces, any window that matches has at least one piece that matches
+// exactly (the pigeonhole principle). We give each piece an anchor, two concrete bytes in a row, and one pass over the
+// input checks every pair of bytes against a bitmap of the anchors. Only windows where an anchor matched get their
+// mismatches counted, which is far less work than shift-add does for every byte, but it needs every piece to have an
+// anchor, so it returns false (having found nothing) for patterns with too many wildcards or too short to split.
+bool pigeonhole(std::span<uint8_t> bytes, const std::vector<std::optional<uint8_t>>& values, size_t max_mismatches,
+                std::vector<Signature::ApproximateMatch>& matches)
+{
+    struct Anchor
+    {
+        uint16_t key{};
+        size_t offset{};
+    };
+
+    auto pieces = max_mismatches + 1;
+    if (values.size() < pieces * 2)
+        return false;
+
+    std::vector<Anchor> anchors;
+
+    for (size_t piece = 0; piece < pieces; piece++)
+    {
+        auto start = piece * values.size() / pieces;
+        auto end = (piece + 1) * values.size() / pieces;
+
+        // Runs of the same byte (like padding) are everywhere in binaries, so we'd rather anchor on two that differ.
+        std::optional<Anchor> anchor;
+        for (auto i = start; i + 1 < end; i++)
+        {
+            if (!values[i].has_value() || !values[i + 1].has_value())
+                continue;
+
+            if (!anchor || (*values[i] != *values[i + 1] && anchor->key >> 8 == (anchor->key & 0xFF)))
+                anchor = Anchor{static_cast<uint16_t>(*values[i] | *values[i + 1] << 8), i};
+        }
+
+        if (!anchor)
+            return false;
+
+        anchors.push_back(*anchor);
+    }
+
+    std::vector<uint64_t> is_anchor(65536 / 64);
+    for (auto& anchor : anchors)
+        is_anchor[anchor.key / 64] |= 1ull << (anchor.key % 64);
+
+    auto count_mismatches = [&](size_t start) {
+        size_t mismatches{};
+        for (size_t i = 0; i < values.size() && mismatches <= max_mismatches; i++)
+            mismatches += values[i].has_value() && bytes[start + i] != *values[i];
+
+        return mismatches;
+    };
+
+    for (size_t i = 0; i + 1 < bytes.size(); i++)
+    {
+        auto key = static_cast<uint16_t>(bytes[i] | bytes[i + 1] << 8);
+        if (!(is_anchor[key / 64] >> (key % 64) & 1))
+            continue;
+
+        for (auto& anchor : anchors)
+        {
+            if (anchor.key != key || i < anchor.offset || i - anchor.offset + values.size() > bytes.size())
+                continue;
+
+            auto start = i - anchor.offset;
+            if (auto mismatches = count_mismatches(start); mismatches <= max_mismatches)
+                matches.push_back({bytes.data() + start, mismatches});
+        }
+    }
+
+    // A window where more than one piece matched was found once for each of them, and not in address order.
+    std::sort(matches.begin(), matches.end(), [](auto& a, auto& b) { return a.address < b.address; });
+    matches.erase(std::unique(matches.begin(), matches.end(), [](auto& a, auto& b) { return a.address == b.address; }),
+                  matches.end());
+
+    return true;
+}
+}
+
 Signature::Signature(std::string_view signature)
 {
     for (auto i = 0; i < signature.length(); i++)
@@ -35,11 +221,14 @@ Signature::Signature(std::string_view signature)
 
 void* Signature::find_in(std::span<uint8_t> bytes)
 {
-    for (auto i = 0; i < bytes.size() - m_values.size(); i++)
+    if (bytes.size() < m_values.size())
+        return nullptr;
+
+    for (size_t i = 0; i <= bytes.size() - m_values.size(); i++)
     {
         bool failed = false;
 
-        for (auto j = 0; j < m_values.size(); j++)
+        for (size_t j = 0; j < m_values.size(); j++)
         {
             auto& value = m_values[j];
             if (!value.has_value())
@@ -58,4 +247,148 @@ void* Signature::find_in(std::span<uint8_t> bytes)
 
     return nullptr;
 }
+
+Signature::ScanResult Signature::find_in(std::span<uint8_t> bytes, const ScanLimits& limits)
+{
+    ScanResult result;
+
+    if (bytes.size() < m_values.size())
+        return result;
+
+    auto candidates = bytes.size() - m_values.size() + 1;
+
+    while (result.bytes_scanned < candidates)
+    {
+        if (limits.stop_token.stop_requested())
+        {
+            result.status = ScanResult::Status::Cancelled;
+            return result;
+        }
+
+        if (limits.deadline.has_value() && std::chrono::steady_clock::now() >= *limits.deadline)
+        {
+            result.status = ScanResult::Status::DeadlineExceeded;
+            return result;
+        }
+
+        auto chunk_candidates = std::min(scan_chunk_size, candidates - result.bytes_scanned);
+
+        if (limits.byte_budget.has_value())
+        {
+            if (result.bytes_scanned >= *limits.byte_budget)
+            {
+                result.status = ScanResult::Status::BudgetExhausted;
+                return result;
+            }
+
+            chunk_candidates = std::min(chunk_candidates, *limits.byte_budget - result.bytes_scanned);
+        }
+
+        // Each chunk includes the bytes needed for a match starting at its last candidate.
+        auto chunk = bytes.subspan(result.bytes_scanned, chunk_candidates + m_values.size() - 1);
+        if (auto* match = find_in(chunk))
+        {
+            result.status = ScanResult::Status::Found;
+            result.address = match;
+            result.bytes_scanned = static_cast<uint8_t*>(match) - bytes.data();
+            return result;
+        }
+
+        result.bytes_scanned += chunk_candidates;
+    }
+
+    result.bytes_scanned = bytes.size();
+    return result;
+}
+
+Signature& Signature::then_add(int64_t offset)
+{
+    m_resolve_steps.push_back({ResolveStep::Kind::Add, offset});
+    return *this;
+}
+
+Signature& Signature::then_follow_relative32(size_t trailing_bytes)
+{
+    m_resolve_steps.push_back({ResolveStep::Kind::FollowRelative32, static_cast<int64_t>(trailing_bytes)});
+    return *this;
+}
+
+Signature& Signature::then_dereference()
+{
+    m_resolve_steps.push_back({ResolveStep::Kind::Dereference});
+    return *this;
+}
+
+void* Signature::resolve(void* match) const
+{
+    auto address = reinterpret_cast<uintptr_t>(match);
+
+    for (auto& step : m_resolve_steps)
+    {
+        if (!address)
+            return nullptr;
+
+        switch (step.kind)
+        {
+            case ResolveStep::Kind::Add:
+                address += step.value;
+                break;
+            case ResolveStep::Kind::FollowRelative32:
+            {
+                int32_t displacement;
+                memcpy(&displacement, reinterpret_cast<void*>(address), sizeof(displacement));
+                address += sizeof(displacement) + step.value + displacement;
+                break;
+            }
+            case ResolveStep::Kind::Dereference:
+                memcpy(&address, reinterpret_cast<void*>(address), sizeof(address));
+                break;
+        }
+    }
+
+    return reinterpret_cast<void*>(address);
+}
+
+void* Signature::find_and_resolve_in(std::span<uint8_t> bytes)
+{
+    auto* match = find_in(bytes);
+    if (!match)
+        return nullptr;
+
+    return resolve(match);
+}
+
+std::vector<Signature::ApproximateMatch> Signature::find_approximate(std::span<uint8_t> bytes, size_t max_mismatches)
+{
+    std::vector<ApproximateMatch> matches;
+
+    if (m_values.empty() || bytes.size() < m_values.size())
+        return matches;
+
+    // Enough bits to count up to max_mismatches, and one more to detect overflow.
+    ShiftAddLayout layout;
+    layout.bits_per_field = std::bit_width(max_mismatches) + 1;
+    if (layout.bits_per_field > 32)
+        throw std::runtime_error("Too many mismatches to approximately match signature");
+
+    layout.fields_per_word = 64 / layout.bits_per_field;
+    layout.words = (m_values.size() + layout.fields_per_word - 1) / layout.fields_per_word;
+    if (layout.words > maximum_shift_add_words)
+        throw std::runtime_error("Signature is too long to approximately match");
+
+    auto used_bits = layout.fields_per_word * layout.bits_per_field;
+    layout.used_mask = used_bits == 64 ? ~0ull : (1ull << used_bits) - 1;
+
+    for (size_t i = 0; i < layout.fields_per_word; i++)
+        layout.overflow_mask |= 1ull << (i * layout.bits_per_field + layout.bits_per_field - 1);
+
+    if (!pigeonhole(bytes, m_values, max_mismatches, matches))
+        find_with_shift_add(bytes, layout, m_values, max_mismatches, matches);
+
+    // Matches are already in address order, keep it that way between matches that are equally good.
+    std::stable_sort(matches.begin(), matches.end(),
+                     [](auto& a, auto& b) { return a.mismatches < b.mismatches; });
+
+    return matches;
+}
 }
\ No newline at end of file
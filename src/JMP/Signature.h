@@ -6,9 +6,11 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <optional>
 #include <span>
+#include <stop_token>
 #include <string_view>
 #include <vector>
 
@@ -17,13 +19,86 @@ namespace JMP
 class Signature
 {
 public:
+    struct ApproximateMatch
+    {
+        void* address{};
+        size_t mismatches{};
+    };
+
+    // Limits are only checked between chunks of the scan, so they cost nothing in the hot loop, but a scan may run
+    // over its deadline (or budget) by up to one chunk.
+    struct ScanLimits
+    {
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        std::optional<size_t> byte_budget;
+        std::stop_token stop_token;
+    };
+
+    struct ScanResult
+    {
+        enum class Status
+        {
+            Found,
+            NotFound,
+            DeadlineExceeded,
+            BudgetExhausted,
+            Cancelled
+        };
+
+        Status status{Status::NotFound};
+        void* address{};
+        // Where to continue from, if the scan was aborted.
+        size_t bytes_scanned{};
+
+        bool found() const { return status == Status::Found; }
+        bool aborted() const { return status != Status::Found && status != Status::NotFound; }
+    };
+
+    // One step of getting from where a signature matched to what we actually wanted.
+    struct ResolveStep
+    {
+        enum class Kind
+        {
+            // Moves the address by value.
+            Add,
+            // Reads the rel32 at the address, and follows it from the end of the instruction. value is how many bytes
+            // the instruction has after the rel32 (like an immediate), which is zero for call, jmp and lea.
+            FollowRelative32,
+            // Reads an absolute pointer at the address.
+            Dereference
+        };
+
+        Kind kind{};
+        int64_t value{};
+    };
+
+    static constexpr size_t scan_chunk_size = 64 * 1024;
+
     explicit Signature(std::string_view signature);
 
     void* find_in(std::span<uint8_t> bytes);
+    ScanResult find_in(std::span<uint8_t> bytes, const ScanLimits&);
+
+    // Finds every place where at most max_mismatches of our concrete bytes differ, best (fewest mismatches) first.
+    // Useful to recover a signature that broke because a few bytes changed in an update.
+    std::vector<ApproximateMatch> find_approximate(std::span<uint8_t> bytes, size_t max_mismatches);
+
+    // Steps run in order on a match, to get the real target of (for example) a call instead of the call itself:
+    // Signature("E8 ? ? ? ? 48 8B").then_add(1).then_follow_relative32()
+    Signature& then_add(int64_t offset);
+    Signature& then_follow_relative32(size_t trailing_bytes = 0);
+    Signature& then_dereference();
+
+    // Runs the resolve steps on a match found in this process, returning nullptr if we dereferenced a null pointer.
+    // Nothing here is bounds-checked, the steps are trusted just as much as the signature itself.
+    void* resolve(void* match) const;
+    void* find_and_resolve_in(std::span<uint8_t> bytes);
 
     const std::vector<std::optional<uint8_t>>& values() const { return m_values; }
+    const std::vector<ResolveStep>& resolve_steps() const { return m_resolve_steps; }
 
 private:
     std::vector<std::optional<uint8_t>> m_values;
+    std::vector<ResolveStep> m_resolve_steps;
 };
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "ScopeGuard.h"
+#include <algorithm>
 #include <cstdint>
 #include <span>
 #include <vector>
@@ -24,6 +25,13 @@ public:
     };
 
     virtual std::vector<uint8_t> read(size_t number_of_bytes) = 0;
+    // Reads exactly as many bytes as there is room for. Streams that can read straight into memory they're given should
+    // override this, instead of reading into a vector we copy from.
+    virtual void read_into(std::span<uint8_t> bytes)
+    {
+        auto read_bytes = read(bytes.size());
+        std::copy(read_bytes.begin(), read_bytes.end(), bytes.begin());
+    }
     virtual void write(std::span<uint8_t> bytes_to_write) = 0;
     virtual void seek(size_t offset, SeekOrigin) = 0;
     virtual size_t index() const = 0;
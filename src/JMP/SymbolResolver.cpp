@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "SymbolResolver.h"
+#include "ScopeGuard.h"
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace JMP
+{
+namespace
+{
+// Whether a symbol is something with an address in the module. Absolute symbols are just values, and TLS ones are
+// offsets into each thread's block.
+bool has_address(const ElfImage::Symbol& symbol)
+{
+    if (symbol.st_shndx == SHN_UNDEF || symbol.st_shndx == SHN_ABS || symbol.st_name == 0)
+        return false;
+
+    auto type = ELF64_ST_TYPE(symbol.st_info);
+    return type == STT_FUNC || type == STT_GNU_IFUNC || type == STT_OBJECT || type == STT_NOTYPE;
+}
+
+template<typename T>
+std::span<const T> file_array(std::span<const uint8_t> file, uint64_t offset, uint64_t size)
+{
+    if (offset > file.size() || size > file.size() - offset || offset % alignof(T) != 0)
+        throw std::runtime_error("Module's file is truncated");
+
+    return {reinterpret_cast<const T*>(file.data() + offset), size / sizeof(T)};
+}
+
+std::span<const uint8_t> find_build_id(std::span<const uint8_t> file, std::span<const Elf64_Shdr> sections)
+{
+    for (auto& section : sections)
+    {
+        if (section.sh_type != SHT_NOTE)
+            continue;
+
+        auto notes = file_array<uint8_t>(file, section.sh_offset, section.sh_size);
+        size_t offset{};
+
+        // Build ID notes are always aligned to 4 bytes, so we needn't handle notes aligned to 8.
+        while (offset + sizeof(Elf64_Nhdr) <= notes.size())
+        {
+            Elf64_Nhdr note;
+            memcpy(&note, notes.data() + offset, sizeof(note));
+
+            auto name_offset = offset + sizeof(Elf64_Nhdr);
+            auto description_offset = name_offset + ((note.n_namesz + 3) & ~3);
+            if (description_offset + note.n_descsz > notes.size())
+                break;
+
+            if (note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 && memcmp(notes.data() + name_offset, "GNU", 4) == 0)
+                return notes.subspan(description_offset, note.n_descsz);
+
+            offset = description_offset + ((note.n_descsz + 3) & ~3);
+        }
+    }
+
+    return {};
+}
+}
+
+SymbolResolver::SymbolResolver(const ModuleTable::Module& module, bool read_symbol_table)
+    : m_image(module)
+    , m_base(module.base)
+{
+    if (read_symbol_table)
+        map_symbol_table(module);
+}
+
+SymbolResolver::~SymbolResolver()
+{
+    if (!m_file.empty())
+        munmap(const_cast<uint8_t*>(m_file.data()), m_file.size());
+}
+
+void SymbolResolver::map_symbol_table(const ModuleTable::Module& module)
+{
+    // The loader doesn't know the main executable's path, but the kernel does.
+    auto* path = module.path.empty() ? "/proc/self/exe" : module.path.c_str();
+
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw Platform::PlatformException(errno);
+
+    ScopeGuard close_fd{[fd] { close(fd); }};
+
+    struct stat status;
+    if (fstat(fd, &status) == -1)
+        throw Platform::PlatformException(errno);
+
+    if (status.st_size < static_cast<off_t>(sizeof(Elf64_Ehdr)))
+        throw std::runtime_error("Module's file is truncated");
+
+    auto* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+        throw Platform::PlatformException(errno);
+
+    m_file = {static_cast<const uint8_t*>(mapping), static_cast<size_t>(status.st_size)};
+
+    // Our destructor won't run if the constructor throws.
+    ScopeGuard unmap{[this] {
+        munmap(const_cast<uint8_t*>(m_file.data()), m_file.size());
+        m_file = {};
+    }};
+
+    auto& header = *reinterpret_cast<const Elf64_Ehdr*>(m_file.data());
+    if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_shentsize != sizeof(Elf64_Shdr))
+        throw std::runtime_error("Module's file isn't a 64-bit ELF");
+
+    auto sections = file_array<Elf64_Shdr>(m_file, header.e_shoff, header.e_shnum * sizeof(Elf64_Shdr));
+
+    if (!module.build_id.empty())
+    {
+        auto build_id = find_build_id(m_file, sections);
+        if (!std::equal(build_id.begin(), build_id.end(), module.build_id.begin(), module.build_id.end()))
+            throw std::runtime_error("Module's file on disk isn't the one that's loaded");
+    }
+
+    // A stripped module just doesn't have one, which isn't an error.
+    for (auto& section : sections)
+    {
+        if (section.sh_type != SHT_SYMTAB || section.sh_link >= sections.size())
+            continue;
+
+        auto& strings = sections[section.sh_link];
+        auto string_bytes = file_array<char>(m_file, strings.sh_offset, strings.sh_size);
+        if (string_bytes.empty() || string_bytes.back() != '\0')
+            throw std::runtime_error("Module's symbol names are malformed");
+
+        m_symbol_table = file_array<ElfImage::Symbol>(m_file, section.sh_offset, section.sh_size);
+        m_symbol_table_strings = {string_bytes.data(), string_bytes.size()};
+        break;
+    }
+
+    unmap.disarm();
+}
+
+std::string_view SymbolResolver::symbol_table_name(const ElfImage::Symbol& symbol) const
+{
+    if (symbol.st_name >= m_symbol_table_strings.size())
+        return {};
+
+    return m_symbol_table_strings.data() + symbol.st_name;
+}
+
+bool SymbolResolver::is_better_match(uint32_t current, uint32_t candidate) const
+{
+    // Only a global symbol replaces a local one. Otherwise, we keep the first we found, like a linker would.
+    return current == 0 || (ELF64_ST_BIND(m_symbol_table[current].st_info) == STB_LOCAL &&
+                            ELF64_ST_BIND(m_symbol_table[candidate].st_info) != STB_LOCAL);
+}
+
+std::optional<SymbolResolver::Symbol> SymbolResolver::find_exported(std::string_view name, uint32_t hash) const
+{
+    auto* symbol = m_image.find_symbol(name, hash);
+    if (!symbol || !has_address(*symbol))
+        return {};
+
+    return Symbol{m_image.symbol_name(*symbol), m_image.symbol_address(*symbol), symbol->st_size};
+}
+
+void SymbolResolver::build_name_index()
+{
+    m_has_name_index = true;
+    m_name_index.reserve(m_symbol_table.size());
+
+    for (uint32_t i = 1; i < m_symbol_table.size(); i++)
+    {
+        if (!has_address(m_symbol_table[i]))
+            continue;
+
+        auto [it, inserted] = m_name_index.try_emplace(symbol_table_name(m_symbol_table[i]), i);
+        if (!inserted && is_better_match(it->second, i))
+            it->second = i;
+    }
+}
+
+std::optional<SymbolResolver::Symbol> SymbolResolver::find(std::string_view name)
+{
+    if (auto symbol = find_exported(name, ElfImage::gnu_hash(name)); symbol.has_value())
+        return symbol;
+
+    if (!has_symbol_table())
+        return {};
+
+    if (!m_has_name_index)
+        build_name_index();
+
+    auto it = m_name_index.find(name);
+    if (it == m_name_index.end())
+        return {};
+
+    auto& symbol = m_symbol_table[it->second];
+    return Symbol{it->first, m_base + symbol.st_value, symbol.st_size};
+}
+
+std::vector<std::optional<SymbolResolver::Symbol>> SymbolResolver::find(std::span<const std::string_view> names)
+{
+    std::vector<std::optional<Symbol>> results(names.size());
+    // Names that aren't exported, to the index of their best match in .symtab so far.
+    std::unordered_map<std::string_view, uint32_t, GnuHash> missing;
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        results[i] = find_exported(names[i], ElfImage::gnu_hash(names[i]));
+        if (!results[i].has_value() && has_symbol_table())
+            missing.try_emplace(names[i], 0);
+    }
+
+    if (missing.empty())
+        return results;
+
+    // Building the whole index would take as long as looking for all of them in one pass, so we only use it if it's
+    // already there.
+    if (m_has_name_index)
+    {
+        for (auto& [name, index] : missing)
+        {
+            if (auto it = m_name_index.find(name); it != m_name_index.end())
+                index = it->second;
+        }
+    }
+    else
+    {
+        for (uint32_t i = 1; i < m_symbol_table.size(); i++)
+        {
+            if (!has_address(m_symbol_table[i]))
+                continue;
+
+            auto it = missing.find(symbol_table_name(m_symbol_table[i]));
+            if (it != missing.end() && is_better_match(it->second, i))
+                it->second = i;
+        }
+    }
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (results[i].has_value())
+            continue;
+
+        auto it = missing.find(names[i]);
+        if (it == missing.end() || it->second == 0)
+            continue;
+
+        auto& symbol = m_symbol_table[it->second];
+        results[i] = Symbol{symbol_table_name(symbol), m_base + symbol.st_value, symbol.st_size};
+    }
+
+    return results;
+}
+
+void SymbolResolver::build_address_index()
+{
+    m_has_address_index = true;
+
+    struct Candidate
+    {
+        Symbol symbol;
+        bool is_local{};
+    };
+
+    // Without DT_HASH, counting the symbols walks every GNU hash bucket, so we only do it once.
+    auto dynamic_symbol_count = m_image.symbol_count();
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(dynamic_symbol_count + m_symbol_table.size());
+
+    // Labels (NOTYPE) can be found by name, but they'd hide the functions and objects they're in.
+    auto add = [&](const ElfImage::Symbol& symbol, std::string_view name) {
+        if (!has_address(symbol) || ELF64_ST_TYPE(symbol.st_info) == STT_NOTYPE)
+            return;
+
+        candidates.push_back({{name, m_base + symbol.st_value, symbol.st_size}, ELF64_ST_BIND(symbol.st_info) == STB_LOCAL});
+    };
+
+    for (size_t i = 1; i < dynamic_symbol_count; i++)
+        add(m_image.symbol(i), m_image.symbol_name(m_image.symbol(i)));
+
+    for (size_t i = 1; i < m_symbol_table.size(); i++)
+        add(m_symbol_table[i], symbol_table_name(m_symbol_table[i]));
+
+    // Where several symbols share an address (aliases, or the same symbol in both tables), we keep the largest, and a
+    // global one over a local one. The sort is stable, so exported names win the remaining ties.
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.symbol.address != b.symbol.address)
+            return a.symbol.address < b.symbol.address;
+        if (a.symbol.size != b.symbol.size)
+            return a.symbol.size > b.symbol.size;
+        return !a.is_local && b.is_local;
+    });
+
+    m_address_index.clear();
+    m_address_index.reserve(candidates.size());
+
+    for (auto& candidate : candidates)
+    {
+        if (m_address_index.empty() || m_address_index.back().address != candidate.symbol.address)
+            m_address_index.push_back(candidate.symbol);
+    }
+
+    // Symbols can be nested in others (or alias part of them), so an address past the end of the closest symbol before
+    // it can still be in one that starts earlier. Each symbol remembers the closest one it starts inside of, which is
+    // whatever's left on top of the stack of symbols still open there, and lookups walk back along those.
+    m_enclosing.assign(m_address_index.size(), no_enclosing);
+
+    auto end = [this](size_t index) {
+        return m_address_index[index].address + std::max<size_t>(m_address_index[index].size, 1);
+    };
+
+    std::vector<size_t> open;
+    for (size_t i = 0; i < m_address_index.size(); i++)
+    {
+        while (!open.empty() && end(open.back()) <= m_address_index[i].address)
+            open.pop_back();
+
+        if (!open.empty())
+            m_enclosing[i] = open.back();
+
+        open.push_back(i);
+    }
+}
+
+std::optional<SymbolResolver::Symbol> SymbolResolver::find_by_address(uintptr_t address)
+{
+    if (!m_has_address_index)
+        build_address_index();
+
+    auto it = std::upper_bound(m_address_index.begin(), m_address_index.end(), address,
+                               [](uintptr_t value, const Symbol& symbol) { return value < symbol.address; });
+    if (it == m_address_index.begin())
+        return {};
+
+    // Anything that started before and is still open at the address is somewhere up this chain, closest first.
+    for (auto i = static_cast<size_t>(std::prev(it) - m_address_index.begin()); i != no_enclosing; i = m_enclosing[i])
+    {
+        if (m_address_index[i].contains(address))
+            return m_address_index[i];
+    }
+
+    return {};
+}
+}
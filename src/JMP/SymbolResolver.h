@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ElfImage.h"
+#include "ModuleTable.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace JMP
+{
+// Finds the symbols of a loaded module by name or by address, without going through the loader like dlsym does (so
+// no locks are taken). Exported symbols (.dynsym) are found through the module's GNU hash table. The full symbol
+// table (.symtab), which has the internal symbols dlsym can't see, isn't loaded, so it can be read from the module's
+// file on disk instead.
+//
+// Indices are built the first time they're needed, so this isn't safe to use from multiple threads at once.
+class SymbolResolver
+{
+public:
+    struct Symbol
+    {
+        std::string_view name;
+        // For an IFUNC, this is its resolver rather than what it resolves to.
+        uintptr_t address{};
+        size_t size{};
+
+        bool contains(uintptr_t value) const { return value >= address && value < address + std::max<size_t>(size, 1); }
+    };
+
+    // The module must stay loaded. read_symbol_table maps the module's file to read its .symtab, if it has one, and
+    // throws if the file isn't the one that's loaded.
+    explicit SymbolResolver(const ModuleTable::Module& module, bool read_symbol_table = false);
+    SymbolResolver(const SymbolResolver&) = delete;
+    SymbolResolver& operator=(const SymbolResolver&) = delete;
+    ~SymbolResolver();
+
+    // Exported symbols are preferred over internal ones, which are preferred global over local when names collide.
+    std::optional<Symbol> find(std::string_view name);
+    // Resolves every name at once, in the same order, with a single pass over .symtab for those that aren't exported.
+    std::vector<std::optional<Symbol>> find(std::span<const std::string_view> names);
+
+    // The symbol covering the address, or starting at it for a symbol without a size.
+    std::optional<Symbol> find_by_address(uintptr_t address);
+    std::optional<Symbol> find_by_address(const void* address)
+    {
+        return find_by_address(reinterpret_cast<uintptr_t>(address));
+    }
+
+    bool has_symbol_table() const { return !m_symbol_table.empty(); }
+
+private:
+    struct GnuHash
+    {
+        size_t operator()(std::string_view name) const { return ElfImage::gnu_hash(name); }
+    };
+
+    std::optional<Symbol> find_exported(std::string_view name, uint32_t hash) const;
+    std::string_view symbol_table_name(const ElfImage::Symbol&) const;
+    // Whether a .symtab symbol should be used instead of the one we already have for its name (0 for none).
+    bool is_better_match(uint32_t current, uint32_t candidate) const;
+    void map_symbol_table(const ModuleTable::Module&);
+    void build_name_index();
+    void build_address_index();
+
+    ElfImage m_image;
+    uintptr_t m_base{};
+
+    // The module's file, mapped for as long as we are.
+    std::span<const uint8_t> m_file;
+    std::span<const ElfImage::Symbol> m_symbol_table;
+    std::string_view m_symbol_table_strings;
+
+    // Names from .symtab to their index in it, built on the first lookup that isn't of an exported symbol.
+    std::unordered_map<std::string_view, uint32_t, GnuHash> m_name_index;
+    bool m_has_name_index{};
+    // Every symbol sorted by address, with one per address.
+    std::vector<Symbol> m_address_index;
+    // For each of those, the closest symbol before it that it starts inside of (or no_enclosing).
+    static constexpr size_t no_enclosing = SIZE_MAX;
+    std::vector<size_t> m_enclosing;
+    bool m_has_address_index{};
+};
+}
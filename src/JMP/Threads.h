@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace JMP
+{
+// A thread count that means one thread per core.
+constexpr size_t every_core = 0;
+
+// How many threads to split work_count pieces of work between: as many as were asked for, but never more than there's
+// work for, and always at least one.
+inline size_t resolve_thread_count(size_t thread_count, size_t work_count)
+{
+    if (thread_count == every_core)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    return std::max<size_t>(std::min(thread_count, work_count), 1);
+}
+
+// Runs work(thread_index) on that many threads, including this one, and returns once they're all done.
+template<typename Work>
+void run_on_threads(size_t thread_count, Work work)
+{
+    std::vector<std::jthread> threads;
+    threads.reserve(thread_count - 1);
+
+    for (size_t i = 1; i < thread_count; i++)
+        threads.emplace_back([&, i] { work(i); });
+
+    work(0);
+}
+
+// Calls work(thread_index, index) for every index below count, each handed to whichever thread asks for one next, so
+// pieces of work that take longer than others don't hold everything up.
+template<typename Work>
+void for_each_on_threads(size_t thread_count, size_t count, Work work)
+{
+    std::atomic<size_t> next{};
+
+    run_on_threads(thread_count, [&](size_t thread_index) {
+        for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+             i = next.fetch_add(1, std::memory_order_relaxed))
+            work(thread_index, i);
+    });
+}
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ValueScan.h"
+#include "LargeAllocator.h"
+#include <algorithm>
+#include <cstring>
+
+namespace JMP
+{
+namespace
+{
+template<typename T>
+T decode(uint64_t bits)
+{
+    T value;
+    memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+// A part of a range to scan, as where each value we look at starts.
+struct Chunk
+{
+    const uint8_t* start{};
+    size_t size{};
+};
+
+// Returns how many matches it wrote to offsets, which must have room for one per position.
+using Kernel = size_t (*)(const uint8_t* start, size_t size, uint64_t minimum, uint64_t maximum, uint32_t* offsets);
+
+// Compares a block of values at once into a byte per value, which vectorizes for every type, and only looks at the
+// individual results of blocks that had a match.
+template<typename T, size_t Stride, bool Exact>
+size_t scan_chunk(const uint8_t* start, size_t size, uint64_t minimum_bits, uint64_t maximum_bits, uint32_t* offsets)
+{
+    constexpr size_t block_size = 64;
+
+    auto minimum = decode<T>(minimum_bits);
+    auto maximum = decode<T>(maximum_bits);
+    auto count = (size + Stride - 1) / Stride;
+
+    auto matches = [&](const uint8_t* bytes) -> uint8_t {
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+
+        if constexpr (Exact)
+            return value == minimum;
+        else
+            return (value >= minimum) & (value <= maximum);
+    };
+
+    size_t match_count{};
+    size_t i{};
+    uint8_t hits[block_size];
+
+    for (; i + block_size <= count; i += block_size)
+    {
+        auto* values = start + i * Stride;
+        for (size_t j = 0; j < block_size; j++)
+            hits[j] = matches(values + j * Stride);
+
+        uint64_t any{};
+        for (size_t j = 0; j < block_size; j += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, hits + j, sizeof(word));
+            any |= word;
+        }
+
+        if (!any)
+            continue;
+
+        // Always write the offset, but only keep it if it matched, so there's no branch to mispredict.
+        for (size_t j = 0; j < block_size; j++)
+        {
+            offsets[match_count] = static_cast<uint32_t>((i + j) * Stride);
+            match_count += hits[j];
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        if (matches(start + i * Stride))
+            offsets[match_count++] = static_cast<uint32_t>(i * Stride);
+    }
+
+    return match_count;
+}
+
+template<typename T>
+Kernel kernel_for(bool aligned, bool exact)
+{
+    if (aligned)
+        return exact ? scan_chunk<T, sizeof(T), true> : scan_chunk<T, sizeof(T), false>;
+
+    return exact ? scan_chunk<T, 1, true> : scan_chunk<T, 1, false>;
+}
+
+template<typename T>
+bool matches_value(const uint8_t* bytes, uint64_t minimum, uint64_t maximum)
+{
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value >= decode<T>(minimum) && value <= decode<T>(maximum);
+}
+
+std::vector<Chunk> plan_chunks(std::span<const std::span<const uint8_t>> ranges, size_t value_size, size_t alignment)
+{
+    std::vector<Chunk> chunks;
+
+    for (auto range : ranges)
+    {
+        if (range.size() < value_size)
+            continue;
+
+        auto start = reinterpret_cast<uintptr_t>(range.data());
+        auto first = (start + alignment - 1) & ~(alignment - 1);
+        // Positions past this would read beyond the range.
+        auto end = start + range.size() - value_size + 1;
+
+        for (auto position = first; position < end; position += ValueScan::chunk_size)
+        {
+            auto size = std::min<size_t>(end - position, ValueScan::chunk_size);
+            chunks.push_back({reinterpret_cast<const uint8_t*>(position), size});
+        }
+    }
+
+    return chunks;
+}
+}
+
+size_t ValueScan::size_of(Type type)
+{
+    switch (type)
+    {
+        case Type::U8:
+        case Type::I8:
+            return 1;
+        case Type::U16:
+        case Type::I16:
+            return 2;
+        case Type::U32:
+        case Type::I32:
+        case Type::F32:
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+bool ValueScan::matches(const uint8_t* bytes) const
+{
+    switch (m_type)
+    {
+        case Type::U8:
+            return matches_value<uint8_t>(bytes, m_minimum, m_maximum);
+        case Type::U16:
+            return matches_value<uint16_t>(bytes, m_minimum, m_maximum);
+        case Type::U32:
+            return matches_value<uint32_t>(bytes, m_minimum, m_maximum);
+        case Type::U64:
+            return matches_value<uint64_t>(bytes, m_minimum, m_maximum);
+        case Type::I8:
+            return matches_value<int8_t>(bytes, m_minimum, m_maximum);
+        case Type::I16:
+            return matches_value<int16_t>(bytes, m_minimum, m_maximum);
+        case Type::I32:
+            return matches_value<int32_t>(bytes, m_minimum, m_maximum);
+        case Type::I64:
+            return matches_value<int64_t>(bytes, m_minimum, m_maximum);
+        case Type::F32:
+            return matches_value<float>(bytes, m_minimum, m_maximum);
+        case Type::F64:
+            return matches_value<double>(bytes, m_minimum, m_maximum);
+    }
+
+    return false;
+}
+
+ValueScan::Results ValueScan::scan(std::span<const uint8_t> bytes) const { return scan(std::span(&bytes, 1)); }
+
+ValueScan::Results ValueScan::scan(const MemoryMap& memory_map, const MemoryMap::Filter& filter) const
+{
+    std::vector<std::span<const uint8_t>> ranges;
+    memory_map.for_each_matching(filter, [&](const MemoryMap::Region& region) { ranges.push_back(region.bytes()); });
+
+    return scan(ranges);
+}
+
+ValueScan::Results ValueScan::scan(std::span<const std::span<const uint8_t>> ranges) const
+{
+    // Values are still compared as their type, so an exact float matches -0 and 0 alike.
+    auto exact = m_minimum == m_maximum;
+
+    Kernel kernel{};
+    switch (m_type)
+    {
+        case Type::U8:
+            kernel = kernel_for<uint8_t>(m_aligned, exact);
+            break;
+        case Type::U16:
+            kernel = kernel_for<uint16_t>(m_aligned, exact);
+            break;
+        case Type::U32:
+            kernel = kernel_for<uint32_t>(m_aligned, exact);
+            break;
+        case Type::U64:
+            kernel = kernel_for<uint64_t>(m_aligned, exact);
+            break;
+        case Type::I8:
+            kernel = kernel_for<int8_t>(m_aligned, exact);
+            break;
+        case Type::I16:
+            kernel = kernel_for<int16_t>(m_aligned, exact);
+            break;
+        case Type::I32:
+            kernel = kernel_for<int32_t>(m_aligned, exact);
+            break;
+        case Type::I64:
+            kernel = kernel_for<int64_t>(m_aligned, exact);
+            break;
+        case Type::F32:
+            kernel = kernel_for<float>(m_aligned, exact);
+            break;
+        case Type::F64:
+            kernel = kernel_for<double>(m_aligned, exact);
+            break;
+    }
+
+    auto stride = m_aligned ? value_size() : 1;
+    auto chunks = plan_chunks(ranges, value_size(), stride);
+
+    auto thread_count = resolve_thread_count(m_thread_count, chunks.size());
+
+    // Everything we need is allocated up front, and nothing is freed until every thread is done. Freeing could trim the
+    // heap (or a thread's arena), and then we'd fault scanning what we just gave back.
+    std::vector<std::vector<uint32_t>> chunk_offsets(chunks.size());
+    std::vector<std::vector<uint32_t, LargeAllocator<uint32_t>>> scratch(
+        thread_count, std::vector<uint32_t, LargeAllocator<uint32_t>>(chunk_size / stride));
+
+    for_each_on_threads(thread_count, chunks.size(), [&](size_t thread_index, size_t i) {
+        auto& offsets = scratch[thread_index];
+        auto count = kernel(chunks[i].start, chunks[i].size, m_minimum, m_maximum, offsets.data());
+        if (count)
+            chunk_offsets[i].assign(offsets.begin(), offsets.begin() + count);
+    });
+
+    Results results;
+    size_t total{};
+    for (auto& offsets : chunk_offsets)
+        total += offsets.size();
+
+    results.offsets.reserve(total);
+
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        if (chunk_offsets[i].empty())
+            continue;
+
+        results.blocks.push_back({reinterpret_cast<uintptr_t>(chunks[i].start), results.offsets.size()});
+        results.offsets.insert(results.offsets.end(), chunk_offsets[i].begin(), chunk_offsets[i].end());
+    }
+
+    return results;
+}
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "MemoryMap.h"
+#include "Threads.h"
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace JMP
+{
+// Finds every value of a type that's equal to (or within a range of) what we're looking for, like "every int32 that's
+// 1337" or "every float within 0.01 of 3.5".
+//
+//     auto results = ValueScan::near(3.5f, 0.01f).scan(MemoryMap::self());
+//     results.for_each([](uintptr_t address) { ... });
+//
+// Memory is split into chunks that are scanned in parallel, each block of values compared at once (which the compiler
+// turns into SIMD), so a block without a match costs a few instructions per value.
+class ValueScan
+{
+public:
+    enum class Type : uint8_t
+    {
+        U8,
+        U16,
+        U32,
+        U64,
+        I8,
+        I16,
+        I32,
+        I64,
+        F32,
+        F64
+    };
+
+    // Every match as an offset from the start of the chunk it was found in, which is half the size of a pointer.
+    struct Results
+    {
+        struct Block
+        {
+            uintptr_t base{};
+            // Where the block's offsets start in offsets, they end where the next block's do.
+            size_t first_offset{};
+        };
+
+        std::vector<Block> blocks;
+        std::vector<uint32_t> offsets;
+
+        size_t size() const { return offsets.size(); }
+        bool empty() const { return offsets.empty(); }
+
+        std::span<const uint32_t> offsets_of(size_t block) const
+        {
+            auto end = block + 1 < blocks.size() ? blocks[block + 1].first_offset : offsets.size();
+            return std::span(offsets).subspan(blocks[block].first_offset, end - blocks[block].first_offset);
+        }
+
+        template<typename Callback>
+        void for_each(Callback callback) const
+        {
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                for (auto offset : offsets_of(i))
+                    callback(blocks[i].base + offset);
+            }
+        }
+    };
+
+    // How much of a region one thread scans at a time, and the most a block of results covers.
+    static constexpr size_t chunk_size = 1024 * 1024;
+
+    template<typename T>
+    static ValueScan equal_to(T value)
+    {
+        return {type_of<T>(), encode(value), encode(value)};
+    }
+
+    // Both ends are included.
+    template<typename T>
+    static ValueScan between(T minimum, T maximum)
+    {
+        return {type_of<T>(), encode(minimum), encode(maximum)};
+    }
+
+    template<std::floating_point T>
+    static ValueScan near(T value, T epsilon)
+    {
+        return between<T>(value - epsilon, value + epsilon);
+    }
+
+    // Whether to only look at addresses that are a multiple of the type's size, which is where the compiler puts
+    // values. On by default, and much faster.
+    ValueScan& set_aligned(bool aligned)
+    {
+        m_aligned = aligned;
+        return *this;
+    }
+
+    ValueScan& set_thread_count(size_t thread_count)
+    {
+        m_thread_count = thread_count;
+        return *this;
+    }
+
+    template<typename T>
+    static constexpr Type type_of()
+    {
+        if constexpr (std::same_as<T, uint8_t>)
+            return Type::U8;
+        else if constexpr (std::same_as<T, uint16_t>)
+            return Type::U16;
+        else if constexpr (std::same_as<T, uint32_t>)
+            return Type::U32;
+        else if constexpr (std::same_as<T, uint64_t>)
+            return Type::U64;
+        else if constexpr (std::same_as<T, int8_t>)
+            return Type::I8;
+        else if constexpr (std::same_as<T, int16_t>)
+            return Type::I16;
+        else if constexpr (std::same_as<T, int32_t>)
+            return Type::I32;
+        else if constexpr (std::same_as<T, int64_t>)
+            return Type::I64;
+        else if constexpr (std::same_as<T, float>)
+            return Type::F32;
+        else
+        {
+            static_assert(std::same_as<T, double>, "Unsupported value type");
+            return Type::F64;
+        }
+    }
+
+    // Values are kept as their bits, zero-extended to 64.
+    template<typename T>
+    static uint64_t encode(T value)
+    {
+        if constexpr (sizeof(T) == 1)
+            return std::bit_cast<uint8_t>(value);
+        else if constexpr (sizeof(T) == 2)
+            return std::bit_cast<uint16_t>(value);
+        else if constexpr (sizeof(T) == 4)
+            return std::bit_cast<uint32_t>(value);
+        else
+            return std::bit_cast<uint64_t>(value);
+    }
+
+    static size_t size_of(Type);
+
+    Type type() const { return m_type; }
+    size_t value_size() const { return size_of(m_type); }
+    bool is_aligned() const { return m_aligned; }
+
+    // Whether the value at bytes (of value_size() bytes, not necessarily aligned) matches.
+    bool matches(const uint8_t* bytes) const;
+
+    Results scan(std::span<const uint8_t> bytes) const;
+    Results scan(std::span<const std::span<const uint8_t>> ranges) const;
+
+    // Scans our own memory. Only regions that are readable and writable are scanned by default, which is where values
+    // that change live. Everything scanned must stay mapped until the scan is done. We never free anything while
+    // scanning, so our own allocations can't shrink the heap from under us.
+    Results scan(const MemoryMap&, const MemoryMap::Filter& = {{true, true, false}, {}}) const;
+
+private:
+    ValueScan(Type type, uint64_t minimum, uint64_t maximum) : m_type(type), m_minimum(minimum), m_maximum(maximum) {}
+
+    Type m_type{};
+    uint64_t m_minimum{};
+    uint64_t m_maximum{};
+    bool m_aligned{true};
+    size_t m_thread_count{every_core};
+};
+}
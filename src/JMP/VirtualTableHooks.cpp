@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "VirtualTableHooks.h"
+#include "ProtectionTransaction.h"
+#include <atomic>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace JMP
+{
+VirtualTableHooks::~VirtualTableHooks()
+{
+    try
+    {
+        uninstall_all();
+    }
+    catch (...)
+    {
+        // The vtables couldn't be made writable again (their module is gone, most likely), so there's nothing to put
+        // back.
+    }
+}
+
+std::vector<void*> VirtualTableHooks::install(std::span<const Request> requests)
+{
+    std::unordered_set<uintptr_t> slots;
+    ProtectionTransaction transaction;
+
+    for (auto& request : requests)
+    {
+        auto address = reinterpret_cast<uintptr_t>(request.slot.address());
+        if (m_hooks.contains(address) || !slots.insert(address).second)
+            throw std::invalid_argument("Virtual function is already hooked");
+
+        transaction.add({reinterpret_cast<uint8_t*>(address), sizeof(void*)}, {true, true, false});
+    }
+
+    std::vector<void*> originals;
+    originals.reserve(requests.size());
+
+    auto restore_protection = transaction.apply();
+
+    for (auto& request : requests)
+    {
+        Hook hook;
+        hook.replacement = reinterpret_cast<uintptr_t>(request.replacement);
+        hook.original = std::atomic_ref(*reinterpret_cast<uintptr_t*>(request.slot.address()))
+                            .exchange(hook.replacement, std::memory_order_acq_rel);
+
+        originals.push_back(reinterpret_cast<void*>(hook.original));
+        m_hooks.emplace(reinterpret_cast<uintptr_t>(request.slot.address()), hook);
+    }
+
+    return originals;
+}
+
+void* VirtualTableHooks::install(Slot slot, const void* replacement)
+{
+    Request request{slot, replacement};
+    return install(std::span(&request, 1)).front();
+}
+
+void VirtualTableHooks::uninstall(std::span<const Slot> slots)
+{
+    std::unordered_set<uintptr_t> addresses;
+    ProtectionTransaction transaction;
+
+    for (auto& slot : slots)
+    {
+        if (!is_installed(slot))
+            throw std::invalid_argument("Unable to uninstall hook that isn't installed");
+
+        if (!addresses.insert(reinterpret_cast<uintptr_t>(slot.address())).second)
+            throw std::invalid_argument("Unable to uninstall the same hook twice");
+
+        transaction.add({reinterpret_cast<uint8_t*>(slot.address()), sizeof(void*)}, {true, true, false});
+    }
+
+    auto restore_protection = transaction.apply();
+
+    for (auto& slot : slots)
+    {
+        auto it = m_hooks.find(reinterpret_cast<uintptr_t>(slot.address()));
+        auto expected = it->second.replacement;
+        std::atomic_ref(*reinterpret_cast<uintptr_t*>(slot.address()))
+            .compare_exchange_strong(expected, it->second.original, std::memory_order_acq_rel);
+
+        m_hooks.erase(it);
+    }
+}
+
+void VirtualTableHooks::uninstall(Slot slot) { uninstall(std::span(&slot, 1)); }
+
+void VirtualTableHooks::uninstall_all()
+{
+    std::vector<Slot> slots;
+    slots.reserve(m_hooks.size());
+
+    for (auto& [address, hook] : m_hooks)
+        slots.push_back({reinterpret_cast<void**>(address), 0});
+
+    if (!slots.empty())
+        uninstall(slots);
+}
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace JMP
+{
+// Hooks virtual functions by patching their slots in the vtable itself, which every object of that class shares.
+// Vtables are read-only after relocation, so each batch of installs (or uninstalls) changes protection once, however
+// many slots (and tables) it touches. Slots are swapped atomically, so a thread making a virtual call sees either the
+// old or the new function.
+//
+// To hook a single object, without changing protection at all, use ShadowVirtualTable instead.
+class VirtualTableHooks
+{
+public:
+    struct Slot
+    {
+        // What an object's vtable pointer points to (the first virtual function), not the start of the vtable.
+        void** table{};
+        size_t index{};
+
+        void** address() const { return table + index; }
+    };
+
+    struct Request
+    {
+        Slot slot;
+        const void* replacement{};
+    };
+
+    // The vtable pointer of a polymorphic object, assuming it's at the start of the object as both ABIs put it.
+    static void** table_of(const void* object) { return *static_cast<void** const*>(object); }
+
+    VirtualTableHooks() = default;
+    VirtualTableHooks(const VirtualTableHooks&) = delete;
+    VirtualTableHooks& operator=(const VirtualTableHooks&) = delete;
+    ~VirtualTableHooks();
+
+    // Returns what each slot had before (to call the original), in the same order as the requests.
+    std::vector<void*> install(std::span<const Request> requests);
+    void* install(Slot slot, const void* replacement);
+
+    // A slot that someone else has changed since we hooked it is left alone.
+    void uninstall(std::span<const Slot> slots);
+    void uninstall(Slot slot);
+    void uninstall_all();
+
+    bool is_installed(Slot slot) const { return m_hooks.contains(reinterpret_cast<uintptr_t>(slot.address())); }
+
+private:
+    struct Hook
+    {
+        uintptr_t original{};
+        uintptr_t replacement{};
+    };
+
+    // Keyed by the address of the slot.
+    std::unordered_map<uintptr_t, Hook> m_hooks;
+};
+}
@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "WatchPoints.h"
+#include "MemoryMap.h"
+#include "Platform.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <thread>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace JMP
+{
+namespace
+{
+// Threads that can be letting a write through at once.
+constexpr size_t max_steps = 64;
+// Pages one instruction can write to, like a write across a page boundary.
+constexpr size_t max_step_pages = 4;
+
+struct sigaction previous_fault_action;
+struct sigaction previous_trap_action;
+
+#if defined(__x86_64__)
+// The trap flag, which traps after the next instruction.
+constexpr greg_t trap_flag = 0x100;
+
+uintptr_t instruction_pointer(void* context)
+{
+    return static_cast<uintptr_t>(static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_RIP]);
+}
+
+void set_trap_flag(void* context, bool trap)
+{
+    auto& flags = static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_EFL];
+    flags = trap ? flags | trap_flag : flags & ~trap_flag;
+}
+#else
+// Nothing else has a trap flag to step a single instruction with, and the constructor throws before either could run.
+uintptr_t instruction_pointer(void*) { return 0; }
+void set_trap_flag(void*, bool) {}
+#endif
+
+pid_t current_thread() { return static_cast<pid_t>(syscall(SYS_gettid)); }
+
+uint64_t now_in_nanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(now.tv_nsec);
+}
+
+Platform::MemoryProtection without_write(Platform::MemoryProtection protection)
+{
+    protection.write = false;
+    return protection;
+}
+
+// Does whatever would've happened without us.
+void pass_on(int signal, siginfo_t* info, void* context, const struct sigaction& previous)
+{
+    if (previous.sa_flags & SA_SIGINFO)
+    {
+        previous.sa_sigaction(signal, info, context);
+        return;
+    }
+
+    if (previous.sa_handler == SIG_IGN)
+        return;
+
+    if (previous.sa_handler != SIG_DFL)
+    {
+        previous.sa_handler(signal);
+        return;
+    }
+
+    // The signal is blocked until we return, and then it's delivered to the default action.
+    sigaction(signal, &previous, nullptr);
+    raise(signal);
+}
+}
+
+struct WatchPoints::State
+{
+    struct Watch
+    {
+        std::atomic<uintptr_t> start;
+        std::atomic<size_t> size;
+        // To tell that a write starting before the watch changed it.
+        std::atomic<uint64_t> last_value;
+    };
+
+    enum class PageState : uint32_t
+    {
+        Free,
+        Armed,
+        // Too hot, and left unprotected until the window is over.
+        Cooling,
+        // Being unwatched, and not to be protected again.
+        Disarmed
+    };
+
+    struct Page
+    {
+        std::atomic<uintptr_t> address;
+        std::atomic<PageState> state;
+        Platform::MemoryProtection protection;
+        // Only touched outside of the handlers.
+        size_t watch_count;
+        std::atomic<uint64_t> window_start;
+        std::atomic<size_t> window_hits;
+    };
+
+    // A write being let through, between the fault and the trap after it.
+    struct Step
+    {
+        std::atomic<pid_t> thread;
+        // Every page the instruction faulted on, which are all unprotected until the trap.
+        size_t pages[max_step_pages];
+        size_t page_count;
+        uintptr_t address;
+        uintptr_t instruction;
+    };
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        Hit hit;
+    };
+
+    size_t page_size{};
+    size_t max_hits_per_window{};
+    uint64_t window{};
+
+    Watch watches[max_watches];
+    Page pages[max_pages];
+    Step steps[max_steps];
+
+    // Signals between a fault and its trap, which a page being unwatched has to wait out.
+    std::atomic<size_t> in_flight;
+    std::atomic<size_t> dropped;
+    std::atomic<size_t> coalesced;
+
+    // A bounded queue with many producers (any faulting thread) and one consumer (collect): each slot's sequence says
+    // whether it's ready to be written or read, so neither side ever waits for the other.
+    size_t capacity{};
+    std::atomic<size_t> tail;
+    size_t head{};
+    Slot* slots{};
+
+    // The index of the page if it's watched, or max_pages if it isn't.
+    size_t find_page(uintptr_t address) const
+    {
+        for (size_t i = 0; i < max_pages; i++)
+        {
+            if (pages[i].address.load(std::memory_order_acquire) == address &&
+                pages[i].state.load(std::memory_order_acquire) != PageState::Free)
+                return i;
+        }
+
+        return max_pages;
+    }
+
+    // Protects the page again after a step, unless it's been too hot this window.
+    void rearm(Page& page, uint64_t now)
+    {
+        // Start a new window if this one is over. Two threads can both do so at once, which only costs a few hits.
+        if (now - page.window_start.load(std::memory_order_relaxed) >= window)
+        {
+            page.window_start.store(now, std::memory_order_relaxed);
+            page.window_hits.store(0, std::memory_order_relaxed);
+        }
+
+        if (page.window_hits.fetch_add(1, std::memory_order_relaxed) + 1 > max_hits_per_window)
+        {
+            auto expected = PageState::Armed;
+            if (page.state.compare_exchange_strong(expected, PageState::Cooling, std::memory_order_acq_rel))
+                coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (page.state.load(std::memory_order_acquire) == PageState::Armed)
+        {
+            auto* address = reinterpret_cast<uint8_t*>(page.address.load(std::memory_order_relaxed));
+            (void)Platform::try_modify_memory_protection({address, page_size}, without_write(page.protection));
+        }
+    }
+
+    void push(const Hit& hit)
+    {
+        auto position = tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto& slot = slots[position & (capacity - 1)];
+            auto difference = static_cast<intptr_t>(slot.sequence.load(std::memory_order_acquire) - position);
+
+            if (difference < 0)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            if (difference == 0 && tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                slot.hit = hit;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+
+            if (difference > 0)
+                position = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool pop(Hit& hit)
+    {
+        auto& slot = slots[head & (capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+
+        hit = slot.hit;
+        slot.sequence.store(head + capacity, std::memory_order_release);
+        head++;
+        return true;
+    }
+};
+
+std::atomic<WatchPoints::State*> WatchPoints::s_state;
+
+bool WatchPoints::is_supported()
+{
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+WatchPoints::WatchPoints(const Limits& limits)
+{
+    if (!is_supported())
+        throw std::runtime_error("Watch points are only supported on x86-64");
+
+    if (limits.ring_capacity == 0 || (limits.ring_capacity & (limits.ring_capacity - 1)))
+        throw std::invalid_argument("Ring capacity must be a power of two");
+
+    State* expected{};
+    auto size = sizeof(State) + limits.ring_capacity * sizeof(State::Slot);
+    auto allocation = Platform::allocate_large(size, {false, false});
+
+    m_mapping = allocation.bytes;
+    m_state = new (m_mapping.data()) State();
+    m_state->page_size = Platform::page_size();
+    m_state->max_hits_per_window = limits.max_hits_per_window;
+    m_state->window = std::chrono::duration_cast<std::chrono::nanoseconds>(limits.window).count();
+    m_state->capacity = limits.ring_capacity;
+    m_state->slots = reinterpret_cast<State::Slot*>(m_mapping.data() + sizeof(State));
+
+    for (size_t i = 0; i < limits.ring_capacity; i++)
+        new (&m_state->slots[i]) State::Slot{i, {}};
+
+    if (!s_state.compare_exchange_strong(expected, m_state, std::memory_order_acq_rel))
+    {
+        Platform::free_large(m_mapping);
+        throw std::runtime_error("Only one WatchPoints can exist at a time");
+    }
+
+    struct sigaction action{};
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+
+    action.sa_sigaction = [](int signal, siginfo_t* info, void* context) {
+        auto* state = s_state.load(std::memory_order_acquire);
+        if (state && info->si_code == SEGV_ACCERR &&
+            handle_fault(*state, reinterpret_cast<uintptr_t>(info->si_addr), context))
+            return;
+
+        pass_on(signal, info, context, previous_fault_action);
+    };
+    sigaction(SIGSEGV, &action, &previous_fault_action);
+
+    action.sa_sigaction = [](int signal, siginfo_t* info, void* context) {
+        auto* state = s_state.load(std::memory_order_acquire);
+        if (state && handle_trap(*state, context))
+            return;
+
+        pass_on(signal, info, context, previous_trap_action);
+    };
+    sigaction(SIGTRAP, &action, &previous_trap_action);
+}
+
+WatchPoints::~WatchPoints()
+{
+    for (auto& watch : m_state->watches)
+    {
+        if (auto start = watch.start.load(std::memory_order_relaxed))
+            unwatch(start);
+    }
+
+    // Nothing is protected anymore, so no signal can be ours from here on.
+    sigaction(SIGSEGV, &previous_fault_action, nullptr);
+    sigaction(SIGTRAP, &previous_trap_action, nullptr);
+    s_state.store(nullptr, std::memory_order_release);
+
+    Platform::free_large(m_mapping);
+}
+
+bool WatchPoints::handle_fault(State& state, uintptr_t address, void* context)
+{
+    auto page_address = address & ~(state.page_size - 1);
+
+    auto page_index = state.find_page(page_address);
+    if (page_index == max_pages)
+        return false;
+
+    auto& page = state.pages[page_index];
+    auto thread = current_thread();
+
+    // A thread can fault again while stepping, if another thread protected the page again in between, or if its write
+    // crosses into another watched page. It's still the same step.
+    State::Step* step{};
+    for (auto& candidate : state.steps)
+    {
+        if (candidate.thread.load(std::memory_order_relaxed) == thread)
+        {
+            step = &candidate;
+            break;
+        }
+    }
+
+    if (!step)
+    {
+        for (auto& candidate : state.steps)
+        {
+            pid_t expected{};
+            if (candidate.thread.compare_exchange_strong(expected, thread, std::memory_order_acquire))
+            {
+                step = &candidate;
+                step->page_count = 0;
+                state.in_flight.fetch_add(1, std::memory_order_acq_rel);
+                break;
+            }
+        }
+    }
+
+    auto* pages_end = step ? step->pages + step->page_count : nullptr;
+    auto new_page = step && std::find(step->pages, pages_end, page_index) == pages_end;
+
+    // Too many threads writing at once (or one writing to too many pages), so treat the page as too hot to keep
+    // protected.
+    if (!step || (new_page && step->page_count == max_step_pages))
+    {
+        auto expected = State::PageState::Armed;
+        if (page.state.compare_exchange_strong(expected, State::PageState::Cooling, std::memory_order_acq_rel))
+            state.coalesced.fetch_add(1, std::memory_order_relaxed);
+
+        (void)Platform::try_modify_memory_protection({reinterpret_cast<uint8_t*>(page_address), state.page_size},
+                                                     page.protection);
+        return true;
+    }
+
+    if (step->page_count == 0)
+    {
+        step->address = address;
+        step->instruction = instruction_pointer(context);
+    }
+
+    if (new_page)
+        step->pages[step->page_count++] = page_index;
+
+    (void)Platform::try_modify_memory_protection({reinterpret_cast<uint8_t*>(page_address), state.page_size},
+                                                 page.protection);
+    set_trap_flag(context, true);
+    return true;
+}
+
+bool WatchPoints::handle_trap(State& state, void* context)
+{
+    auto thread = current_thread();
+
+    State::Step* step{};
+    for (auto& candidate : state.steps)
+    {
+        if (candidate.thread.load(std::memory_order_relaxed) == thread)
+        {
+            step = &candidate;
+            break;
+        }
+    }
+
+    if (!step)
+        return false;
+
+    set_trap_flag(context, false);
+
+    auto on_stepped_page = [&](uintptr_t start, size_t size) {
+        for (size_t i = 0; i < step->page_count; i++)
+        {
+            auto page_address = state.pages[step->pages[i]].address.load(std::memory_order_relaxed);
+            if (start < page_address + state.page_size && start + size > page_address)
+                return true;
+        }
+
+        return false;
+    };
+
+    for (auto& watch : state.watches)
+    {
+        auto start = watch.start.load(std::memory_order_acquire);
+        auto size = watch.size.load(std::memory_order_relaxed);
+        if (!start || !on_stepped_page(start, size))
+            continue;
+
+        uint64_t value{};
+        memcpy(&value, reinterpret_cast<const void*>(start), std::min(size, sizeof(value)));
+        auto last_value = watch.last_value.exchange(value, std::memory_order_relaxed);
+
+        if ((step->address >= start && step->address < start + size) || value != last_value)
+            state.push({step->address, step->instruction, start, value, thread});
+    }
+
+    auto now = now_in_nanoseconds();
+    for (size_t i = 0; i < step->page_count; i++)
+        state.rearm(state.pages[step->pages[i]], now);
+
+    step->thread.store(0, std::memory_order_release);
+    state.in_flight.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+void WatchPoints::protect_page(size_t index)
+{
+    auto& page = m_state->pages[index];
+    Platform::modify_memory_protection(
+        {reinterpret_cast<uint8_t*>(page.address.load(std::memory_order_relaxed)), m_state->page_size},
+        without_write(page.protection));
+}
+
+void WatchPoints::release_page(size_t index)
+{
+    auto& page = m_state->pages[index];
+    if (--page.watch_count)
+        return;
+
+    // A thread between its fault and its trap could still protect the page again, so we wait for it to be done.
+    page.state.store(State::PageState::Disarmed, std::memory_order_release);
+    while (m_state->in_flight.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+    // Also runs from the destructor, and while unwinding from watch(), so failing to give the page its write access
+    // back can't throw.
+    auto* address = reinterpret_cast<uint8_t*>(page.address.load(std::memory_order_relaxed));
+    (void)Platform::try_modify_memory_protection({address, m_state->page_size}, page.protection);
+    page.address.store(0, std::memory_order_relaxed);
+    page.state.store(State::PageState::Free, std::memory_order_release);
+}
+
+void WatchPoints::watch(uintptr_t address, size_t size)
+{
+    if (size == 0)
+        throw std::invalid_argument("Watch is empty");
+
+    auto mapping_start = reinterpret_cast<uintptr_t>(m_mapping.data());
+    if (address < mapping_start + m_mapping.size() && address + size > mapping_start)
+        throw std::invalid_argument("Can't watch our own state");
+
+    auto watch = std::find_if(std::begin(m_state->watches), std::end(m_state->watches),
+                              [](const State::Watch& watch) { return !watch.start.load(std::memory_order_relaxed); });
+    if (watch == std::end(m_state->watches))
+        throw std::runtime_error("Too many watches");
+
+    auto memory_map = MemoryMap::self();
+    auto page_size = m_state->page_size;
+    auto first_page = address & ~(page_size - 1);
+    auto last_page = (address + size - 1) & ~(page_size - 1);
+
+    std::vector<size_t> added;
+    try
+    {
+        for (auto page_address = first_page; page_address <= last_page; page_address += page_size)
+        {
+            if (auto existing = m_state->find_page(page_address); existing != max_pages)
+            {
+                m_state->pages[existing].watch_count++;
+                added.push_back(existing);
+                continue;
+            }
+
+            auto* region = memory_map.find(page_address);
+            if (!region || !region->protection.write)
+                throw std::invalid_argument("Watched memory isn't writable");
+
+            auto* page = std::find_if(std::begin(m_state->pages), std::end(m_state->pages),
+                                      [](const State::Page& page) { return page.state == State::PageState::Free; });
+            if (page == std::end(m_state->pages))
+                throw std::runtime_error("Too many watched pages");
+
+            page->protection = region->protection;
+            page->watch_count = 1;
+            page->window_start.store(now_in_nanoseconds(), std::memory_order_relaxed);
+            page->window_hits.store(0, std::memory_order_relaxed);
+            page->address.store(page_address, std::memory_order_relaxed);
+            page->state.store(State::PageState::Armed, std::memory_order_release);
+            added.push_back(page - m_state->pages);
+
+            protect_page(page - m_state->pages);
+        }
+    }
+    catch (...)
+    {
+        for (auto index : added)
+            release_page(index);
+
+        throw;
+    }
+
+    uint64_t value{};
+    memcpy(&value, reinterpret_cast<const void*>(address), std::min(size, sizeof(value)));
+    watch->last_value.store(value, std::memory_order_relaxed);
+    watch->size.store(size, std::memory_order_relaxed);
+    watch->start.store(address, std::memory_order_release);
+}
+
+void WatchPoints::unwatch(uintptr_t address)
+{
+    auto watch = std::find_if(std::begin(m_state->watches), std::end(m_state->watches), [&](const State::Watch& watch) {
+        return watch.start.load(std::memory_order_relaxed) == address;
+    });
+    if (watch == std::end(m_state->watches))
+        throw std::invalid_argument("Address isn't watched");
+
+    auto size = watch->size.load(std::memory_order_relaxed);
+    watch->start.store(0, std::memory_order_release);
+
+    auto page_size = m_state->page_size;
+    auto last_page = (address + size - 1) & ~(page_size - 1);
+    for (auto page_address = address & ~(page_size - 1); page_address <= last_page; page_address += page_size)
+    {
+        if (auto index = m_state->find_page(page_address); index != max_pages)
+            release_page(index);
+    }
+}
+
+std::vector<WatchPoints::Hit> WatchPoints::collect()
+{
+    std::vector<Hit> hits;
+    Hit hit;
+    while (m_state->pop(hit))
+        hits.push_back(hit);
+
+    auto now = now_in_nanoseconds();
+    for (size_t i = 0; i < max_pages; i++)
+    {
+        auto& page = m_state->pages[i];
+        if (page.state.load(std::memory_order_acquire) != State::PageState::Cooling ||
+            now - page.window_start.load(std::memory_order_relaxed) < m_state->window)
+            continue;
+
+        page.window_start.store(now, std::memory_order_relaxed);
+        page.window_hits.store(0, std::memory_order_relaxed);
+
+        auto expected = State::PageState::Cooling;
+        if (page.state.compare_exchange_strong(expected, State::PageState::Armed, std::memory_order_acq_rel))
+            protect_page(i);
+    }
+
+    return hits;
+}
+
+size_t WatchPoints::dropped() const { return m_state->dropped.load(std::memory_order_relaxed); }
+
+size_t WatchPoints::coalesced() const { return m_state->coalesced.load(std::memory_order_relaxed); }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <sys/types.h>
+#include <vector>
+
+namespace JMP
+{
+// Finds out what writes to memory of our own process, without polling it: the pages being watched are write protected,
+// and each write faults. We record where and what wrote, let the write through by single-stepping the writing
+// instruction with the page unprotected, and protect the page again.
+//
+//     WatchPoints watch_points;
+//     watch_points.watch(reinterpret_cast<uintptr_t>(&player->health), sizeof(player->health));
+//     // ... later
+//     for (auto& hit : watch_points.collect())
+//         printf("%#lx wrote %lu\n", hit.instruction, hit.value);
+//
+// Every write to a watched page costs a fault and a trap, whether it's to what we watch or not. A page written to more
+// than max_hits_per_window times in a window is left unprotected until the window is over, so a hot page costs a
+// bounded amount, and what's written to it while it cools down is missed. So is what another thread writes to a page
+// while one thread's write to it is being let through.
+//
+// Only one can exist at a time, as it takes over SIGSEGV and SIGTRAP (passing on what isn't ours to whatever handled
+// them before). Don't watch a thread's stack, as the kernel can't deliver a signal onto a protected stack. The kernel
+// doesn't fault writing to protected memory for a syscall either, it fails the syscall with EFAULT instead.
+//
+// x86-64 only, as letting a write through takes the trap flag.
+class WatchPoints
+{
+public:
+    struct Hit
+    {
+        // Where the write was, which can be outside of what we watch for a write that overlaps it.
+        uintptr_t address{};
+        // The instruction that wrote.
+        uintptr_t instruction{};
+        // The start of the watch it hit.
+        uintptr_t watch{};
+        // The first (up to) eight bytes of the watch, after the write.
+        uint64_t value{};
+        pid_t thread{};
+    };
+
+    struct Limits
+    {
+        size_t max_hits_per_window{64};
+        std::chrono::milliseconds window{10};
+        // Hits that come in while the ring is full are dropped (and counted), so collect often enough.
+        size_t ring_capacity{1 << 16};
+    };
+
+    static constexpr size_t max_watches = 64;
+    static constexpr size_t max_pages = 256;
+
+    WatchPoints() : WatchPoints(Limits()) {}
+    explicit WatchPoints(const Limits&);
+    ~WatchPoints();
+
+    WatchPoints(const WatchPoints&) = delete;
+    WatchPoints& operator=(const WatchPoints&) = delete;
+
+    static bool is_supported();
+
+    // The memory must be writable, and stays write protected until it's no longer watched.
+    void watch(uintptr_t address, size_t size);
+    void unwatch(uintptr_t address);
+
+    // Takes every hit since the last call, in the order they were recorded, and protects the pages that have cooled
+    // down again.
+    std::vector<Hit> collect();
+
+    // Hits that didn't fit in the ring.
+    size_t dropped() const;
+    // How many times a page was too hot, and left unprotected until its window was over.
+    size_t coalesced() const;
+
+private:
+    struct State;
+
+    // The handlers are for the whole process, so they find us through here.
+    static std::atomic<State*> s_state;
+
+    // Return whether the signal was ours.
+    static bool handle_fault(State&, uintptr_t address, void* context);
+    static bool handle_trap(State&, void* context);
+
+    void protect_page(size_t index);
+    void release_page(size_t index);
+
+    State* m_state{};
+    // Everything the handlers touch is in here, on pages of its own, so it can never share a page with what's watched.
+    std::span<uint8_t> m_mapping;
+};
+}
@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "X86.h"
+#include <array>
+#include <cstring>
+
+namespace JMP::X86
+{
+namespace
+{
+enum OpcodeFlags : uint32_t
+{
+    // The low four bits are how many bytes of immediate there are with a 32-bit operand size, so that enter (imm16,
+    // imm8) is just 3.
+    Immediate8 = 1,
+    Immediate16 = 2,
+    Immediate32 = 4,
+    ImmediateSizeMask = 0xF,
+
+    ModRM = 1 << 4,
+    // The immediate is 16 bits with a 16-bit operand size.
+    OperandSized = 1 << 5,
+    // The immediate is 64 bits with a 64-bit operand size (mov r, imm).
+    Widened = 1 << 6,
+    // A rel8 or rel32, which is always 32 bits whatever the operand size.
+    Relative = 1 << 7,
+    // A full address (mov al, [moffs]), 64 bits unless the address size is overridden.
+    MemoryOffset = 1 << 8,
+    // test/not/neg/mul/div, only test has an immediate.
+    Group3 = 1 << 9,
+    Invalid = 1 << 10,
+
+    // Only in the one-byte table, for the bytes that aren't opcodes on their own.
+    Prefix = 1 << 11,
+    OperandSizePrefix = 1 << 12,
+    AddressSizePrefix = 1 << 13,
+    // 66 or F2, which some 0F opcodes change meaning with.
+    MandatoryPrefix = 1 << 14,
+    // C4/C5 (VEX), 62 (EVEX) and 8F (XOP), which are only prefixes if nothing else is, and (for 8F) if what follows
+    // names one of XOP's maps, as otherwise it's pop r/m.
+    VectorPrefix = 1 << 15,
+    // Only in the two-byte table, for 0F 38 and 0F 3A.
+    Escape = 1 << 16,
+    // Only in the two-byte table, for SSE4a's extrq/insertq, which have two imm8s with 66 or F2.
+    TwoImmediatesWithMandatoryPrefix = 1 << 17,
+
+    // 16 or 32 bits, depending on operand size.
+    ImmediateZ = Immediate32 | OperandSized,
+    // 16, 32 or 64 bits, depending on operand size.
+    ImmediateV = Immediate32 | OperandSized | Widened,
+};
+
+using OpcodeTable = std::array<uint32_t, 256>;
+
+constexpr OpcodeTable make_one_byte_table()
+{
+    OpcodeTable table{};
+
+    // The arithmetic block: op r/m, r / op r, r/m / op al, imm8 / op eax, imm.
+    for (auto i = 0x00; i < 0x40; i += 8)
+    {
+        table[i + 0] = table[i + 1] = table[i + 2] = table[i + 3] = ModRM;
+        table[i + 4] = Immediate8;
+        table[i + 5] = ImmediateZ;
+    }
+
+    for (auto opcode : {0x06, 0x07, 0x0E, 0x16, 0x17, 0x1E, 0x1F, 0x27, 0x2F, 0x37, 0x3F, 0x60, 0x61, 0x82, 0x9A, 0xCE,
+                        0xD4, 0xD5, 0xD6, 0xEA})
+        table[opcode] = Invalid;
+
+    for (auto opcode : {0x26, 0x2E, 0x36, 0x3E, 0x64, 0x65, 0xF0, 0xF3})
+        table[opcode] = Prefix;
+
+    table[0x66] = Prefix | OperandSizePrefix | MandatoryPrefix;
+    table[0x67] = Prefix | AddressSizePrefix;
+    table[0xF2] = Prefix | MandatoryPrefix;
+
+    table[0x63] = ModRM;
+    table[0x68] = ImmediateZ;
+    table[0x69] = ModRM | ImmediateZ;
+    table[0x6A] = Immediate8;
+    table[0x6B] = ModRM | Immediate8;
+
+    for (auto i = 0x70; i <= 0x7F; i++)
+        table[i] = Immediate8 | Relative;
+
+    table[0x80] = ModRM | Immediate8;
+    table[0x81] = ModRM | ImmediateZ;
+    table[0x83] = ModRM | Immediate8;
+    for (auto i = 0x84; i <= 0x8F; i++)
+        table[i] = ModRM;
+
+    for (auto i = 0xA0; i <= 0xA3; i++)
+        table[i] = MemoryOffset;
+
+    table[0xA8] = Immediate8;
+    table[0xA9] = ImmediateZ;
+
+    for (auto i = 0xB0; i <= 0xB7; i++)
+        table[i] = Immediate8;
+    for (auto i = 0xB8; i <= 0xBF; i++)
+        table[i] = ImmediateV;
+
+    table[0xC0] = table[0xC1] = ModRM | Immediate8;
+    table[0xC2] = Immediate16;
+    table[0xC6] = ModRM | Immediate8;
+    table[0xC7] = ModRM | ImmediateZ;
+    table[0xC8] = Immediate16 | Immediate8;
+    table[0xCA] = Immediate16;
+    table[0xCD] = Immediate8;
+
+    for (auto i = 0xD0; i <= 0xD3; i++)
+        table[i] = ModRM;
+    for (auto i = 0xD8; i <= 0xDF; i++)
+        table[i] = ModRM;
+
+    for (auto i = 0xE0; i <= 0xE3; i++)
+        table[i] = Immediate8 | Relative;
+    for (auto i = 0xE4; i <= 0xE7; i++)
+        table[i] = Immediate8;
+
+    table[0xE8] = table[0xE9] = Immediate32 | Relative;
+    table[0xEB] = Immediate8 | Relative;
+
+    table[0xF6] = table[0xF7] = ModRM | Group3;
+    table[0xFE] = table[0xFF] = ModRM;
+
+    // les/lds/bound outside of 64-bit mode, so they're invalid when they aren't prefixes.
+    table[0xC4] = table[0xC5] = table[0x62] = Invalid | VectorPrefix;
+    table[0x8F] |= VectorPrefix;
+
+    return table;
+}
+
+constexpr OpcodeTable make_two_byte_table()
+{
+    OpcodeTable table{};
+    table.fill(ModRM);
+
+    for (auto opcode : {0x05, 0x06, 0x07, 0x08, 0x09, 0x0B, 0x0E, 0x77, 0xA0, 0xA1, 0xA2, 0xA8, 0xA9, 0xAA})
+        table[opcode] = 0;
+
+    for (auto i = 0x30; i <= 0x37; i++)
+        table[i] = 0;
+    for (auto i = 0xC8; i <= 0xCF; i++)
+        table[i] = 0;
+
+    for (auto opcode : {0x04, 0x0A, 0x0C, 0x24, 0x25, 0x26, 0x27, 0x36, 0x39, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F})
+        table[opcode] = Invalid;
+
+    for (auto i = 0x80; i <= 0x8F; i++)
+        table[i] = Immediate32 | Relative;
+
+    // The three-byte opcodes, which are never valid after a VEX prefix.
+    table[0x38] = table[0x3A] = Escape | Invalid;
+
+    table[0x78] = ModRM | TwoImmediatesWithMandatoryPrefix;
+
+    // 3DNow! has its real opcode as a trailing byte, which is the same as an imm8 for our purposes.
+    for (auto opcode : {0x0F, 0x70, 0x71, 0x72, 0x73, 0xA4, 0xAC, 0xBA, 0xC2, 0xC4, 0xC5, 0xC6})
+        table[opcode] = ModRM | Immediate8;
+
+    return table;
+}
+
+// What a ModRM byte brings with it. The low three bits are the displacement size, as far as the ModRM byte knows.
+enum ModRMFlags : uint8_t
+{
+    HasSIB = 1 << 3,
+    RIPRelative = 1 << 4,
+};
+
+constexpr std::array<uint8_t, 256> make_modrm_table()
+{
+    std::array<uint8_t, 256> table{};
+
+    for (auto modrm = 0; modrm < 256; modrm++)
+    {
+        auto mod = modrm >> 6;
+        auto rm = modrm & 7;
+
+        if (mod == 3)
+            continue;
+
+        uint8_t flags = mod == 1 ? 1 : mod == 2 ? 4 : 0;
+        if (rm == 4)
+            flags |= HasSIB;
+        else if (mod == 0 && rm == 5)
+            flags |= 4 | RIPRelative;
+
+        table[modrm] = flags;
+    }
+
+    return table;
+}
+
+// Indexed by whether there was a 0F escape.
+constexpr std::array<OpcodeTable, 2> opcode_tables{make_one_byte_table(), make_two_byte_table()};
+constexpr auto& one_byte_table = opcode_tables[0];
+constexpr auto& two_byte_table = opcode_tables[1];
+constexpr auto modrm_table = make_modrm_table();
+
+// The longest an instruction is allowed to be.
+constexpr size_t maximum_length = 15;
+// The furthest we might read: as many prefixes as an instruction can have, then either 8 bytes at once, or an EVEX
+// prefix and opcode, ModRM, and SIB.
+constexpr size_t maximum_read = maximum_length + 8;
+
+// How much must be readable from the start of an instruction to decode it in place.
+constexpr size_t padding = 32;
+static_assert(padding >= maximum_read);
+
+// Takes care of a VEX, EVEX or XOP prefix (and the opcode after it), leaving index at the ModRM byte.
+bool decode_vector_prefix(const uint8_t* code, size_t& index, Instruction& instruction, uint32_t& flags)
+{
+    auto first = instruction.opcode;
+
+    if (first == 0xC5)
+    {
+        instruction.encoding = Instruction::Encoding::VEX;
+        instruction.map = 1;
+        index += 1;
+    }
+    else if (first == 0x62)
+    {
+        // The fixed bit in P1 must be set.
+        if (!(code[index + 1] & 0x04))
+            return false;
+
+        instruction.encoding = Instruction::Encoding::EVEX;
+        instruction.map = code[index] & 0x07;
+        index += 3;
+    }
+    else
+    {
+        instruction.encoding = first == 0xC4 ? Instruction::Encoding::VEX : Instruction::Encoding::XOP;
+        instruction.map = code[index] & 0x1F;
+        index += 2;
+    }
+
+    instruction.opcode = code[index++];
+
+    // Everything has a ModRM byte, save for vzeroupper/vzeroall which the 0F table already knows about. EVEX's
+    // compressed disp8*N is still a single byte, so it doesn't change any lengths.
+    auto is_xop = instruction.encoding == Instruction::Encoding::XOP;
+    auto is_evex = instruction.encoding == Instruction::Encoding::EVEX;
+
+    switch (instruction.map)
+    {
+        case 1:
+            flags = is_xop ? Invalid : two_byte_table[instruction.opcode] & (ModRM | Immediate8 | Invalid);
+            return true;
+        case 2:
+            flags = is_xop ? Invalid : ModRM;
+            return true;
+        case 3:
+            flags = is_xop ? Invalid : ModRM | Immediate8;
+            return true;
+        case 5:
+        case 6:
+            flags = is_evex ? ModRM : Invalid;
+            return true;
+        case 8:
+            flags = is_xop ? ModRM | Immediate8 : Invalid;
+            return true;
+        case 9:
+            flags = is_xop ? ModRM : Invalid;
+            return true;
+        case 10:
+            flags = is_xop ? ModRM | Immediate32 : Invalid;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Fills in instruction (which must start out empty), or returns false if it's invalid. Decoding reads without bounds
+// checks (and past the end of invalid or truncated instructions), so code must have at least padding bytes readable,
+// even if only size of them are the instruction.
+bool decode_into(const uint8_t* code, size_t size, Instruction& instruction)
+{
+    size_t index{};
+    uint32_t prefixes{};
+
+    auto flags = one_byte_table[code[0]];
+    while (flags & Prefix)
+    {
+        prefixes |= flags;
+        if (++index >= maximum_length)
+            return false;
+
+        flags = one_byte_table[code[index]];
+    }
+
+    // Whether the common parts of an instruction (REX, 0F, ModRM, SIB, displacement, immediate) are there is far too
+    // unpredictable to branch on, so they're worked out arithmetically instead, leaving branches for the rare parts.
+    // They all come from one load, too, as a chain of loads (each depending on where the last part ended) is slower.
+    uint64_t window;
+    memcpy(&window, code + index, sizeof(window));
+
+    uint32_t has_rex = (window & 0xF0) == 0x40;
+    uint8_t rex = window & (0xFF * has_rex);
+    window >>= 8 * has_rex;
+
+    uint32_t is_escaped = (window & 0xFF) == 0x0F;
+    window >>= 8 * is_escaped;
+
+    uint8_t opcode = window;
+    flags = opcode_tables[is_escaped][opcode];
+
+    size_t opcode_offset = index + has_rex;
+    index = opcode_offset + is_escaped + 1;
+
+    instruction.rex = rex;
+    instruction.opcode_offset = opcode_offset;
+    instruction.map = is_escaped;
+    instruction.opcode = opcode;
+
+    uint8_t modrm = window >> 8;
+    uint8_t sib = window >> 16;
+
+    if (flags & (Escape | VectorPrefix | TwoImmediatesWithMandatoryPrefix | Invalid))
+    {
+        if (flags & Escape)
+        {
+            // 0F 38 and 0F 3A, as the 0F itself was taken care of above.
+            instruction.map = instruction.opcode == 0x38 ? 2 : 3;
+            flags = instruction.opcode == 0x38 ? ModRM : ModRM | Immediate8;
+            instruction.opcode = code[index++];
+            modrm = code[index];
+            sib = code[index + 1];
+        }
+        else if ((flags & VectorPrefix) && !rex && (instruction.opcode != 0x8F || (code[index] & 0x1F) >= 8))
+        {
+            if (!decode_vector_prefix(code, index, instruction, flags))
+                return false;
+
+            modrm = code[index];
+            sib = code[index + 1];
+        }
+        else if ((flags & TwoImmediatesWithMandatoryPrefix) && (prefixes & MandatoryPrefix))
+        {
+            flags |= Immediate16;
+        }
+
+        if (flags & Invalid)
+            return false;
+    }
+
+    instruction.opcode_size = index - opcode_offset;
+
+    uint32_t has_modrm = (flags & ModRM) != 0;
+    uint32_t modrm_flags = modrm_table[modrm] & (0xFF * has_modrm);
+    uint32_t has_sib = (modrm_flags & HasSIB) != 0;
+
+    // A SIB with no base (and no displacement of its own) has a disp32 instead.
+    uint32_t displacement_size = modrm_flags & 7;
+    displacement_size |= (has_sib & ((sib & 7) == 5) & ((modrm >> 6) == 0)) << 2;
+
+    instruction.has_modrm = has_modrm;
+    instruction.modrm_offset = index * has_modrm;
+    index += has_modrm;
+
+    instruction.has_sib = has_sib;
+    instruction.sib_offset = index * has_sib;
+    index += has_sib;
+
+    instruction.is_rip_relative = modrm_flags & RIPRelative;
+    instruction.displacement_offset = index * (displacement_size != 0);
+    instruction.displacement_size = displacement_size;
+    index += displacement_size;
+
+    if (flags & (Group3 | MemoryOffset))
+    {
+        if ((flags & Group3) && ((modrm >> 3) & 7) < 2)
+            flags |= instruction.opcode == 0xF6 ? Immediate8 : ImmediateZ;
+
+        if (flags & MemoryOffset)
+        {
+            instruction.displacement_offset = index;
+            instruction.displacement_size = (prefixes & AddressSizePrefix) ? 4 : 8;
+            index += instruction.displacement_size;
+        }
+    }
+
+    uint32_t is_64_bit_operand = (rex >> 3) & 1;
+    uint32_t is_16_bit_operand = ((prefixes & OperandSizePrefix) != 0) & !is_64_bit_operand;
+
+    uint32_t immediate_size = flags & ImmediateSizeMask;
+    immediate_size -= 2 * (is_16_bit_operand & ((flags & OperandSized) != 0));
+    immediate_size += 4 * (is_64_bit_operand & ((flags & Widened) != 0));
+
+    instruction.immediate_offset = index * (immediate_size != 0);
+    instruction.immediate_size = immediate_size;
+    instruction.is_relative_branch = flags & Relative;
+    index += immediate_size;
+
+    if (index > std::min(size, maximum_length))
+        return false;
+
+    instruction.length = index;
+    return true;
+}
+
+// Anything too short to decode in place is copied somewhere that isn't first.
+bool decode_padded(std::span<const uint8_t> bytes, Instruction& instruction)
+{
+    std::array<uint8_t, padding> padded{};
+    memcpy(padded.data(), bytes.data(), bytes.size());
+    return decode_into(padded.data(), bytes.size(), instruction);
+}
+}
+
+std::optional<Instruction> decode(std::span<const uint8_t> bytes)
+{
+    // Decoded in place, as building it elsewhere and copying it in costs more than the decoding does.
+    std::optional<Instruction> instruction{std::in_place};
+
+    auto is_valid = bytes.size() >= padding ? decode_into(bytes.data(), bytes.size(), *instruction)
+                                            : decode_padded(bytes, *instruction);
+    if (!is_valid)
+        instruction.reset();
+
+    return instruction;
+}
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023, James Puleo <james@jame.xyz>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace JMP::X86
+{
+// Where the parts of a decoded (64-bit mode) instruction are. Offsets are from the start of the instruction, and
+// sizes of zero mean the instruction doesn't have that part.
+struct Instruction
+{
+    enum class Encoding : uint8_t
+    {
+        Legacy,
+        VEX,
+        EVEX,
+        XOP
+    };
+
+    uint8_t length{};
+    Encoding encoding{Encoding::Legacy};
+    // Which opcode table: 0 for one-byte opcodes, 1 for 0F, 2 for 0F 38, 3 for 0F 3A. VEX, EVEX and XOP say so
+    // themselves, which is how EVEX gets to 5 and 6, and XOP to 8, 9 and 10.
+    uint8_t map{};
+    // The last byte of the opcode, which is what tells instructions in a map apart.
+    uint8_t opcode{};
+    uint8_t opcode_offset{};
+    // Including escape bytes and VEX/EVEX/XOP prefixes, so 0F 38 xx is 3, and C5 xx xx is also 3.
+    uint8_t opcode_size{};
+    // Zero when there isn't one, as it always comes right before the opcode.
+    uint8_t rex{};
+    uint8_t modrm_offset{};
+    bool has_modrm{};
+    uint8_t sib_offset{};
+    bool has_sib{};
+    uint8_t displacement_offset{};
+    uint8_t displacement_size{};
+    uint8_t immediate_offset{};
+    uint8_t immediate_size{};
+    // The displacement is a disp32 relative to the end of the instruction.
+    bool is_rip_relative{};
+    // The immediate is a rel8 or rel32 branch target relative to the end of the instruction.
+    bool is_relative_branch{};
+};
+
+// Decodes the length (and layout) of the instruction at the start of bytes. Returns nothing if it is invalid in 64-bit
+// mode, something we don't understand, or doesn't fit in bytes.
+std::optional<Instruction> decode(std::span<const uint8_t> bytes);
+}